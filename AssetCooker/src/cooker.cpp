@@ -0,0 +1,299 @@
+// AssetCooker
+// Converts source assets into the packed archive N-Gin loads at startup (see asset_archive.h).
+//
+// Usage: AssetCooker [-o archive] [assets...]
+//
+// Run it from the VulkanTutorial directory, asset names are stored exactly as they're passed in
+// and the runtime looks them up by the same relative paths. Without any assets it cooks the model,
+// texture and shaders the sample uses into ASSET_ARCHIVE_PATH.
+//
+//	.obj .gltf .glb					mesh, simplified into LODs and split into meshlets
+//	.png .bmp .jpg .jpeg .tga		texture, mipped and compressed to UASTC (transcoded to BC7 at load)
+//	.ktx2							texture, copied as is
+//	.vert .frag .comp ...			shader, compiled to SPIR-V with the same options the runtime uses
+
+#include "vertex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "asset_archive.h"
+#include "asset_cache.h"
+#include "constants.h"
+#include "mesh.h"
+#include "shader_compiler.h"
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#endif
+
+#ifndef STB_IMAGE_RESIZE_IMPLEMENTATION
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+#endif
+
+#include <ktx.h>
+
+namespace
+{
+	using CookedAsset = std::pair<std::string, std::vector<char>>;
+
+	std::string GetExtension(const std::string& path)
+	{
+		std::string extension = path.substr(path.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		return extension;
+	}
+
+	uint64_t AlignUp(uint64_t value)
+	{
+		return (value + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+	}
+
+	// Does everything SampleModel::Initialize would otherwise do at runtime.
+	std::vector<char> CookMesh(const std::string& path)
+	{
+		Mesh mesh;
+		mesh.LoadModel(path.c_str());
+		mesh.GenerateLods(MESH_LOD_COUNT, MESH_LOD_REDUCTION);
+		mesh.BuildMeshlets(MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+
+		return mesh.Serialize();
+	}
+
+	void CheckKtx(KTX_error_code result, const std::string& what, const std::string& path)
+	{
+		if (result != KTX_SUCCESS)
+		{
+			throw std::runtime_error("Failed to " + what + " " + path + " (" + ktxErrorString(result) + ")");
+		}
+	}
+
+	std::vector<char> CookTexture(const std::string& path)
+	{
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			throw std::runtime_error("Failed to load texture " + path);
+		}
+
+		auto mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+		ktxTextureCreateInfo createInfo{};
+		{
+			createInfo.vkFormat = VK_FORMAT_R8G8B8A8_SRGB;
+			createInfo.baseWidth = static_cast<ktx_uint32_t>(width);
+			createInfo.baseHeight = static_cast<ktx_uint32_t>(height);
+			createInfo.baseDepth = 1;
+			createInfo.numDimensions = 2;
+			createInfo.numLevels = mipLevels;
+			createInfo.numLayers = 1;
+			createInfo.numFaces = 1;
+			createInfo.isArray = KTX_FALSE;
+			createInfo.generateMipmaps = KTX_FALSE;
+		}
+
+		ktxTexture2* texture = nullptr;
+		CheckKtx(ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture), "create KTX2 texture for", path);
+
+		// Each level is filtered down from the one before it, in linear space.
+		std::vector<stbi_uc> level(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(pixels);
+
+		for (uint32_t mip = 0; mip < mipLevels; ++mip)
+		{
+			CheckKtx(ktxTexture_SetImageFromMemory(ktxTexture(texture), mip, 0, 0, level.data(), level.size()), "store mip of", path);
+
+			if (mip + 1 < mipLevels)
+			{
+				int mipWidth = std::max(1, width / 2);
+				int mipHeight = std::max(1, height / 2);
+
+				std::vector<stbi_uc> next(static_cast<size_t>(mipWidth) * mipHeight * 4);
+				stbir_resize_uint8_srgb(level.data(), width, height, 0, next.data(), mipWidth, mipHeight, 0, 4, 3, 0);
+
+				level.swap(next);
+				width = mipWidth;
+				height = mipHeight;
+			}
+		}
+
+		// UASTC transcodes to BC7 with little loss, zstd on top keeps the archive small.
+		ktxBasisParams params{};
+		{
+			params.structSize = sizeof(params);
+			params.uastc = KTX_TRUE;
+			params.uastcFlags = KTX_PACK_UASTC_LEVEL_DEFAULT;
+			params.threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		CheckKtx(ktxTexture2_CompressBasisEx(texture, &params), "compress", path);
+		CheckKtx(ktxTexture2_DeflateZstd(texture, 18), "supercompress", path);
+
+		ktx_uint8_t* bytes = nullptr;
+		ktx_size_t size = 0;
+		CheckKtx(ktxTexture_WriteToMemory(ktxTexture(texture), &bytes, &size), "write", path);
+
+		std::vector<char> blob(bytes, bytes + size);
+
+		free(bytes);
+		ktxTexture_Destroy(ktxTexture(texture));
+
+		return blob;
+	}
+
+	std::vector<char> CookAsset(const std::string& path)
+	{
+		auto extension = GetExtension(path);
+
+		if (extension == "obj" || extension == "gltf" || extension == "glb")
+		{
+			return CookMesh(path);
+		}
+
+		if (extension == "png" || extension == "bmp" || extension == "jpg" || extension == "jpeg" || extension == "tga")
+		{
+			return CookTexture(path);
+		}
+
+		if (extension == "vert" || extension == "frag" || extension == "comp" || extension == "geom" || extension == "tesc" || extension == "tese")
+		{
+			// Stored under the source's name, that's what the runtime looks up.
+			auto code = CompileShader(path).Span();
+			return std::vector<char>(code.begin(), code.end());
+		}
+
+		if (extension == "ktx2")
+		{
+			MappedFile file(path, MappedFileAccess::Sequential);
+			return std::vector<char>(file.Data(), file.Data() + file.Size());
+		}
+
+		throw std::runtime_error("Don't know how to cook " + path);
+	}
+
+	void WriteArchive(const std::string& path, const std::vector<CookedAsset>& assets)
+	{
+		ArchiveHeader header{};
+		{
+			header.magic = ARCHIVE_MAGIC;
+			header.version = ARCHIVE_VERSION;
+			header.entryCount = static_cast<uint32_t>(assets.size());
+			header.tocOffset = sizeof(ArchiveHeader);
+		}
+
+		// The header and table of contents fit in the first page or so, every blob starts on its own page.
+		std::vector<ArchiveEntry> toc(assets.size());
+		uint64_t offset = AlignUp(header.tocOffset + toc.size() * sizeof(ArchiveEntry));
+
+		for (size_t i = 0; i < assets.size(); ++i)
+		{
+			const auto& name = assets[i].first;
+			if (name.size() >= sizeof(toc[i].name))
+			{
+				throw std::runtime_error("Asset path is too long for the archive: " + name);
+			}
+
+			memset(toc[i].name, 0, sizeof(toc[i].name));
+			memcpy(toc[i].name, name.data(), name.size());
+			toc[i].offset = offset;
+			toc[i].size = assets[i].second.size();
+
+			offset = AlignUp(offset + toc[i].size);
+		}
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open " + path + " for writing");
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(toc.data()), toc.size() * sizeof(ArchiveEntry));
+
+		const std::vector<char> padding(ARCHIVE_ALIGNMENT, 0);
+		for (size_t i = 0; i < assets.size(); ++i)
+		{
+			auto position = static_cast<uint64_t>(file.tellp());
+			file.write(padding.data(), static_cast<std::streamsize>(toc[i].offset - position));
+			file.write(assets[i].second.data(), static_cast<std::streamsize>(assets[i].second.size()));
+		}
+
+		// Pad the last blob too so the file size is page aligned.
+		auto position = static_cast<uint64_t>(file.tellp());
+		file.write(padding.data(), static_cast<std::streamsize>(AlignUp(position) - position));
+
+		if (!file.good())
+		{
+			throw std::runtime_error("Failed to write " + path);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string output = ASSET_ARCHIVE_PATH;
+	std::vector<std::string> sources;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "-o" && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else
+		{
+			// Names are looked up with forward slashes at runtime.
+			std::replace(arg.begin(), arg.end(), '\\', '/');
+			sources.push_back(arg);
+		}
+	}
+
+	if (sources.empty())
+	{
+		sources = {
+			MODEL_PATH,
+			TEXTURE_PATH,
+			SHADER_DIRECTORY + "vs.vert",
+			SHADER_DIRECTORY + "fs.frag",
+			SHADER_DIRECTORY + "cull.comp",
+		};
+	}
+
+	// Shaders the app already compiled (or the other way around) come out of the same cache.
+	AssetCache::Get().SetDirectory(ASSET_CACHE_DIRECTORY);
+
+	try
+	{
+		std::vector<CookedAsset> assets;
+		for (const auto& source : sources)
+		{
+			std::cout << "Cooking " << source << std::endl;
+			assets.emplace_back(source, CookAsset(source));
+		}
+
+		WriteArchive(output, assets);
+
+		std::cout << "Wrote " << assets.size() << " assets to " << output << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -852,6 +852,17 @@ static void ImGui_ImplVulkan_CreatePipeline(VkDevice device, const VkAllocationC
     info.layout = g_PipelineLayout;
     info.renderPass = renderPass;
     info.subpass = subpass;
+
+    VkPipelineRenderingCreateInfoKHR rendering_info = {};
+    rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachmentFormats = &g_VulkanInitInfo.ColorAttachmentFormat;
+    if (g_VulkanInitInfo.UseDynamicRendering)
+    {
+        info.pNext = &rendering_info;
+        info.renderPass = VK_NULL_HANDLE;
+    }
+
     VkResult err = vkCreateGraphicsPipelines(device, pipelineCache, 1, &info, allocator, pipeline);
     check_vk_result(err);
 }
@@ -997,7 +1008,10 @@ bool    ImGui_ImplVulkan_Init(ImGui_ImplVulkan_InitInfo* info, VkRenderPass rend
     IM_ASSERT(info->DescriptorPool != VK_NULL_HANDLE);
     IM_ASSERT(info->MinImageCount >= 2);
     IM_ASSERT(info->ImageCount >= info->MinImageCount);
-    IM_ASSERT(render_pass != VK_NULL_HANDLE);
+    if (info->UseDynamicRendering)
+        IM_ASSERT(info->ColorAttachmentFormat != VK_FORMAT_UNDEFINED);
+    else
+        IM_ASSERT(render_pass != VK_NULL_HANDLE);
 
     g_VulkanInitInfo = *info;
     g_RenderPass = render_pass;
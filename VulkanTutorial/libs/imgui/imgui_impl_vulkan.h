@@ -58,6 +58,8 @@ struct ImGui_ImplVulkan_InitInfo
     VkSampleCountFlagBits           MSAASamples;            // >= VK_SAMPLE_COUNT_1_BIT
     const VkAllocationCallbacks*    Allocator;
     void                            (*CheckVkResultFn)(VkResult err);
+    bool                            UseDynamicRendering;    // Draw between vkCmdBeginRenderingKHR/vkCmdEndRenderingKHR (VK_KHR_dynamic_rendering), render_pass is ignored
+    VkFormat                        ColorAttachmentFormat;  // Required with UseDynamicRendering
 };
 
 // Called by user code
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Packed archive written by the AssetCooker tool.
+//
+// Layout:
+//   ArchiveHeader
+//   ArchiveEntry[entryCount]		table of contents
+//   blobs, each starting on an ARCHIVE_ALIGNMENT boundary
+//
+// Blob contents depend on the source asset:
+//   meshes   - Mesh::Serialize, already simplified into LODs and split into meshlets
+//   textures - KTX2 with the full mip chain
+//   shaders  - SPIR-V
+
+static const uint32_t ARCHIVE_MAGIC = 0x4B50474E;	// "NGPK"
+static const uint32_t ARCHIVE_VERSION = 1;
+static const uint64_t ARCHIVE_ALIGNMENT = 4096;		// Page aligned so blobs can be mapped and read without straddling pages.
+
+struct ArchiveHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	uint64_t tocOffset;
+};
+
+struct ArchiveEntry
+{
+	char name[112];		// Source path the asset was cooked from, e.g. "meshes/wahoo.obj"
+	uint64_t offset;	// From the start of the archive
+	uint64_t size;
+};
+
+static_assert(sizeof(ArchiveEntry) == 128, "Archive entries are read straight out of the file");
+
+// Read side of the archive. The whole file is mapped once, so a cold start is a few large
+// sequential reads instead of opening every asset on its own.
+class AssetArchive
+{
+	static inline AssetArchive* s_archive;
+
+public:
+	static AssetArchive& Get()
+	{
+		if (!s_archive)
+		{
+			s_archive = new AssetArchive();
+		}
+
+		return *s_archive;
+	}
+
+	// Leaves the archive empty if the file doesn't exist, everything is then loaded from the source files.
+	bool Open(const std::string& path)
+	{
+		m_entries.clear();
+
+		if (!std::ifstream(path).good())
+		{
+			return false;
+		}
+
+		m_file = MappedFile(path);
+
+		ArchiveHeader header{};
+		if (m_file.Size() < sizeof(header))
+		{
+			throw std::runtime_error("Asset archive is truncated: " + path);
+		}
+
+		memcpy(&header, m_file.Data(), sizeof(header));
+		if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION)
+		{
+			throw std::runtime_error("Asset archive is from a different cooker version: " + path);
+		}
+
+		if (header.tocOffset + header.entryCount * sizeof(ArchiveEntry) > m_file.Size())
+		{
+			throw std::runtime_error("Asset archive is truncated: " + path);
+		}
+
+		for (uint32_t i = 0; i < header.entryCount; ++i)
+		{
+			ArchiveEntry entry;
+			memcpy(&entry, m_file.Data() + header.tocOffset + i * sizeof(ArchiveEntry), sizeof(entry));
+
+			if (entry.offset + entry.size > m_file.Size())
+			{
+				throw std::runtime_error("Asset archive is truncated: " + path);
+			}
+
+			entry.name[sizeof(entry.name) - 1] = '\0';
+			m_entries[entry.name] = entry;
+		}
+
+		return true;
+	}
+
+	bool IsOpen() const { return !m_entries.empty(); }
+
+	// Used once the source file is newer than what was cooked (hot reload), later lookups go to the file.
+	void Remove(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.erase(name);
+	}
+
+	// Called from loader threads too.
+	std::optional<ByteSpan> Find(const std::string& name, MappedFileAccess access = MappedFileAccess::Normal) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_entries.find(name);
+		if (it == m_entries.end())
+		{
+			return std::nullopt;
+		}
+
+		m_file.Advise(access, it->second.offset, it->second.size);
+
+		return m_file.Span(it->second.offset, it->second.size);
+	}
+
+private:
+	MappedFile m_file;
+	std::unordered_map<std::string, ArchiveEntry> m_entries;
+	mutable std::mutex m_mutex;
+};
+
+// Bytes of an asset, either a blob inside the archive or the source file mapped on its own.
+// Nothing is copied, the span stays valid as long as this does.
+class MappedAsset
+{
+public:
+	MappedAsset(const std::string& path, MappedFileAccess access = MappedFileAccess::Sequential)
+	{
+		if (auto asset = AssetArchive::Get().Find(path, access))
+		{
+			m_bytes = *asset;
+			return;
+		}
+
+		m_file = MappedFile(path, access);
+		m_bytes = m_file.Span();
+	}
+
+	ByteSpan Span() const { return m_bytes; }
+
+private:
+	MappedFile m_file;
+	ByteSpan m_bytes;
+};
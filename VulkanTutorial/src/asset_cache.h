@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#endif
+
+#include "image.h"
+#include "mapped_file.h"
+
+// Content hash of an asset's source bytes together with the settings it was imported with.
+// Two assets with the same hash produce the same derived data and GPU resources.
+struct AssetHash
+{
+	uint64_t value = 0;
+
+	bool operator==(const AssetHash& other) const { return value == other.value; }
+
+	std::string ToString() const
+	{
+		char text[17];
+		snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+		return text;
+	}
+};
+
+namespace std {
+	template<> struct hash<AssetHash> {
+		size_t operator()(AssetHash const& assetHash) const {
+			return static_cast<size_t>(assetHash.value);
+		}
+	};
+}
+
+// Settings has to be a plain struct of 32 bit fields, its bytes are hashed as they are and padding would make the hash unstable.
+template<typename Settings>
+static AssetHash HashAsset(ByteSpan bytes, const Settings& settings)
+{
+	static_assert(std::is_trivially_copyable_v<Settings> && sizeof(Settings) % 4 == 0, "Settings are hashed byte for byte");
+
+	XXH3_state_t state;
+	XXH3_64bits_reset(&state);
+	XXH3_64bits_update(&state, bytes.data, bytes.size);
+	XXH3_64bits_update(&state, &settings, sizeof(Settings));
+
+	return AssetHash{ XXH3_64bits_digest(&state) };
+}
+
+// Writes the parts one after the other, creating the directory if needed. Written next to the file and renamed
+// so a half written file is never picked up. Everything stored this way can be rebuilt, so a failure is returned
+// rather than thrown.
+static bool WriteFileAtomically(const std::filesystem::path& path, std::initializer_list<ByteSpan> parts)
+{
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	auto temporaryPath = path;
+	temporaryPath += ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		for (const auto& part : parts)
+		{
+			file.write(part.data, static_cast<std::streamsize>(part.size));
+		}
+
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temporaryPath, path, error);
+	return !error;
+}
+
+// Destroys the resource along with the last reference to it.
+// Also used directly for resources that aren't shared by content, e.g. a texture with its top mips dropped.
+template<typename Resource>
+static std::shared_ptr<Resource> MakeSharedResource(Resource&& resource)
+{
+	return std::shared_ptr<Resource>(new Resource(std::move(resource)), [](Resource* released)
+	{
+		released->Destroy();
+		delete released;
+	});
+}
+
+// Hands out shared GPU resources by content hash. The cache only holds weak references, a resource
+// is destroyed as soon as the last user lets go of it and is created again the next time it's asked for.
+template<typename Resource>
+class ResourceCache
+{
+public:
+	std::shared_ptr<Resource> Find(AssetHash hash)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_resources.find(hash);
+		if (it == m_resources.end())
+		{
+			return nullptr;
+		}
+
+		auto resource = it->second.lock();
+		if (!resource)
+		{
+			m_resources.erase(it);
+		}
+
+		return resource;
+	}
+
+	// If the same content was inserted in the meantime, that copy wins and this one is destroyed.
+	std::shared_ptr<Resource> Insert(AssetHash hash, Resource&& resource)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto& entry = m_resources[hash];
+		if (auto existing = entry.lock())
+		{
+			resource.Destroy();
+			return existing;
+		}
+
+		auto shared = MakeSharedResource(std::move(resource));
+
+		entry = shared;
+
+		return shared;
+	}
+
+	size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_resources.size();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::unordered_map<AssetHash, std::weak_ptr<Resource>> m_resources;
+};
+
+// A sampled texture on the GPU, shared between everything that uses the same image.
+struct GpuTexture
+{
+	Image image;
+	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t mipLevels = 1;
+	uint32_t layerCount = 1;	// More than one for atlases, see TextureAtlas.
+
+	void Destroy()
+	{
+		image.Cleanup();
+	}
+
+	// What the image takes up in device memory, including alignment.
+	VkDeviceSize MemorySize() const
+	{
+		VkMemoryRequirements memoryRequirements{};
+		vkGetImageMemoryRequirements(VulkanManager::GetVulkanManager().GetDevice(), image.m_image, &memoryRequirements);
+		return memoryRequirements.size;
+	}
+};
+
+// Shared resources plus derived artifacts (e.g. processed meshes) persisted on disk between runs,
+// named by the hash of whatever they were derived from.
+class AssetCache
+{
+	static inline AssetCache* s_cache;
+
+public:
+	static AssetCache& Get()
+	{
+		if (!s_cache)
+		{
+			s_cache = new AssetCache();
+		}
+
+		return *s_cache;
+	}
+
+	void SetDirectory(const std::string& directory)
+	{
+		m_directory = directory;
+	}
+
+	// Maps the artifact if an earlier run stored one for this hash.
+	std::optional<MappedFile> LoadDerived(AssetHash hash, const std::string& extension) const
+	{
+		auto path = DerivedPath(hash, extension);
+
+		std::error_code error;
+		if (!std::filesystem::exists(path, error))
+		{
+			return std::nullopt;
+		}
+
+		return MappedFile(path.string(), MappedFileAccess::Sequential);
+	}
+
+	// A failed write only costs the next run the time to derive it again.
+	bool StoreDerived(AssetHash hash, const std::string& extension, ByteSpan bytes) const
+	{
+		return WriteFileAtomically(DerivedPath(hash, extension), { bytes });
+	}
+
+	ResourceCache<GpuTexture> m_textures;
+
+private:
+	std::filesystem::path DerivedPath(AssetHash hash, const std::string& extension) const
+	{
+		return std::filesystem::path(m_directory) / (hash.ToString() + extension);
+	}
+
+	std::string m_directory;
+};
@@ -27,7 +27,7 @@ public:
 		// VK_BUFFER_USAGE_TRANSFER_DST_BIT - Use this buffer as the destination in transferring memory.
 		// VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT - The most optimal use of memory. We need to use a staging buffer for this since it's not directly accessible with CPU.
 		// The vertex buffer is device local. This means that we can't map memory directly to it but we can copy data from another buffer over.
-		VulkanManager::GetVulkanManager().CreateBuffer(m_size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_buffer, m_memory);
+		VulkanManager::GetVulkanManager().CreateBuffer(m_size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_buffer, m_memory, &m_allocationSize);
 
 		// Copy from staging to vertex buffer
 		VulkanManager::GetVulkanManager().CopyBuffer(stagingBuffer, m_buffer, commandPool, m_size);
@@ -41,7 +41,7 @@ public:
 	
 	Buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) : m_size(size)
 	{
-		VulkanManager::GetVulkanManager().CreateBuffer(size, usage, properties, m_buffer, m_memory);
+		VulkanManager::GetVulkanManager().CreateBuffer(size, usage, properties, m_buffer, m_memory, &m_allocationSize);
 	}
 
 	template<typename T>
@@ -68,7 +68,52 @@ public:
 		vkUnmapMemory(device, m_memory);
 	}
 
-	VkDeviceSize m_size;
-	VkBuffer m_buffer;
-	VkDeviceMemory m_memory;
+	// Maps a host visible buffer and lets write fill it in place, for data that can be produced
+	// straight into the buffer instead of being copied in.
+	template<typename Function>
+	void Write(Function&& write)
+	{
+		auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+		void* data;
+		vkMapMemory(device, m_memory, 0, m_size, 0, &data);
+		try
+		{
+			write(data);
+		}
+		catch (...)
+		{
+			vkUnmapMemory(device, m_memory);
+			throw;
+		}
+		vkUnmapMemory(device, m_memory);
+	}
+
+	// Copy the contents of a host visible buffer back to the CPU.
+	template<typename T>
+	void Read(T* copyData, size_t size)
+	{
+		auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+		void* data;
+		vkMapMemory(device, m_memory, 0, size, 0, &data);
+		memcpy(copyData, data, size);
+		vkUnmapMemory(device, m_memory);
+	}
+
+	void Destroy()
+	{
+		vkDestroyBuffer(VulkanManager::GetVulkanManager().GetDevice(), m_buffer, nullptr);
+		vkFreeMemory(VulkanManager::GetVulkanManager().GetDevice(), m_memory, nullptr);
+
+		m_size = 0;
+		m_allocationSize = 0;
+		m_buffer = VK_NULL_HANDLE;
+		m_memory = VK_NULL_HANDLE;
+	}
+
+	VkDeviceSize m_size = 0;
+	VkDeviceSize m_allocationSize = 0;	// Device memory actually allocated, m_size rounded up to the alignment.
+	VkBuffer m_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_memory = VK_NULL_HANDLE;
 };
@@ -11,9 +11,46 @@ static const int MAX_FRAMES_IN_FLIGHT = 2;
 
 static const std::string MODEL_PATH = "meshes/wahoo.obj";
 static const std::string TEXTURE_PATH = "textures/wahoo.bmp";
+static const std::string MODEL_DIRECTORY = "meshes/";	// Listed by the model browser.
 
 static const std::string SHADER_DIRECTORY = "src/shaders/";
 
+// Written by the AssetCooker tool. Assets that aren't in it are loaded from the paths above.
+static const std::string ASSET_ARCHIVE_PATH = "assets.pak";
+// Meshes processed at runtime are kept here, named by the hash of their source file and import settings.
+static const std::string ASSET_CACHE_DIRECTORY = "cache/";
+
+// Compiled pipelines from the last run, only reused on the same device and driver.
+static const std::string PIPELINE_CACHE_PATH = "cache/pipelines.bin";
+// Material permutations earlier runs drew with, compiled at startup before anything asks for them.
+static const std::string PIPELINE_USAGE_PATH = "cache/pipelines_used.bin";
+
+// Mesh LODs
+static const uint32_t MESH_LOD_COUNT = 6;
+static const float MESH_LOD_REDUCTION = 0.5f;		// Fraction of the previous LOD's triangles to keep.
+static const float MESH_LOD_PIXEL_ERROR = 1.0f;		// How far a LOD may deviate on screen before switching to a finer one.
+
+// Meshlets
+static const uint32_t MESHLET_MAX_VERTICES = 64;
+static const uint32_t MESHLET_MAX_TRIANGLES = 124;
+static const uint32_t MESHLET_CULL_GROUP_SIZE = 64;	// Has to match local_size_x in cull.comp.
+
+// Texture atlases
+static const uint32_t TEXTURE_ATLAS_SIZE = 2048;
+static const uint32_t TEXTURE_ATLAS_GUTTER = 8;				// Texels around each texture, keeps the first 4 mips from bleeding.
+static const uint32_t TEXTURE_ATLAS_MAX_TEXTURE_SIZE = 256;	// Anything larger keeps its own image.
+
+// Residency
+static const float RESIDENCY_BUDGET_FRACTION = 0.5f;		// Share of device local memory textures and meshes may use by default.
+static const uint32_t RESIDENCY_MIN_TEXTURE_SIZE = 64;		// Textures are never trimmed below this.
+
+// Model browser
+static const uint32_t MODEL_THUMBNAIL_SIZE = 32;
+
+// Material permutations
+static const uint32_t MATERIAL_MAX_LIGHTS = 4;	// Has to match MAX_LIGHTS in fs.frag.
+static const bool g_prewarmPermutations = true;	// Build every permutation the UI can select in the background at startup.
+
 const std::vector<static const char*> g_validationLayers = {
 	"VK_LAYER_KHRONOS_validation",
 };
@@ -22,12 +59,27 @@ const std::vector<static const char*> g_deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 };
 
+// Record passes with VK_KHR_dynamic_rendering when the device has it, no render pass or framebuffer objects.
+// Render passes are the fallback.
+static const bool g_preferDynamicRendering = true;
+
+// Link graphics pipelines from VK_EXT_graphics_pipeline_library parts when the device has it (and links them fast).
+// Creating every pipeline whole with vkCreateGraphicsPipelines is the fallback.
+static const bool g_preferGraphicsPipelineLibrary = true;
+
 #ifdef NDEBUG
 static const bool g_enableValidationLayers = false;
 #else
 static const bool g_enableValidationLayers = true;
 #endif
 
+// Hot reload of shaders, meshes and textures while the app runs.
+#ifdef NDEBUG
+static const bool g_enableHotReload = false;
+#else
+static const bool g_enableHotReload = true;
+#endif
+
 #define SELECT_FIRST_DEVICE
 #ifdef SELECT_FIRST_DEVICE
 #define SELECT_FIRST_DEVICE
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+// Reports when watched files are written, or when anything in a watched directory changes.
+// Linux gets notified through inotify. Everywhere else the modification times are checked,
+// which is fine for the handful of files hot reload cares about. Directories use change
+// notifications on Windows.
+class FileWatcher
+{
+public:
+	FileWatcher()
+	{
+#ifdef __linux__
+		m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_inotify < 0)
+		{
+			std::cerr << "Failed to initialize inotify, hot reload is disabled" << std::endl;
+		}
+#endif
+	}
+
+	~FileWatcher()
+	{
+#ifdef __linux__
+		if (m_inotify >= 0)
+		{
+			close(m_inotify);
+		}
+#elif defined(_WIN32)
+		for (auto& directory : m_directories)
+		{
+			FindCloseChangeNotification(directory.notification);
+		}
+#endif
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// Changes are reported with the path exactly as it was passed in here.
+	void Watch(const std::string& path)
+	{
+#ifdef __linux__
+		if (m_inotify < 0)
+		{
+			return;
+		}
+
+		// Editors often save by writing a new file and renaming it over the old one, which would
+		// drop a watch on the file itself. Watching the directory catches both.
+		std::filesystem::path filePath(path);
+		auto directory = filePath.parent_path().empty() ? std::string(".") : filePath.parent_path().string();
+
+		// Added to whatever else is watched in the same directory.
+		int watch = inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MASK_ADD);
+		if (watch < 0)
+		{
+			std::cerr << "Failed to watch " << directory << std::endl;
+			return;
+		}
+
+		m_watches[watch][filePath.filename().string()] = path;
+#else
+		m_files.push_back({ path, LastWriteTime(path) });
+#endif
+	}
+
+	// Files being added, removed, renamed or written in the directory are all reported as a change to it.
+	void WatchDirectory(const std::string& directory)
+	{
+#ifdef __linux__
+		if (m_inotify < 0)
+		{
+			return;
+		}
+
+		int watch = inotify_add_watch(m_inotify, directory.c_str(), IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_MASK_ADD);
+		if (watch < 0)
+		{
+			std::cerr << "Failed to watch " << directory << std::endl;
+			return;
+		}
+
+		m_directoryWatches[watch] = directory;
+#elif defined(_WIN32)
+		auto notification = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+		if (notification == INVALID_HANDLE_VALUE)
+		{
+			std::cerr << "Failed to watch " << directory << std::endl;
+			return;
+		}
+
+		m_directories.push_back({ directory, notification });
+#else
+		m_directories.push_back({ directory, LastWriteTime(directory) });
+#endif
+	}
+
+	// Every watched file written since the last call, each reported once.
+	std::vector<std::string> PollChanges()
+	{
+		std::vector<std::string> changes;
+
+#ifdef __linux__
+		ReadEvents();
+		changes.swap(m_changedFiles);
+#else
+		// Stat'ing every frame would be wasteful, a few times a second is plenty.
+		auto now = std::chrono::steady_clock::now();
+		if (now - m_lastPoll < std::chrono::milliseconds(250))
+		{
+			return changes;
+		}
+		m_lastPoll = now;
+
+		for (auto& file : m_files)
+		{
+			// A file that's missing (e.g. mid save) is picked up once it's back.
+			std::error_code error;
+			auto writeTime = std::filesystem::last_write_time(file.path, error);
+			if (!error && writeTime != file.writeTime)
+			{
+				file.writeTime = writeTime;
+				changes.push_back(file.path);
+			}
+		}
+#endif
+
+		return changes;
+	}
+
+	// Every watched directory whose contents changed since the last call, each reported once.
+	// Which files changed isn't reported, the caller is expected to look.
+	std::vector<std::string> PollDirectoryChanges()
+	{
+		std::vector<std::string> changes;
+
+#ifdef __linux__
+		ReadEvents();
+		changes.swap(m_changedDirectories);
+#elif defined(_WIN32)
+		for (auto& directory : m_directories)
+		{
+			// Signalled until the next FindNextChangeNotification, any number of changes in between count as one.
+			if (WaitForSingleObject(directory.notification, 0) == WAIT_OBJECT_0)
+			{
+				changes.push_back(directory.path);
+				FindNextChangeNotification(directory.notification);
+			}
+		}
+#else
+		// Adding, removing or renaming an entry touches the directory. Files written in place don't,
+		// those are only picked up on the next change that does.
+		auto now = std::chrono::steady_clock::now();
+		if (now - m_lastDirectoryPoll < std::chrono::milliseconds(250))
+		{
+			return changes;
+		}
+		m_lastDirectoryPoll = now;
+
+		for (auto& directory : m_directories)
+		{
+			auto writeTime = LastWriteTime(directory.path);
+			if (writeTime != directory.writeTime)
+			{
+				directory.writeTime = writeTime;
+				changes.push_back(directory.path);
+			}
+		}
+#endif
+
+		return changes;
+	}
+
+private:
+	static void AddUnique(std::vector<std::string>& changes, const std::string& path)
+	{
+		if (std::find(changes.begin(), changes.end(), path) == changes.end())
+		{
+			changes.push_back(path);
+		}
+	}
+
+#ifdef __linux__
+	// Both kinds of watches share one inotify instance, so events are read once and sorted into either list.
+	void ReadEvents()
+	{
+		if (m_inotify < 0)
+		{
+			return;
+		}
+
+		alignas(inotify_event) char buffer[4096];
+		while (true)
+		{
+			auto length = read(m_inotify, buffer, sizeof(buffer));
+			if (length <= 0)
+			{
+				break;
+			}
+
+			for (char* event = buffer; event < buffer + length;)
+			{
+				auto notification = reinterpret_cast<const inotify_event*>(event);
+				event += sizeof(inotify_event) + notification->len;
+
+				auto watchedDirectory = m_directoryWatches.find(notification->wd);
+				if (watchedDirectory != m_directoryWatches.end())
+				{
+					AddUnique(m_changedDirectories, watchedDirectory->second);
+				}
+
+				// The directory may also be watched for new files, those events don't mean a watched file was written.
+				if (!(notification->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+				{
+					continue;
+				}
+
+				auto directory = m_watches.find(notification->wd);
+				if (directory == m_watches.end() || notification->len == 0)
+				{
+					continue;
+				}
+
+				auto file = directory->second.find(notification->name);
+				if (file != directory->second.end())
+				{
+					AddUnique(m_changedFiles, file->second);
+				}
+			}
+		}
+	}
+
+	int m_inotify = -1;
+	// Watch descriptor -> file name -> path the file was watched with.
+	std::unordered_map<int, std::unordered_map<std::string, std::string>> m_watches;
+	std::unordered_map<int, std::string> m_directoryWatches;
+	std::vector<std::string> m_changedFiles;
+	std::vector<std::string> m_changedDirectories;
+#else
+	struct WatchedFile
+	{
+		std::string path;
+		std::filesystem::file_time_type writeTime;
+	};
+
+	static std::filesystem::file_time_type LastWriteTime(const std::string& path)
+	{
+		std::error_code error;
+		auto writeTime = std::filesystem::last_write_time(path, error);
+		return error ? std::filesystem::file_time_type::min() : writeTime;
+	}
+
+	std::vector<WatchedFile> m_files;
+	std::chrono::steady_clock::time_point m_lastPoll;
+
+#ifdef _WIN32
+	struct WatchedDirectory
+	{
+		std::string path;
+		HANDLE notification;
+	};
+#else
+	struct WatchedDirectory
+	{
+		std::string path;
+		std::filesystem::file_time_type writeTime;
+	};
+
+	std::chrono::steady_clock::time_point m_lastDirectoryPoll;
+#endif
+
+	std::vector<WatchedDirectory> m_directories;
+#endif
+};
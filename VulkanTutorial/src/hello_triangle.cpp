@@ -14,6 +14,12 @@
 #include <filesystem>
 #include <iostream>
 
+#include "asset_archive.h"
+#include "asset_cache.h"
+#include "pipeline_cache.h"
+#include "pipeline_queue.h"
+#include "pipeline_registry.h"
+#include "vulkan_object_cache.h"
 #include "window.h"
 #include "../libs/imgui/imgui_impl_glfw.h"
 #include "../libs/imgui/imgui_impl_vulkan.h"
@@ -49,6 +55,12 @@ void HelloTriangle::MainLoop()
 	while (!glfwWindowShouldClose(m_window))
 	{
 		glfwPollEvents();
+
+		// Between frames, so anything reloaded can be swapped in without touching an in flight frame.
+		m_sampleModel.HotReload();
+		m_sampleModel.StreamResources();
+		m_sampleModel.CollectPipelineBuilds();
+
 		DrawFrame();
 	}
 
@@ -230,6 +242,12 @@ void HelloTriangle::InitWindow()
 
 void HelloTriangle::InitVulkan()
 {
+	// Everything that was cooked comes out of the archive.
+	AssetArchive::Get().Open(ASSET_ARCHIVE_PATH);
+	AssetCache::Get().SetDirectory(ASSET_CACHE_DIRECTORY);
+	m_modelCatalog.Open(MODEL_DIRECTORY);
+	PipelineCache::Get().Load(PIPELINE_CACHE_PATH);
+
 	m_sampleModel.Initialize();
 	m_imguiManager.Initialize();
 }
@@ -275,34 +293,77 @@ void HelloTriangle::CleanupSwapChain()
 
 void HelloTriangle::DrawMenu()
 {
-	namespace fs = std::filesystem;
-
+	// Only changes when the watcher sees the directory change, listing it every frame adds up fast.
+	m_modelCatalog.Update();
 
-	const std::string path = "D:/Development/VulkanTutorial/models/";
-
-	//https://www.codegrepper.com/code-examples/cpp/c%2B%2B+get+file+list+of+directory
-	std::vector<std::string> modelPaths;
-	for (const auto& f : fs::directory_iterator(path))
-	{
-		auto filePath = f.path().string();
-		modelPaths.push_back(filePath);
-	}
+	const auto& models = m_modelCatalog.Models();
 
 	ImGui::Begin("Models");
 	{
-		int curr = 0;
-		for (int i = 0; i < modelPaths.size(); ++i)
+		for (int i = 0; i < static_cast<int>(models.size()); ++i)
 		{
-			const bool isSelected = curr == i;
-			if (ImGui::Selectable(modelPaths[i].c_str(), isSelected))
+			const auto& model = models[i];
+
+			const bool isSelected = m_selectedModel == i;
+			if (ImGui::Selectable(model.name.c_str(), isSelected))
 			{
-				curr = i;
+				m_selectedModel = i;
 			}
 
 			if (isSelected)
 			{
 				ImGui::SetItemDefaultFocus();
 			}
+
+			// Metadata is only loaded for what's been scrolled into view.
+			if (ImGui::IsItemVisible())
+			{
+				m_modelCatalog.RequestMetadata(i);
+			}
+
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::BeginTooltip();
+				ImGui::Text("%s", model.path.c_str());
+				ImGui::Text("%.1f KB", model.fileSize / 1024.0);
+
+				switch (model.metadata)
+				{
+				case ModelInfo::Metadata::Ready:
+				{
+					ImGui::Text("%u vertices, %u triangles", model.vertexCount, model.triangleCount);
+
+					// The ImGui backend only draws its font atlas, so the thumbnail is drawn as one rect per texel.
+					const float texelSize = 3.0f;
+					auto origin = ImGui::GetCursorScreenPos();
+					auto* drawList = ImGui::GetWindowDrawList();
+					for (uint32_t y = 0; y < MODEL_THUMBNAIL_SIZE; ++y)
+					{
+						for (uint32_t x = 0; x < MODEL_THUMBNAIL_SIZE; ++x)
+						{
+							auto shade = model.thumbnail[y * MODEL_THUMBNAIL_SIZE + x];
+							if (shade == 0)
+							{
+								continue;
+							}
+
+							ImVec2 min(origin.x + x * texelSize, origin.y + y * texelSize);
+							drawList->AddRectFilled(min, ImVec2(min.x + texelSize, min.y + texelSize), IM_COL32(shade, shade, shade, 255));
+						}
+					}
+					ImGui::Dummy(ImVec2(MODEL_THUMBNAIL_SIZE * texelSize, MODEL_THUMBNAIL_SIZE * texelSize));
+					break;
+				}
+				case ModelInfo::Metadata::Failed:
+					ImGui::Text("Couldn't be loaded");
+					break;
+				default:
+					ImGui::Text("Loading...");
+					break;
+				}
+
+				ImGui::EndTooltip();
+			}
 		}
 	}
 	ImGui::End();
@@ -321,6 +382,14 @@ void HelloTriangle::Cleanup()
 		vkDestroyFence(VulkanManager::GetVulkanManager().GetDevice(), VulkanManager::GetVulkanManager().GetInFlightFences()[i], nullptr);
 	}
 	
+	// Every pipeline build was waited for above, this only stops the threads.
+	PipelineQueue::Get().Shutdown();
+	PipelineRegistry::Get().Destroy();
+
+	// Samplers, layouts and render passes shared between everything above.
+	PipelineCache::Get().Destroy();
+	VulkanObjectCache::Get().Destroy();
+
 	// Device queues (graphics queue) are implicitly destroyed when the device is destroyed.
 	vkDestroyDevice(VulkanManager::GetVulkanManager().GetDevice(), nullptr);
 	
@@ -14,6 +14,7 @@
 #include "imgui_manager.h"
 
 #include "sample_model.h"
+#include "model_catalog.h"
 
 #include <iostream>
 #include <stdexcept>
@@ -56,6 +57,8 @@ private:
 
 	void InitVulkan();
 
+	void DrawMenu();
+
 	// These should be in VulkanManager
 	void RecreateSwapChain();
 	void CleanupSwapChain();
@@ -63,6 +66,8 @@ private:
 private:
 	ImGuiManager m_imguiManager;
 	SampleModel m_sampleModel;
+	ModelCatalog m_modelCatalog;
+	int m_selectedModel = -1;
 
 	Camera* g_camera;
 	
@@ -6,37 +6,9 @@
 #include <GLFW/glfw3.h>
 
 #include <chrono>
-#include <fstream>
+#include <thread>
 #include <vector>
 
-static std::vector<char> ReadFile(const std::string& filename)
-{
-	// Read from the end and read as a binary file.
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-	if(!file.is_open())
-	{
-		std::string msg = "Failed to open file: " + filename;
-		throw std::runtime_error(msg.c_str());
-	}
-
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-	
-	// Go back to the beginning.
-	file.seekg(0);
-	// Read all the bytes at once.
-	file.read(buffer.data(), fileSize);
-	// Close the file.
-	file.close();
-
-	if (buffer.size() != fileSize)
-	{
-		throw std::runtime_error("Couldn't read file");
-	}
-
-	return buffer;
-}
-
 static float GetCurrentTime()
 {
 	static auto startTime = std::chrono::high_resolution_clock::now();
@@ -46,6 +18,13 @@ static float GetCurrentTime()
 	return time;
 }
 
+// Threads for a worker pool, leaving a core for the main thread. hardware_concurrency() is 0 when it can't tell.
+static uint32_t WorkerThreadCount()
+{
+	auto cores = std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 1;
+}
+
 //https://stackoverflow.com/questions/3767869/adding-message-to-assert
 // TODO: Fix so that intellisense can still work filling out a function in the condition.
 // Actually not a fan of the way this assert works.
@@ -55,7 +55,7 @@ public:
 		vkFreeMemory(VulkanManager::GetVulkanManager().GetDevice(), m_memory, nullptr);
 	}
 	
-	VkImage m_image;
-	VkDeviceMemory m_memory;
-	VkImageView m_view;
+	VkImage m_image = VK_NULL_HANDLE;
+	VkDeviceMemory m_memory = VK_NULL_HANDLE;
+	VkImageView m_view = VK_NULL_HANDLE;
 };
@@ -4,6 +4,8 @@
 
 #include "constants.h"
 #include "helpers.h"
+#include "pipeline_cache.h"
+#include "vulkan_object_cache.h"
 
 void ImGuiManager::Initialize()
 {
@@ -49,23 +51,70 @@ void ImGuiManager::SubmitDrawCall(uint32_t imageIndex, Camera& camera)
 	}
 	VK_ASSERT(vkBeginCommandBuffer(m_commandBuffers[imageIndex], &info), "");
 
-	VkClearValue clearValue;
-	clearValue.color = { 0.45f, 0.55f, 0.60f, 1.00f };
+	if (VulkanManager::GetVulkanManager().UsesDynamicRendering())
+	{
+		RenderDynamic(imageIndex);
+	}
+	else
+	{
+		VkClearValue clearValue;
+		clearValue.color = { 0.45f, 0.55f, 0.60f, 1.00f };
+
+		VkRenderPassBeginInfo renderpassinfo = {};
+		renderpassinfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderpassinfo.renderPass = m_renderPass;
+		renderpassinfo.framebuffer = m_frameBuffers[imageIndex];
+		renderpassinfo.renderArea.extent.width = VulkanManager::GetVulkanManager().GetSwapChainExtent().width;
+		renderpassinfo.renderArea.extent.height = VulkanManager::GetVulkanManager().GetSwapChainExtent().height;
+		renderpassinfo.clearValueCount = 1;
+		renderpassinfo.pClearValues = &clearValue;
+		vkCmdBeginRenderPass(m_commandBuffers[imageIndex], &renderpassinfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_commandBuffers[imageIndex]);
+
+		vkCmdEndRenderPass(m_commandBuffers[imageIndex]);
+	}
 
-	VkRenderPassBeginInfo renderpassinfo = {};
-	renderpassinfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderpassinfo.renderPass = m_renderPass;
-	renderpassinfo.framebuffer = m_frameBuffers[imageIndex];
-	renderpassinfo.renderArea.extent.width = VulkanManager::GetVulkanManager().GetSwapChainExtent().width;
-	renderpassinfo.renderArea.extent.height = VulkanManager::GetVulkanManager().GetSwapChainExtent().height;
-	renderpassinfo.clearValueCount = 1;
-	renderpassinfo.pClearValues = &clearValue;
-	vkCmdBeginRenderPass(m_commandBuffers[imageIndex], &renderpassinfo, VK_SUBPASS_CONTENTS_INLINE);
+	VK_ASSERT(vkEndCommandBuffer(m_commandBuffers[imageIndex]), "");
+}
 
-	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_commandBuffers[imageIndex]);
+void ImGuiManager::RenderDynamic(uint32_t imageIndex)
+{
+	auto& vkManager = VulkanManager::GetVulkanManager();
+	auto commandBuffer = m_commandBuffers[imageIndex];
+	auto image = vkManager.GetSwapChainImages()[imageIndex];
 
-	vkCmdEndRenderPass(m_commandBuffers[imageIndex]);
-	VK_ASSERT(vkEndCommandBuffer(m_commandBuffers[imageIndex]), "");
+	// Drawn over the scene SampleModel resolved into the image, same as the render pass's subpass dependency.
+	auto sceneBarrier = vkHelpers::ImageBarrier(image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &sceneBarrier);
+
+	VkRenderingAttachmentInfoKHR colorAttachment{};
+	{
+		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		colorAttachment.imageView = vkManager.GetSwapChainImageViews()[imageIndex];
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	}
+
+	VkRenderingInfoKHR renderingInfo{};
+	{
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+		renderingInfo.renderArea.extent = vkManager.GetSwapChainExtent();
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachments = &colorAttachment;
+	}
+
+	vkManager.BeginRendering(commandBuffer, renderingInfo);
+	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+	vkManager.EndRendering(commandBuffer);
+
+	// The render pass's final layout.
+	auto presentBarrier = vkHelpers::ImageBarrier(image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &presentBarrier);
 }
 
 void ImGuiManager::Cleanup(bool recreateSwapchain = false)
@@ -76,7 +125,7 @@ void ImGuiManager::Cleanup(bool recreateSwapchain = false)
 
 	//vkFreeCommandBuffers(VulkanManager::GetVulkanManager().GetDevice(), m_commandPool.m_commandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
 
-	vkDestroyRenderPass(VulkanManager::GetVulkanManager().GetDevice(), m_renderPass, nullptr);
+	// The render pass belongs to VulkanObjectCache.
 	//m_commandPool.Destroy();
 	
 	// Resources to destroy when the program ends
@@ -88,6 +137,13 @@ void ImGuiManager::Cleanup(bool recreateSwapchain = false)
 
 void ImGuiManager::CreateRenderPass()
 {
+	// Nothing to create, see RenderDynamic.
+	if (VulkanManager::GetVulkanManager().UsesDynamicRendering())
+	{
+		m_renderPass = VK_NULL_HANDLE;
+		return;
+	}
+
 	VkAttachmentDescription imguiAttachment{};
 	CreateAttachmentDescription(
 		imguiAttachment,
@@ -142,7 +198,7 @@ void ImGuiManager::CreateRenderPass()
 		renderPassInfo.pDependencies = &dependency;
 	}
 
-	VK_ASSERT(vkCreateRenderPass(VulkanManager::GetVulkanManager().GetDevice(), &renderPassInfo, nullptr, &m_renderPass), "Failed to create render pass");
+	m_renderPass = VulkanObjectCache::Get().GetRenderPass(renderPassInfo);
 }
 
 void ImGuiManager::CreateDescriptorSetLayout()
@@ -183,6 +239,12 @@ void ImGuiManager::CreateCommandPool()
 
 void ImGuiManager::CreateFrameBuffers()
 {
+	if (VulkanManager::GetVulkanManager().UsesDynamicRendering())
+	{
+		m_frameBuffers.clear();
+		return;
+	}
+
 	// Each FBO will need to reference each of the image view objects.
 	m_frameBuffers.resize(VulkanManager::GetVulkanManager().GetSwapChainImageViews().size());
 	
@@ -237,12 +299,14 @@ void ImGuiManager::SetupImGui(GLFWwindow* window, size_t currentFrame)
 		init_info.Device = VulkanManager::GetVulkanManager().GetDevice();
 		init_info.QueueFamily = queueFamily.graphicsFamily.value();
 		init_info.Queue = VulkanManager::GetVulkanManager().GetGraphicsQueue();
-		init_info.PipelineCache = nullptr;
+		init_info.PipelineCache = PipelineCache::Get().GetHandle();
 		init_info.DescriptorPool = GetDescriptorPool();
 		init_info.Allocator = nullptr;
 		init_info.MinImageCount = swapChainSupport.capabilities.minImageCount + 1;
 		init_info.ImageCount = VulkanManager::GetVulkanManager().NumSwapChainImages();
 		init_info.CheckVkResultFn = nullptr;
+		init_info.UseDynamicRendering = VulkanManager::GetVulkanManager().UsesDynamicRendering();
+		init_info.ColorAttachmentFormat = VulkanManager::GetVulkanManager().GetSwapChainImageFormat();
 	}
 	ImGui_ImplVulkan_Init(&init_info, GetRenderPass());
 
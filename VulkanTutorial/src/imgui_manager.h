@@ -33,6 +33,9 @@ public:
 	void End();
 	void SetActive(bool active) { m_active = active; }
 
+	// SubmitDrawCall without a render pass, for VK_KHR_dynamic_rendering.
+	void RenderDynamic(uint32_t imageIndex);
+
 	bool m_active = false;
 
 	std::vector<VkCommandBuffer>& GetCommandBuffers() { return m_commandBuffers; }
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Non-owning view of bytes, e.g. part of a mapped file. Whoever owns the memory has to outlive it.
+struct ByteSpan
+{
+	ByteSpan() = default;
+	ByteSpan(const char* data, size_t size) : data(data), size(size) {}
+	ByteSpan(const std::vector<char>& bytes) : data(bytes.data()), size(bytes.size()) {}
+
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+	bool empty() const { return size == 0; }
+
+	const char* data = nullptr;
+	size_t size = 0;
+};
+
+// How a mapping is going to be read, passed on to the OS so it can read ahead (or not).
+enum class MappedFileAccess
+{
+	Normal,
+	Sequential,		// Read front to back once, e.g. SPIR-V or a texture being decoded.
+	Random,			// Small scattered reads, read ahead would only waste IO.
+	WillNeed,		// Start reading it in now, it's about to be used.
+};
+
+// Read-only view of a whole file mapped into memory.
+// Pages are only read from disk when they're touched, so nothing is copied up front.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	MappedFile(const std::string& filename, MappedFileAccess access = MappedFileAccess::Normal)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Failed to open file: " + filename);
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize))
+		{
+			CloseHandle(file);
+			throw std::runtime_error("Failed to read the size of file: " + filename);
+		}
+		m_size = static_cast<size_t>(fileSize.QuadPart);
+
+		// Mapping an empty file fails, an empty view is fine though.
+		if (m_size > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping)
+			{
+				m_data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				// The view keeps the mapping alive.
+				CloseHandle(mapping);
+			}
+		}
+
+		CloseHandle(file);
+#else
+		int file = open(filename.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			throw std::runtime_error("Failed to open file: " + filename);
+		}
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0)
+		{
+			close(file);
+			throw std::runtime_error("Failed to read the size of file: " + filename);
+		}
+		m_size = static_cast<size_t>(fileStat.st_size);
+
+		if (m_size > 0)
+		{
+			m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (m_data == MAP_FAILED)
+			{
+				m_data = nullptr;
+			}
+		}
+
+		close(file);
+#endif
+
+		if (m_size > 0 && !m_data)
+		{
+			throw std::runtime_error("Failed to map file: " + filename);
+		}
+
+		Advise(access);
+	}
+
+	~MappedFile()
+	{
+		Unmap();
+	}
+
+	// Only movable, the view is unmapped once.
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept : m_data(other.m_data), m_size(other.m_size)
+	{
+		other.m_data = nullptr;
+		other.m_size = 0;
+	}
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Unmap();
+			m_data = other.m_data;
+			m_size = other.m_size;
+			other.m_data = nullptr;
+			other.m_size = 0;
+		}
+
+		return *this;
+	}
+
+	void Unmap()
+	{
+		if (m_data)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(m_data);
+#else
+			munmap(m_data, m_size);
+#endif
+		}
+
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	// Only a hint, failures are ignored. Covers the whole file unless a range is given.
+	void Advise(MappedFileAccess access, size_t offset = 0, size_t size = SIZE_MAX) const
+	{
+		if (!m_data || access == MappedFileAccess::Normal || offset >= m_size)
+		{
+			return;
+		}
+
+		size = std::min(size, m_size - offset);
+
+#ifdef _WIN32
+		// Windows has no equivalent for the access pattern, only for prefetching.
+		if (access == MappedFileAccess::WillNeed || access == MappedFileAccess::Sequential)
+		{
+			WIN32_MEMORY_RANGE_ENTRY range{};
+			range.VirtualAddress = static_cast<char*>(m_data) + offset;
+			range.NumberOfBytes = size;
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+		}
+#else
+		// madvise wants a page aligned address.
+		const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		const size_t alignedOffset = offset / pageSize * pageSize;
+
+		int advice = MADV_NORMAL;
+		switch (access)
+		{
+		case MappedFileAccess::Sequential:	advice = MADV_SEQUENTIAL;	break;
+		case MappedFileAccess::Random:		advice = MADV_RANDOM;		break;
+		case MappedFileAccess::WillNeed:	advice = MADV_WILLNEED;		break;
+		default:														break;
+		}
+
+		madvise(static_cast<char*>(m_data) + alignedOffset, size + offset - alignedOffset, advice);
+#endif
+	}
+
+	const char* Data() const { return static_cast<const char*>(m_data); }
+	size_t Size() const { return m_size; }
+
+	ByteSpan Span() const { return ByteSpan(Data(), m_size); }
+
+	ByteSpan Span(size_t offset, size_t size) const
+	{
+		if (offset > m_size || size > m_size - offset)
+		{
+			throw std::out_of_range("Range is outside of the mapped file");
+		}
+
+		return ByteSpan(Data() + offset, size);
+	}
+
+private:
+	void* m_data = nullptr;
+	size_t m_size = 0;
+};
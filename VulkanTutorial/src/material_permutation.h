@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#endif
+
+#include <vulkan/vulkan.h>
+
+#include "constants.h"
+
+// Matches the constant_id values in fs.frag.
+enum MaterialConstant : uint32_t
+{
+	MATERIAL_CONSTANT_TEXTURED = 0,
+	MATERIAL_CONSTANT_VERTEX_COLOR = 1,
+	MATERIAL_CONSTANT_LIGHT_COUNT = 2,
+	MATERIAL_CONSTANT_ALPHA_TEST = 3,
+	MATERIAL_CONSTANT_ALPHA_CUTOFF = 4,
+	MATERIAL_CONSTANT_COUNT,
+};
+
+// One variant of the fragment shader. The values are baked in as specialization constants when the
+// pipeline is created, so the driver drops whatever a variant doesn't use instead of branching per fragment.
+// Every field is 4 bytes (VkBool32 for the switches), that's what the shader's constants expect.
+struct MaterialPermutation
+{
+	VkBool32 textured = VK_TRUE;		// Multiply by the texture.
+	VkBool32 vertexColor = VK_TRUE;		// Multiply by the vertex color.
+	uint32_t lightCount = 1;			// Directional lights, up to MATERIAL_MAX_LIGHTS. Zero is unlit.
+	VkBool32 alphaTest = VK_FALSE;		// Discard texels with alpha below alphaCutoff.
+	float alphaCutoff = 0.5f;
+
+	// Drawn while the selected permutation is still compiling. Untextured with one light, it reads the same
+	// descriptors as every other permutation and always looks reasonable.
+	static MaterialPermutation Fallback()
+	{
+		MaterialPermutation permutation;
+		{
+			permutation.textured = VK_FALSE;
+			permutation.vertexColor = VK_TRUE;
+			permutation.lightCount = 1;
+			permutation.alphaTest = VK_FALSE;
+		}
+
+		return permutation;
+	}
+
+	// Where each constant sits in the struct. Static so a VkSpecializationInfo can point at them.
+	static const std::array<VkSpecializationMapEntry, MATERIAL_CONSTANT_COUNT>& MapEntries()
+	{
+		static const std::array<VkSpecializationMapEntry, MATERIAL_CONSTANT_COUNT> entries = { {
+			{ MATERIAL_CONSTANT_TEXTURED, offsetof(MaterialPermutation, textured), sizeof(VkBool32) },
+			{ MATERIAL_CONSTANT_VERTEX_COLOR, offsetof(MaterialPermutation, vertexColor), sizeof(VkBool32) },
+			{ MATERIAL_CONSTANT_LIGHT_COUNT, offsetof(MaterialPermutation, lightCount), sizeof(uint32_t) },
+			{ MATERIAL_CONSTANT_ALPHA_TEST, offsetof(MaterialPermutation, alphaTest), sizeof(VkBool32) },
+			{ MATERIAL_CONSTANT_ALPHA_CUTOFF, offsetof(MaterialPermutation, alphaCutoff), sizeof(float) },
+		} };
+
+		return entries;
+	}
+
+	// Points into this permutation, it has to outlive the pipeline creation.
+	VkSpecializationInfo SpecializationInfo() const
+	{
+		VkSpecializationInfo info{};
+		{
+			info.mapEntryCount = static_cast<uint32_t>(MapEntries().size());
+			info.pMapEntries = MapEntries().data();
+			info.dataSize = sizeof(MaterialPermutation);
+			info.pData = this;
+		}
+
+		return info;
+	}
+
+	// e.g. "textured, vertex color, 2 lights, alpha test"
+	std::string Name() const
+	{
+		std::string name;
+		auto append = [&name](const std::string& part)
+		{
+			name += name.empty() ? part : ", " + part;
+		};
+
+		if (textured)
+		{
+			append("textured");
+		}
+
+		if (vertexColor)
+		{
+			append("vertex color");
+		}
+
+		append(lightCount == 0 ? "unlit" : std::to_string(lightCount) + (lightCount == 1 ? " light" : " lights"));
+
+		if (alphaTest)
+		{
+			append("alpha test");
+		}
+
+		return name;
+	}
+
+	bool operator==(const MaterialPermutation& other) const
+	{
+		return textured == other.textured &&
+			vertexColor == other.vertexColor &&
+			lightCount == other.lightCount &&
+			alphaTest == other.alphaTest &&
+			alphaCutoff == other.alphaCutoff;
+	}
+
+	bool operator!=(const MaterialPermutation& other) const { return !(*this == other); }
+};
+
+static_assert(std::is_trivially_copyable_v<MaterialPermutation> && sizeof(MaterialPermutation) == 5 * 4, "Specialization data is read straight from the struct");
+
+namespace std {
+	template<> struct hash<MaterialPermutation> {
+		size_t operator()(MaterialPermutation const& permutation) const {
+			return static_cast<size_t>(XXH3_64bits(&permutation, sizeof(MaterialPermutation)));
+		}
+	};
+}
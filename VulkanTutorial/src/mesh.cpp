@@ -1,11 +1,695 @@
 #include "mesh.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "mapped_file.h"
+
 #ifndef TINYOBJLOADER_IMPLEMENTATION
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 #endif
 
+#ifndef CGLTF_IMPLEMENTATION
+#define CGLTF_IMPLEMENTATION
+#include <cgltf.h>
+#endif
+
+namespace
+{
+	// Garland-Heckbert error quadric. Only the 10 unique terms of the symmetric 4x4 matrix are stored.
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double weight = 0;
+
+		void AddPlane(const glm::vec3& n, double d, double w)
+		{
+			a00 += w * n.x * n.x;
+			a01 += w * n.x * n.y;
+			a02 += w * n.x * n.z;
+			a11 += w * n.y * n.y;
+			a12 += w * n.y * n.z;
+			a22 += w * n.z * n.z;
+			b0 += w * n.x * d;
+			b1 += w * n.y * d;
+			b2 += w * n.z * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02;
+			a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// Weighted mean squared distance from p to all the planes accumulated so far.
+		double Error(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double e = a00 * x * x + a11 * y * y + a22 * z * z
+				+ 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2 * (b0 * x + b1 * y + b2 * z)
+				+ c;
+
+			// e can dip just below zero from rounding.
+			return weight > 0 ? std::abs(e) / weight : 0;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double error;
+	};
+
+	// Collapses edges onto existing vertices until the index count drops to targetIndexCount
+	// or nothing else can be collapsed. No vertices are created, so the result can be drawn
+	// straight out of the original vertex buffer.
+	std::vector<uint32_t> SimplifyIndices(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& source, size_t targetIndexCount, float& outError)
+	{
+		const auto vertexCount = vertices.size();
+		std::vector<uint32_t> indices = source;
+
+		// Vertices split along UV seams share a position. Quadrics are tracked per position
+		// and seam vertices are never moved, otherwise the seam would tear open.
+		std::vector<uint32_t> wedge(vertexCount);
+		std::vector<bool> locked(vertexCount, false);
+		{
+			std::unordered_map<glm::vec3, uint32_t> positions;
+			for (uint32_t i = 0; i < vertexCount; ++i)
+			{
+				wedge[i] = positions.emplace(vertices[i].position, i).first->second;
+				if (wedge[i] != i)
+				{
+					locked[wedge[i]] = true;
+				}
+			}
+		}
+
+		// Edges used by a single triangle are on the mesh border. Keep those in place too.
+		{
+			std::unordered_map<uint64_t, uint32_t> edgeUses;
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				for (int e = 0; e < 3; ++e)
+				{
+					uint64_t a = wedge[indices[i + e]];
+					uint64_t b = wedge[indices[i + (e + 1) % 3]];
+					edgeUses[std::min(a, b) << 32 | std::max(a, b)]++;
+				}
+			}
+
+			for (auto& [edge, uses] : edgeUses)
+			{
+				if (uses == 1)
+				{
+					locked[edge >> 32] = true;
+					locked[edge & 0xffffffff] = true;
+				}
+			}
+		}
+
+		// Every vertex starts with the planes of the triangles around it, weighted by area.
+		std::vector<Quadric> quadrics(vertexCount);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			const auto& p0 = vertices[indices[i + 0]].position;
+			const auto& p1 = vertices[indices[i + 1]].position;
+			const auto& p2 = vertices[indices[i + 2]].position;
+
+			auto normal = glm::cross(p1 - p0, p2 - p0);
+			auto area = glm::length(normal);
+			if (area == 0.0f)
+			{
+				continue;
+			}
+
+			normal /= area;
+			auto d = -glm::dot(normal, p0);
+			for (int k = 0; k < 3; ++k)
+			{
+				quadrics[wedge[indices[i + k]]].AddPlane(normal, d, area);
+			}
+		}
+
+		std::vector<uint32_t> collapseTo(vertexCount);
+		std::vector<bool> touched(vertexCount);
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+		std::vector<uint32_t> adjacency;
+		std::vector<Collapse> candidates;
+		double maxError = 0;
+
+		while (indices.size() > targetIndexCount)
+		{
+			// Triangles around each vertex, used to reject collapses that would flip a face.
+			{
+				std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+				for (auto index : indices)
+				{
+					adjacencyOffsets[index + 1]++;
+				}
+				std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+				adjacency.resize(indices.size());
+				std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); ++i)
+				{
+					adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			auto flipsTriangle = [&](uint32_t from, uint32_t to)
+			{
+				for (auto k = adjacencyOffsets[from]; k < adjacencyOffsets[from + 1]; ++k)
+				{
+					const auto* triangle = &indices[adjacency[k] * 3];
+
+					// Triangles on the collapsed edge disappear, they can't flip.
+					if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+					{
+						continue;
+					}
+
+					glm::vec3 before[3], after[3];
+					for (int v = 0; v < 3; ++v)
+					{
+						before[v] = vertices[triangle[v]].position;
+						after[v] = triangle[v] == from ? vertices[to].position : before[v];
+					}
+
+					auto n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+					auto n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+					if (glm::dot(n0, n1) <= 0.0f)
+					{
+						return true;
+					}
+				}
+
+				return false;
+			};
+
+			// Every directed edge is a candidate, cheapest first.
+			candidates.clear();
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				for (int e = 0; e < 3; ++e)
+				{
+					uint32_t a = indices[i + e];
+					uint32_t b = indices[i + (e + 1) % 3];
+
+					for (auto [from, to] : { std::make_pair(a, b), std::make_pair(b, a) })
+					{
+						if (locked[wedge[from]])
+						{
+							continue;
+						}
+
+						auto q = quadrics[wedge[from]];
+						q.Add(quadrics[wedge[to]]);
+						candidates.push_back({ from, to, q.Error(vertices[to].position) });
+					}
+				}
+			}
+
+			std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+			// Collapse as many independent edges as the target allows in one pass.
+			// An interior edge collapse removes two triangles.
+			std::iota(collapseTo.begin(), collapseTo.end(), 0);
+			std::fill(touched.begin(), touched.end(), false);
+
+			size_t trianglesToRemove = (indices.size() - targetIndexCount) / 3;
+			size_t trianglesRemoved = 0;
+			size_t collapses = 0;
+
+			for (const auto& candidate : candidates)
+			{
+				if (trianglesRemoved >= trianglesToRemove)
+				{
+					break;
+				}
+
+				auto from = wedge[candidate.from];
+				auto to = wedge[candidate.to];
+				if (touched[from] || touched[to] || flipsTriangle(candidate.from, candidate.to))
+				{
+					continue;
+				}
+
+				collapseTo[candidate.from] = candidate.to;
+				quadrics[to].Add(quadrics[from]);
+				touched[from] = true;
+				touched[to] = true;
+
+				// The triangles around from change shape, so the flip check of any vertex sharing one of them
+				// would be looking at stale positions. They wait for the next pass.
+				for (auto k = adjacencyOffsets[candidate.from]; k < adjacencyOffsets[candidate.from + 1]; ++k)
+				{
+					const auto* triangle = &indices[adjacency[k] * 3];
+					for (int v = 0; v < 3; ++v)
+					{
+						touched[wedge[triangle[v]]] = true;
+					}
+				}
+
+				maxError = std::max(maxError, candidate.error);
+				trianglesRemoved += 2;
+				collapses++;
+			}
+
+			if (collapses == 0)
+			{
+				break;
+			}
+
+			// Remap and drop the triangles that became degenerate.
+			size_t write = 0;
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				auto a = collapseTo[indices[i + 0]];
+				auto b = collapseTo[indices[i + 1]];
+				auto c = collapseTo[indices[i + 2]];
+
+				if (a == b || b == c || c == a)
+				{
+					continue;
+				}
+
+				indices[write++] = a;
+				indices[write++] = b;
+				indices[write++] = c;
+			}
+			indices.resize(write);
+		}
+
+		outError = static_cast<float>(std::sqrt(maxError));
+		return indices;
+	}
+
+	void ComputeMeshletBounds(Meshlet& meshlet, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& meshletVertices)
+	{
+		// Bounding sphere around the centroid.
+		glm::vec3 center(0);
+		for (auto index : meshletVertices)
+		{
+			center += vertices[index].position;
+		}
+		center /= static_cast<float>(meshletVertices.size());
+
+		float radius = 0.0f;
+		for (auto index : meshletVertices)
+		{
+			radius = std::max(radius, glm::distance(center, vertices[index].position));
+		}
+
+		// Normal cone around the average face normal.
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.triangleCount);
+
+		glm::vec3 axis(0);
+		for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+		{
+			const auto& p0 = vertices[indices[i + 0]].position;
+			const auto& p1 = vertices[indices[i + 1]].position;
+			const auto& p2 = vertices[indices[i + 2]].position;
+
+			auto normal = glm::cross(p1 - p0, p2 - p0);
+			auto area = glm::length(normal);
+			if (area == 0.0f)
+			{
+				continue;
+			}
+
+			normals.push_back(normal / area);
+			axis += normals.back();
+		}
+
+		// A cutoff of 1 can never pass the cone test in cull.comp.
+		float cutoff = 1.0f;
+
+		auto axisLength = glm::length(axis);
+		if (axisLength > 0.0f)
+		{
+			axis /= axisLength;
+
+			float minDot = 1.0f;
+			for (const auto& normal : normals)
+			{
+				minDot = std::min(minDot, glm::dot(axis, normal));
+			}
+
+			// Normals spread over more than a hemisphere can always be seen from somewhere.
+			if (minDot > 0.0f)
+			{
+				cutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+		}
+
+		meshlet.sphere = glm::vec4(center, radius);
+		meshlet.cone = glm::vec4(axis, cutoff);
+	}
+
+	// Below this many items a job isn't worth starting threads for.
+	const size_t PARALLEL_MIN_BATCH = 4096;
+
+	// Runs function(begin, end) over [0, count), split into one contiguous range per hardware thread.
+	// Ranges don't overlap, so jobs that only write to their own items need no locking.
+	template<typename Function>
+	void ParallelFor(size_t count, const Function& function)
+	{
+		size_t threadCount = std::min<size_t>(std::thread::hardware_concurrency(), count / PARALLEL_MIN_BATCH);
+		if (threadCount <= 1)
+		{
+			function(size_t(0), count);
+			return;
+		}
+
+		const size_t batchSize = (count + threadCount - 1) / threadCount;
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount);
+		for (size_t begin = 0; begin < count; begin += batchSize)
+		{
+			const size_t end = std::min(count, begin + batchSize);
+			threads.emplace_back([&function, begin, end]() { function(begin, end); });
+		}
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	// For every group, the triangle corners (3 * triangle + corner) whose vertex belongs to it, in CSR form.
+	// Lets each group gather its own contributions instead of triangles scattering into shared sums.
+	struct CornerAdjacency
+	{
+		std::vector<uint32_t> offsets;	// groupCount + 1 entries
+		std::vector<uint32_t> corners;
+	};
+
+	template<typename GroupOf>
+	CornerAdjacency BuildCornerAdjacency(const std::vector<uint32_t>& indices, size_t indexCount, size_t groupCount, const GroupOf& groupOf)
+	{
+		CornerAdjacency adjacency;
+		adjacency.offsets.assign(groupCount + 1, 0);
+		adjacency.corners.resize(indexCount);
+
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			adjacency.offsets[groupOf(indices[i]) + 1]++;
+		}
+
+		std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+		std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			adjacency.corners[cursor[groupOf(indices[i])]++] = static_cast<uint32_t>(i);
+		}
+
+		return adjacency;
+	}
+
+	// Angle at p0 between the edges to p1 and p2.
+	float CornerAngle(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+	{
+		auto e1 = p1 - p0;
+		auto e2 = p2 - p0;
+
+		float lengths = glm::length(e1) * glm::length(e2);
+		if (lengths == 0.0f)
+		{
+			return 0.0f;
+		}
+
+		return std::acos(glm::clamp(glm::dot(e1, e2) / lengths, -1.0f, 1.0f));
+	}
+
+	const uint32_t COOKED_MESH_MAGIC = 0x4853454D;	// "MESH"
+
+	// Followed by the vertex, index, LOD, meshlet and submesh arrays, then the materials.
+	struct CookedMeshHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexSize;	// Guards against Vertex changing without bumping the version.
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t lodCount;
+		uint32_t meshletCount;
+		uint32_t submeshCount;
+		uint32_t materialCount;
+		float center[3];
+		float radius;
+	};
+
+	template<typename T>
+	void WriteArray(std::vector<char>& blob, const T* data, size_t count)
+	{
+		const auto* bytes = reinterpret_cast<const char*>(data);
+		blob.insert(blob.end(), bytes, bytes + count * sizeof(T));
+	}
+
+	template<typename T>
+	void ReadArray(const char*& cursor, const char* end, T* data, size_t count)
+	{
+		if (static_cast<size_t>(end - cursor) < count * sizeof(T))
+		{
+			throw std::runtime_error("Cooked mesh is truncated");
+		}
+
+		memcpy(data, cursor, count * sizeof(T));
+		cursor += count * sizeof(T);
+	}
+
+	// Files cgltf asked for, keyed by the pointer handed back to it.
+	using GltfMappedFiles = std::unordered_map<const void*, MappedFile>;
+
+	cgltf_result GltfMapFile(const cgltf_memory_options*, const cgltf_file_options* fileOptions, const char* path, cgltf_size* size, void** data)
+	{
+		MappedFile file;
+		try
+		{
+			file = MappedFile(path);
+		}
+		catch (const std::exception&)
+		{
+			return cgltf_result_file_not_found;
+		}
+
+		if (file.Size() == 0)
+		{
+			return cgltf_result_io_error;
+		}
+
+		*size = file.Size();
+		*data = const_cast<char*>(file.Data());	// cgltf never writes to file data.
+
+		auto& files = *static_cast<GltfMappedFiles*>(fileOptions->user_data);
+		files[*data] = std::move(file);
+
+		return cgltf_result_success;
+	}
+
+	void GltfUnmapFile(const cgltf_memory_options*, const cgltf_file_options* fileOptions, void* data)
+	{
+		auto& files = *static_cast<GltfMappedFiles*>(fileOptions->user_data);
+		if (files.erase(data) == 0)
+		{
+			// Older cgltf versions release buffers decoded from data: URIs here too. Those come from
+			// cgltf's default allocator, LoadGltf leaves the memory options unset.
+			std::free(data);
+		}
+	}
+
+	const cgltf_accessor* FindGltfAttribute(const cgltf_primitive& primitive, cgltf_attribute_type type)
+	{
+		for (cgltf_size i = 0; i < primitive.attributes_count; ++i)
+		{
+			// Only the first set of UVs and colors is used.
+			if (primitive.attributes[i].type == type && primitive.attributes[i].index == 0)
+			{
+				return primitive.attributes[i].data;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Calls function for every triangle primitive with the world transform of the node that places it.
+	// Meshes instanced by several nodes are visited once per node.
+	template<typename Function>
+	void ForEachGltfPrimitive(const cgltf_data* data, Function&& function)
+	{
+		auto visitMesh = [&](const cgltf_mesh& mesh, const glm::mat4& world)
+		{
+			for (cgltf_size i = 0; i < mesh.primitives_count; ++i)
+			{
+				const auto& primitive = mesh.primitives[i];
+				if (primitive.type != cgltf_primitive_type_triangles || !FindGltfAttribute(primitive, cgltf_attribute_type_position))
+				{
+					continue;
+				}
+
+				function(primitive, world);
+			}
+		};
+
+		bool placedByNodes = false;
+		for (cgltf_size i = 0; i < data->nodes_count; ++i)
+		{
+			if (data->nodes[i].mesh)
+			{
+				float world[16];
+				cgltf_node_transform_world(&data->nodes[i], world);
+				visitMesh(*data->nodes[i].mesh, glm::make_mat4(world));
+				placedByNodes = true;
+			}
+		}
+
+		// Files without a node hierarchy just list their meshes.
+		if (!placedByNodes)
+		{
+			for (cgltf_size i = 0; i < data->meshes_count; ++i)
+			{
+				visitMesh(data->meshes[i], glm::mat4(1.0f));
+			}
+		}
+	}
+
+	// Reads a buffer view straight into one member of every vertex.
+	void CopyGltfAttribute(const cgltf_accessor* accessor, Vertex* vertices, size_t memberOffset, cgltf_size components)
+	{
+		auto* dst = reinterpret_cast<char*>(vertices) + memberOffset;
+		const auto* view = accessor->buffer_view;
+
+		// Float data is copied as is out of the mapped file.
+		if (accessor->component_type == cgltf_component_type_r_32f && !accessor->is_sparse && view && view->buffer->data && cgltf_num_components(accessor->type) >= components)
+		{
+			const auto* src = static_cast<const char*>(view->buffer->data) + view->offset + accessor->offset;
+			for (cgltf_size i = 0; i < accessor->count; ++i)
+			{
+				memcpy(dst + i * sizeof(Vertex), src + i * accessor->stride, components * sizeof(float));
+			}
+
+			return;
+		}
+
+		// Quantized, normalized and sparse accessors go through cgltf's conversion.
+		float value[16] = {};
+		for (cgltf_size i = 0; i < accessor->count; ++i)
+		{
+			cgltf_accessor_read_float(accessor, i, value, 16);
+			memcpy(dst + i * sizeof(Vertex), value, components * sizeof(float));
+		}
+	}
+
+	// Widens indices to 32 bits and rebases them onto base. Returns false if the accessor has to be read through cgltf.
+	bool CopyGltfIndices(const cgltf_accessor* accessor, uint32_t* dst, uint32_t base)
+	{
+		const auto* view = accessor->buffer_view;
+		if (accessor->is_sparse || !view || !view->buffer->data)
+		{
+			return false;
+		}
+
+		const auto* src = static_cast<const char*>(view->buffer->data) + view->offset + accessor->offset;
+		const auto count = accessor->count;
+		const auto stride = accessor->stride;
+
+		switch (accessor->component_type)
+		{
+		case cgltf_component_type_r_32u:
+			// The common case is a single copy.
+			if (stride == sizeof(uint32_t))
+			{
+				memcpy(dst, src, count * sizeof(uint32_t));
+				if (base != 0)
+				{
+					for (cgltf_size i = 0; i < count; ++i)
+					{
+						dst[i] += base;
+					}
+				}
+			}
+			else
+			{
+				for (cgltf_size i = 0; i < count; ++i)
+				{
+					uint32_t index;
+					memcpy(&index, src + i * stride, sizeof(index));
+					dst[i] = base + index;
+				}
+			}
+			return true;
+		case cgltf_component_type_r_16u:
+			for (cgltf_size i = 0; i < count; ++i)
+			{
+				uint16_t index;
+				memcpy(&index, src + i * stride, sizeof(index));
+				dst[i] = base + index;
+			}
+			return true;
+		case cgltf_component_type_r_8u:
+			for (cgltf_size i = 0; i < count; ++i)
+			{
+				dst[i] = base + static_cast<uint8_t>(src[i * stride]);
+			}
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
 void Mesh::LoadModel(const char* path)
+{
+	m_vertices.clear();
+	m_indices.clear();
+	m_meshlets.clear();
+	m_submeshes.clear();
+	m_materials.clear();
+
+	std::string extension = path;
+	extension = extension.substr(extension.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	if (extension == "gltf" || extension == "glb")
+	{
+		LoadGltf(path);
+	}
+	else
+	{
+		LoadObj(path);
+	}
+
+	GenerateTangentFrames();
+	ComputeBounds();
+
+	// The full resolution mesh is always LOD 0.
+	m_lods = { { 0, static_cast<uint32_t>(m_indices.size()), 0.0f } };
+}
+
+void Mesh::LoadObj(const char* path)
 {
 	using namespace tinyobj;
 	attrib_t attrib;
@@ -13,7 +697,7 @@ void Mesh::LoadModel(const char* path)
 	std::vector<material_t> materials;
 	std::string warning, error;
 
-	if (!LoadObj(&attrib, &shapes, &materials, &warning, &error, path))
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, path))
 	{
 		throw std::runtime_error(warning + error);
 	}
@@ -32,16 +716,24 @@ void Mesh::LoadModel(const char* path)
 					attrib.vertices[3 * index.vertex_index + 2],
 				};
 
-				vertex.uv = {
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1 - attrib.texcoords[2 * index.texcoord_index + 1],	// TinyObj does some weird flipping.
-				};
+				// Missing UVs and normals come through as -1 and are left zero.
+				if (index.texcoord_index >= 0)
+				{
+					vertex.uv = {
+						attrib.texcoords[2 * index.texcoord_index + 0],
+						1 - attrib.texcoords[2 * index.texcoord_index + 1],	// TinyObj does some weird flipping.
+					};
+				}
 
-				vertex.normal = {
-					attrib.normals[3 * index.normal_index + 0],
-					attrib.normals[3 * index.normal_index + 1],
-					attrib.normals[3 * index.normal_index + 2],
-				};
+				// Missing normals are generated afterwards.
+				if (index.normal_index >= 0)
+				{
+					vertex.normal = {
+						attrib.normals[3 * index.normal_index + 0],
+						attrib.normals[3 * index.normal_index + 1],
+						attrib.normals[3 * index.normal_index + 2],
+					};
+				}
 				
 				vertex.color = { 1, 1, 1 };
 			}
@@ -54,4 +746,703 @@ void Mesh::LoadModel(const char* path)
 			m_indices.push_back(uniqueVertices[vertex]);
 		}
 	}
+
+	// Materials aren't read from OBJ files, the whole model uses the default one.
+	m_materials = { Material{} };
+	m_submeshes = { { 0, static_cast<uint32_t>(m_indices.size()), 0, static_cast<uint32_t>(m_vertices.size()), 0 } };
+}
+
+void Mesh::LoadGltf(const char* path)
+{
+	// The .gltf/.glb and any external .bin buffers are memory mapped instead of read into
+	// heap copies. For GLB files the binary chunk is used in place.
+	GltfMappedFiles mappedFiles;
+
+	cgltf_options options{};
+	{
+		options.file.read = GltfMapFile;
+		options.file.release = GltfUnmapFile;
+		options.file.user_data = &mappedFiles;
+	}
+
+	cgltf_data* data = nullptr;
+	if (cgltf_parse_file(&options, path, &data) != cgltf_result_success)
+	{
+		throw std::runtime_error(std::string("Failed to parse glTF file: ") + path);
+	}
+
+	// Frees the parsed data (and unmaps the files) on every exit path.
+	std::unique_ptr<cgltf_data, decltype(&cgltf_free)> scopedData(data, cgltf_free);
+
+	if (cgltf_load_buffers(&options, data, path) != cgltf_result_success)
+	{
+		throw std::runtime_error(std::string("Failed to load glTF buffers: ") + path);
+	}
+
+	// Materials
+	std::string directory = path;
+	directory = directory.substr(0, directory.find_last_of("/\\") + 1);
+
+	for (cgltf_size i = 0; i < data->materials_count; ++i)
+	{
+		const auto& gltfMaterial = data->materials[i];
+
+		Material material{};
+		if (gltfMaterial.has_pbr_metallic_roughness)
+		{
+			const auto& pbr = gltfMaterial.pbr_metallic_roughness;
+			material.baseColor = glm::make_vec4(pbr.base_color_factor);
+
+			const auto* image = pbr.base_color_texture.texture ? pbr.base_color_texture.texture->image : nullptr;
+			if (image && image->uri)
+			{
+				material.baseColorTexture = directory + image->uri;
+			}
+		}
+
+		m_materials.push_back(material);
+	}
+
+	// Primitives without a material use the default one at the end.
+	const auto defaultMaterial = static_cast<uint32_t>(m_materials.size());
+	m_materials.push_back(Material{});
+
+	// Size everything up front so the attribute copies below write straight into the final arrays.
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	ForEachGltfPrimitive(data, [&](const cgltf_primitive& primitive, const glm::mat4&)
+	{
+		const auto* position = FindGltfAttribute(primitive, cgltf_attribute_type_position);
+		vertexCount += position->count;
+		indexCount += primitive.indices ? primitive.indices->count : position->count;
+	});
+
+	m_vertices.resize(vertexCount);
+	m_indices.resize(indexCount);
+
+	size_t firstVertex = 0;
+	size_t firstIndex = 0;
+	ForEachGltfPrimitive(data, [&](const cgltf_primitive& primitive, const glm::mat4& world)
+	{
+		const auto* position = FindGltfAttribute(primitive, cgltf_attribute_type_position);
+		const auto* normal = FindGltfAttribute(primitive, cgltf_attribute_type_normal);
+		const auto* uv = FindGltfAttribute(primitive, cgltf_attribute_type_texcoord);
+		const auto* color = FindGltfAttribute(primitive, cgltf_attribute_type_color);
+		const auto* tangent = FindGltfAttribute(primitive, cgltf_attribute_type_tangent);
+
+		const auto count = position->count;
+		auto* vertices = m_vertices.data() + firstVertex;
+
+		Submesh submesh{};
+		{
+			submesh.firstIndex = static_cast<uint32_t>(firstIndex);
+			submesh.indexCount = static_cast<uint32_t>(primitive.indices ? primitive.indices->count : count);
+			submesh.firstVertex = static_cast<uint32_t>(firstVertex);
+			submesh.vertexCount = static_cast<uint32_t>(count);
+			submesh.material = primitive.material ? static_cast<uint32_t>(primitive.material - data->materials) : defaultMaterial;
+		}
+
+		// Vertices. Missing attributes stay zero, except color which falls back to the base color.
+		// Missing normals and tangents are generated afterwards. Attributes with a different count
+		// than the positions are treated as missing.
+		CopyGltfAttribute(position, vertices, offsetof(Vertex, position), 3);
+
+		const bool hasNormals = normal && normal->count == count;
+		const bool hasTangents = tangent && tangent->count == count;
+
+		if (hasNormals)
+		{
+			CopyGltfAttribute(normal, vertices, offsetof(Vertex, normal), 3);
+		}
+
+		if (hasTangents)
+		{
+			CopyGltfAttribute(tangent, vertices, offsetof(Vertex, tangent), 4);
+		}
+
+		// glTF UVs already have their origin in the top left like Vulkan, no flip needed.
+		if (uv && uv->count == count)
+		{
+			CopyGltfAttribute(uv, vertices, offsetof(Vertex, uv), 2);
+		}
+
+		const glm::vec3 baseColor = glm::vec3(m_materials[submesh.material].baseColor);
+		if (color && color->count == count)
+		{
+			CopyGltfAttribute(color, vertices, offsetof(Vertex, color), 3);
+			for (size_t v = 0; v < count; ++v)
+			{
+				vertices[v].color *= baseColor;
+			}
+		}
+		else
+		{
+			for (size_t v = 0; v < count; ++v)
+			{
+				vertices[v].color = baseColor;
+			}
+		}
+
+		// The whole mesh is drawn at once, so the vertices carry which material they belong to.
+		for (size_t v = 0; v < count; ++v)
+		{
+			vertices[v].material = submesh.material;
+		}
+
+		// Only nodes that actually move the mesh pay for a transform.
+		if (world != glm::mat4(1.0f))
+		{
+			const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+			for (size_t v = 0; v < count; ++v)
+			{
+				vertices[v].position = glm::vec3(world * glm::vec4(vertices[v].position, 1.0f));
+				if (hasNormals)
+				{
+					vertices[v].normal = glm::normalize(normalMatrix * vertices[v].normal);
+				}
+				if (hasTangents)
+				{
+					const glm::vec3 t = glm::normalize(glm::mat3(world) * glm::vec3(vertices[v].tangent));
+					vertices[v].tangent = glm::vec4(t, vertices[v].tangent.w);
+				}
+			}
+		}
+
+		// Indices, rebased onto the shared vertex buffer.
+		auto* indices = m_indices.data() + firstIndex;
+		const auto base = static_cast<uint32_t>(firstVertex);
+
+		if (!primitive.indices)
+		{
+			std::iota(indices, indices + count, base);
+		}
+		else if (!CopyGltfIndices(primitive.indices, indices, base))
+		{
+			for (cgltf_size i = 0; i < primitive.indices->count; ++i)
+			{
+				indices[i] = base + static_cast<uint32_t>(cgltf_accessor_read_index(primitive.indices, i));
+			}
+		}
+
+		m_submeshes.push_back(submesh);
+		firstVertex += count;
+		firstIndex += submesh.indexCount;
+	});
+}
+
+void Mesh::GenerateTangentFrames()
+{
+	// Only the full resolution mesh, LODs reuse its vertices.
+	const size_t indexCount = m_lods.empty() ? m_indices.size() : m_lods[0].indexCount;
+	const size_t triangleCount = indexCount / 3;
+	const size_t vertexCount = m_vertices.size();
+
+	const bool missingNormals = std::any_of(m_vertices.begin(), m_vertices.end(), [](const Vertex& v) { return glm::dot(v.normal, v.normal) == 0.0f; });
+	const bool missingTangents = std::any_of(m_vertices.begin(), m_vertices.end(), [](const Vertex& v) { return v.tangent.w == 0.0f; });
+
+	if (!missingNormals && !missingTangents)
+	{
+		return;
+	}
+
+	// Each pass first computes per triangle values in parallel, then every vertex gathers the
+	// corners that touch it. Every thread only ever writes its own elements, so there are no locks or atomics.
+
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	std::vector<float> cornerAngles(indexCount);
+
+	ParallelFor(triangleCount, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; ++t)
+		{
+			const auto& p0 = m_vertices[m_indices[3 * t + 0]].position;
+			const auto& p1 = m_vertices[m_indices[3 * t + 1]].position;
+			const auto& p2 = m_vertices[m_indices[3 * t + 2]].position;
+
+			auto normal = glm::cross(p1 - p0, p2 - p0);
+			auto length = glm::length(normal);
+			faceNormals[t] = length > 0.0f ? normal / length : glm::vec3(0);
+
+			cornerAngles[3 * t + 0] = CornerAngle(p0, p1, p2);
+			cornerAngles[3 * t + 1] = CornerAngle(p1, p2, p0);
+			cornerAngles[3 * t + 2] = CornerAngle(p2, p0, p1);
+		}
+	});
+
+	if (missingNormals)
+	{
+		// Vertices split along UV seams share a position. Grouping by position keeps the normals
+		// smooth across the seam instead of creasing it.
+		std::vector<uint32_t> wedge(vertexCount);
+		{
+			std::unordered_map<glm::vec3, uint32_t> positions;
+			positions.reserve(vertexCount);
+
+			for (uint32_t i = 0; i < vertexCount; ++i)
+			{
+				wedge[i] = positions.emplace(m_vertices[i].position, i).first->second;
+			}
+		}
+
+		auto adjacency = BuildCornerAdjacency(m_indices, indexCount, vertexCount, [&](uint32_t v) { return wedge[v]; });
+
+		ParallelFor(vertexCount, [&](size_t begin, size_t end)
+		{
+			for (size_t v = begin; v < end; ++v)
+			{
+				auto& vertex = m_vertices[v];
+				if (glm::dot(vertex.normal, vertex.normal) != 0.0f)
+				{
+					continue;
+				}
+
+				// Weighting by the corner angle makes the result independent of how the surface is triangulated.
+				glm::vec3 sum(0);
+				for (auto j = adjacency.offsets[wedge[v]]; j < adjacency.offsets[wedge[v] + 1]; ++j)
+				{
+					auto corner = adjacency.corners[j];
+					sum += faceNormals[corner / 3] * cornerAngles[corner];
+				}
+
+				auto length = glm::length(sum);
+				vertex.normal = length > 0.0f ? sum / length : glm::vec3(0, 0, 1);
+			}
+		});
+	}
+
+	if (missingTangents)
+	{
+		// Directions of increasing U and V across each triangle.
+		std::vector<glm::vec3> faceTangents(triangleCount);
+		std::vector<glm::vec3> faceBitangents(triangleCount);
+
+		ParallelFor(triangleCount, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; ++t)
+			{
+				const auto& v0 = m_vertices[m_indices[3 * t + 0]];
+				const auto& v1 = m_vertices[m_indices[3 * t + 1]];
+				const auto& v2 = m_vertices[m_indices[3 * t + 2]];
+
+				auto e1 = v1.position - v0.position;
+				auto e2 = v2.position - v0.position;
+				auto uv1 = v1.uv - v0.uv;
+				auto uv2 = v2.uv - v0.uv;
+
+				// No UVs or a degenerate mapping, leave it to the fallback below.
+				float determinant = uv1.x * uv2.y - uv2.x * uv1.y;
+				if (std::abs(determinant) < 1e-12f)
+				{
+					faceTangents[t] = glm::vec3(0);
+					faceBitangents[t] = glm::vec3(0);
+					continue;
+				}
+
+				faceTangents[t] = (e1 * uv2.y - e2 * uv1.y) / determinant;
+				faceBitangents[t] = (e2 * uv1.x - e1 * uv2.x) / determinant;
+			}
+		});
+
+		// Tangents follow the UVs, so unlike normals they are never shared across seams.
+		auto adjacency = BuildCornerAdjacency(m_indices, indexCount, vertexCount, [](uint32_t v) { return v; });
+
+		ParallelFor(vertexCount, [&](size_t begin, size_t end)
+		{
+			for (size_t v = begin; v < end; ++v)
+			{
+				auto& vertex = m_vertices[v];
+				if (vertex.tangent.w != 0.0f)
+				{
+					continue;
+				}
+
+				const auto& n = vertex.normal;
+
+				// Like MikkTSpace, each face's tangent is projected onto the vertex's tangent plane
+				// and normalized before it's weighted by the corner angle.
+				glm::vec3 tangent(0);
+				glm::vec3 bitangent(0);
+				for (auto j = adjacency.offsets[v]; j < adjacency.offsets[v + 1]; ++j)
+				{
+					auto corner = adjacency.corners[j];
+
+					auto t = faceTangents[corner / 3] - n * glm::dot(n, faceTangents[corner / 3]);
+					auto b = faceBitangents[corner / 3] - n * glm::dot(n, faceBitangents[corner / 3]);
+
+					auto tLength = glm::length(t);
+					auto bLength = glm::length(b);
+					if (tLength > 0.0f)
+					{
+						tangent += t * (cornerAngles[corner] / tLength);
+					}
+					if (bLength > 0.0f)
+					{
+						bitangent += b * (cornerAngles[corner] / bLength);
+					}
+				}
+
+				tangent -= n * glm::dot(n, tangent);
+
+				// Any direction in the tangent plane will do when there's nothing to go by.
+				auto length = glm::length(tangent);
+				if (length < 1e-6f)
+				{
+					glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+					tangent = glm::normalize(axis - n * glm::dot(n, axis));
+				}
+				else
+				{
+					tangent /= length;
+				}
+
+				// bitangent = w * cross(normal, tangent)
+				float handedness = glm::dot(glm::cross(n, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+				vertex.tangent = glm::vec4(tangent, handedness);
+			}
+		});
+	}
+}
+
+std::vector<char> Mesh::Serialize() const
+{
+	CookedMeshHeader header{};
+	{
+		header.magic = COOKED_MESH_MAGIC;
+		header.version = COOKED_MESH_VERSION;
+		header.vertexSize = sizeof(Vertex);
+		header.vertexCount = static_cast<uint32_t>(m_vertices.size());
+		header.indexCount = static_cast<uint32_t>(m_indices.size());
+		header.lodCount = static_cast<uint32_t>(m_lods.size());
+		header.meshletCount = static_cast<uint32_t>(m_meshlets.size());
+		header.submeshCount = static_cast<uint32_t>(m_submeshes.size());
+		header.materialCount = static_cast<uint32_t>(m_materials.size());
+		header.center[0] = m_center.x;
+		header.center[1] = m_center.y;
+		header.center[2] = m_center.z;
+		header.radius = m_radius;
+	}
+
+	std::vector<char> blob;
+	WriteArray(blob, &header, 1);
+	WriteArray(blob, m_vertices.data(), m_vertices.size());
+	WriteArray(blob, m_indices.data(), m_indices.size());
+	WriteArray(blob, m_lods.data(), m_lods.size());
+	WriteArray(blob, m_meshlets.data(), m_meshlets.size());
+	WriteArray(blob, m_submeshes.data(), m_submeshes.size());
+
+	for (const auto& material : m_materials)
+	{
+		auto length = static_cast<uint32_t>(material.baseColorTexture.size());
+		WriteArray(blob, &material.baseColor, 1);
+		WriteArray(blob, &length, 1);
+		WriteArray(blob, material.baseColorTexture.data(), length);
+	}
+
+	return blob;
+}
+
+void Mesh::LoadCooked(const char* data, size_t size)
+{
+	const char* cursor = data;
+	const char* end = data + size;
+
+	CookedMeshHeader header{};
+	ReadArray(cursor, end, &header, 1);
+
+	if (header.magic != COOKED_MESH_MAGIC || header.version != COOKED_MESH_VERSION || header.vertexSize != sizeof(Vertex))
+	{
+		throw std::runtime_error("Cooked mesh is from a different cooker version");
+	}
+
+	m_vertices.resize(header.vertexCount);
+	m_indices.resize(header.indexCount);
+	m_lods.resize(header.lodCount);
+	m_meshlets.resize(header.meshletCount);
+	m_submeshes.resize(header.submeshCount);
+	m_materials.resize(header.materialCount);
+
+	ReadArray(cursor, end, m_vertices.data(), m_vertices.size());
+	ReadArray(cursor, end, m_indices.data(), m_indices.size());
+	ReadArray(cursor, end, m_lods.data(), m_lods.size());
+	ReadArray(cursor, end, m_meshlets.data(), m_meshlets.size());
+	ReadArray(cursor, end, m_submeshes.data(), m_submeshes.size());
+
+	for (auto& material : m_materials)
+	{
+		uint32_t length = 0;
+		ReadArray(cursor, end, &material.baseColor, 1);
+		ReadArray(cursor, end, &length, 1);
+
+		material.baseColorTexture.resize(length);
+		ReadArray(cursor, end, &material.baseColorTexture[0], length);
+	}
+
+	m_center = glm::vec3(header.center[0], header.center[1], header.center[2]);
+	m_radius = header.radius;
+}
+
+std::vector<VertexPosition> Mesh::GetPositionStream() const
+{
+	std::vector<VertexPosition> positions(m_vertices.size());
+	for (size_t i = 0; i < m_vertices.size(); ++i)
+	{
+		const auto& position = m_vertices[i].position;
+		positions[i] = { position.x, position.y, position.z };
+	}
+
+	return positions;
+}
+
+std::vector<VertexAttributes> Mesh::GetAttributeStream() const
+{
+	std::vector<VertexAttributes> attributes(m_vertices.size());
+	for (size_t i = 0; i < m_vertices.size(); ++i)
+	{
+		const auto& vertex = m_vertices[i];
+		attributes[i] = { vertex.normal, vertex.color, vertex.uv, vertex.tangent, vertex.material };
+	}
+
+	return attributes;
+}
+
+void Mesh::ComputeBounds()
+{
+	// Bounding sphere around the AABB, good enough for LOD selection.
+	if (!m_vertices.empty())
+	{
+		glm::vec3 minBounds = m_vertices[0].position;
+		glm::vec3 maxBounds = m_vertices[0].position;
+		for (const auto& vertex : m_vertices)
+		{
+			minBounds = glm::min(minBounds, vertex.position);
+			maxBounds = glm::max(maxBounds, vertex.position);
+		}
+
+		m_center = (minBounds + maxBounds) * 0.5f;
+		m_radius = 0.0f;
+		for (const auto& vertex : m_vertices)
+		{
+			m_radius = std::max(m_radius, glm::distance(m_center, vertex.position));
+		}
+	}
+}
+
+void Mesh::GenerateLods(uint32_t maxLods, float reduction)
+{
+	// Throw away any previously generated chain.
+	if (!m_lods.empty())
+	{
+		m_indices.resize(m_lods[0].indexCount);
+		m_lods.resize(1);
+	}
+
+	std::vector<uint32_t> previous = m_indices;
+	float error = 0.0f;
+
+	while (m_lods.size() < maxLods)
+	{
+		auto targetIndexCount = static_cast<size_t>(previous.size() / 3 * reduction) * 3;
+
+		float lodError = 0.0f;
+		auto lodIndices = SimplifyIndices(m_vertices, previous, targetIndexCount, lodError);
+
+		// Stop once the simplifier gets stuck on seams and borders.
+		if (lodIndices.empty() || lodIndices.size() > previous.size() * 0.9f)
+		{
+			break;
+		}
+
+		// Each LOD is simplified from the previous one so their errors add up.
+		error += lodError;
+
+		m_lods.push_back({ static_cast<uint32_t>(m_indices.size()), static_cast<uint32_t>(lodIndices.size()), error });
+		m_indices.insert(m_indices.end(), lodIndices.begin(), lodIndices.end());
+
+		previous = std::move(lodIndices);
+	}
+}
+
+uint32_t Mesh::SelectLod(float distance, float fov, float viewportHeight, float pixelError) const
+{
+	// Measure from the closest point of the bounding sphere so the error is never underestimated.
+	distance = std::max(distance - m_radius, std::numeric_limits<float>::epsilon());
+
+	// How many pixels one object space unit covers at that distance.
+	float pixelsPerUnit = viewportHeight / (2.0f * distance * std::tan(fov * 0.5f));
+
+	uint32_t lod = 0;
+	for (uint32_t i = 1; i < m_lods.size(); ++i)
+	{
+		if (m_lods[i].error * pixelsPerUnit > pixelError)
+		{
+			break;
+		}
+
+		lod = i;
+	}
+
+	return lod;
+}
+
+void Mesh::BuildMeshlets(uint32_t maxVertices, uint32_t maxTriangles)
+{
+	m_meshlets.clear();
+
+	if (m_lods.empty())
+	{
+		return;
+	}
+
+	const auto& lod = m_lods[0];
+	const uint32_t triangleCount = lod.indexCount / 3;
+
+	// LOD 0's triangles are reordered so every meshlet is a contiguous range of it and can be drawn
+	// straight out of the existing index buffer. Reads go through a copy of the original order.
+	const std::vector<uint32_t> source(m_indices.begin() + lod.firstIndex, m_indices.begin() + lod.firstIndex + triangleCount * 3);
+
+	// Triangles around each vertex, so a meshlet can grow into its neighbours.
+	std::vector<uint32_t> adjacencyOffsets(m_vertices.size() + 1, 0);
+	std::vector<uint32_t> adjacency(source.size());
+	{
+		for (auto index : source)
+		{
+			adjacencyOffsets[index + 1]++;
+		}
+		std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+		std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < source.size(); ++i)
+		{
+			adjacency[cursor[source[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<glm::vec3> centroids(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		centroids[t] = (m_vertices[source[t * 3 + 0]].position + m_vertices[source[t * 3 + 1]].position + m_vertices[source[t * 3 + 2]].position) / 3.0f;
+	}
+
+	// Meshlets never cross a submesh boundary, each submesh stays a contiguous range too.
+	std::vector<uint32_t> rangeStarts = { 0, triangleCount };
+	for (const auto& submesh : m_submeshes)
+	{
+		if (submesh.firstIndex > lod.firstIndex && submesh.firstIndex < lod.firstIndex + triangleCount * 3)
+		{
+			rangeStarts.push_back((submesh.firstIndex - lod.firstIndex) / 3);
+		}
+	}
+	std::sort(rangeStarts.begin(), rangeStarts.end());
+	rangeStarts.erase(std::unique(rangeStarts.begin(), rangeStarts.end()), rangeStarts.end());
+
+	std::vector<bool> used(triangleCount, false);
+	std::vector<uint32_t> meshletVertices;
+	meshletVertices.reserve(maxVertices);
+
+	Meshlet meshlet{};
+	meshlet.firstIndex = lod.firstIndex;
+
+	auto isNew = [&](uint32_t index) { return std::find(meshletVertices.begin(), meshletVertices.end(), index) == meshletVertices.end(); };
+
+	// Unused triangle of [begin, end) touching the current meshlet whose centroid is closest to target,
+	// optionally only one that still fits. UINT32_MAX if there's none.
+	auto nearestNeighbour = [&](uint32_t begin, uint32_t end, const glm::vec3& target, bool mustFit)
+	{
+		uint32_t best = UINT32_MAX;
+		uint32_t bestNewVertices = UINT32_MAX;
+		float bestDistance = std::numeric_limits<float>::max();
+
+		for (auto vertex : meshletVertices)
+		{
+			for (auto k = adjacencyOffsets[vertex]; k < adjacencyOffsets[vertex + 1]; ++k)
+			{
+				auto t = adjacency[k];
+				if (used[t] || t < begin || t >= end)
+				{
+					continue;
+				}
+
+				uint32_t newVertices = 0;
+				for (int v = 0; v < 3; ++v)
+				{
+					newVertices += isNew(source[t * 3 + v]) ? 1 : 0;
+				}
+
+				if (mustFit && meshletVertices.size() + newVertices > maxVertices)
+				{
+					continue;
+				}
+
+				// Reusing vertices first, then staying compact.
+				auto distance = glm::distance(centroids[t], target);
+				if (newVertices < bestNewVertices || (newVertices == bestNewVertices && distance < bestDistance))
+				{
+					best = t;
+					bestNewVertices = newVertices;
+					bestDistance = distance;
+				}
+			}
+		}
+
+		return best;
+	};
+
+	uint32_t written = lod.firstIndex;
+	for (size_t r = 0; r + 1 < rangeStarts.size(); ++r)
+	{
+		const auto begin = rangeStarts[r];
+		const auto end = rangeStarts[r + 1];
+		uint32_t firstUnused = begin;
+		uint32_t seed = begin;
+
+		while (seed != UINT32_MAX)
+		{
+			// Grow from the seed across shared vertices until the meshlet is full or runs out of neighbours.
+			glm::vec3 centroidSum(0);
+			auto t = seed;
+			while (t != UINT32_MAX)
+			{
+				used[t] = true;
+				centroidSum += centroids[t];
+				for (int v = 0; v < 3; ++v)
+				{
+					auto index = source[t * 3 + v];
+					m_indices[written++] = index;
+					if (isNew(index))
+					{
+						meshletVertices.push_back(index);
+					}
+				}
+
+				if (++meshlet.triangleCount >= maxTriangles)
+				{
+					break;
+				}
+
+				t = nearestNeighbour(begin, end, centroidSum / static_cast<float>(meshlet.triangleCount), true);
+			}
+
+			auto center = centroidSum / static_cast<float>(meshlet.triangleCount);
+
+			// The next one starts next to this one, or at the first unused triangle once this part of the mesh is done.
+			seed = nearestNeighbour(begin, end, center, false);
+			if (seed == UINT32_MAX)
+			{
+				while (firstUnused < end && used[firstUnused])
+				{
+					firstUnused++;
+				}
+				seed = firstUnused < end ? firstUnused : UINT32_MAX;
+			}
+
+			meshlet.indexCount = meshlet.triangleCount * 3;
+			meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+			ComputeMeshletBounds(meshlet, m_vertices, m_indices, meshletVertices);
+			m_meshlets.push_back(meshlet);
+
+			meshlet.firstIndex += meshlet.indexCount;
+			meshlet.triangleCount = 0;
+			meshletVertices.clear();
+		}
+	}
 }
@@ -1,16 +1,97 @@
 #pragma once
 
 #include "vertex.h"
+#include <string>
 #include <vector>
 
+// Bump whenever Mesh::Serialize's layout or how its contents are built changes, older archives and cached meshes are then rejected.
+static const uint32_t COOKED_MESH_VERSION = 3;
+
+// A range of Mesh::m_indices that draws the whole mesh at one level of detail.
+// Every LOD indexes into the same m_vertices so they all share one vertex buffer.
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;	// Object space deviation from the full resolution mesh.
+};
+
+// A glTF primitive (or the whole OBJ) inside the shared vertex and index buffers.
+// Indices are already offset by the submesh's first vertex.
+struct Submesh
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t firstVertex;
+	uint32_t vertexCount;
+	uint32_t material;	// Index into Mesh::m_materials
+};
+
+struct Material
+{
+	glm::vec4 baseColor = glm::vec4(1);
+	std::string baseColorTexture;	// Path relative to the working directory, empty if untextured.
+};
+
+// A small cluster of triangles that can be culled as a unit.
+// The layout matches the Meshlet struct in cull.comp (std430).
+struct Meshlet
+{
+	glm::vec4 sphere;		// xyz - center, w - radius
+	glm::vec4 cone;			// xyz - average normal, w - sine of the normal spread, 1 disables cone culling
+	uint32_t firstIndex;	// Range of Mesh::m_indices
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet has to match the std430 layout used by the culling shader");
+
 class Mesh
 {
 public:
 	Mesh() {}
 	~Mesh() = default;
 
+	// Loads .obj, .gltf and .glb files.
 	void LoadModel(const char* path);
 
+	// Binary form stored in the asset archive. Holds everything LoadModel, GenerateLods and
+	// BuildMeshlets produce, so a cooked mesh is ready to upload as soon as it's copied in.
+	std::vector<char> Serialize() const;
+	void LoadCooked(const char* data, size_t size);
+
+	// Generates angle weighted smooth normals and MikkTSpace style tangents for the vertices
+	// that were loaded without them (zero normal, zero tangent.w). The results stay in m_vertices,
+	// so it only does work the first time. Runs across all hardware threads.
+	void GenerateTangentFrames();
+
+	// Appends progressively simplified index ranges to m_indices.
+	void GenerateLods(uint32_t maxLods, float reduction);
+	// Picks the coarsest LOD whose error projects to less than pixelError on screen.
+	uint32_t SelectLod(float distance, float fov, float viewportHeight, float pixelError) const;
+
+	// The vertices split into the streams described by Vertex::GetBindingDescriptions.
+	std::vector<VertexPosition> GetPositionStream() const;
+	std::vector<VertexAttributes> GetAttributeStream() const;
+
+	// Splits LOD 0 into meshlets of at most maxVertices unique vertices and maxTriangles triangles.
+	// Its triangles are reordered so each meshlet grows across neighbouring triangles and stays compact.
+	void BuildMeshlets(uint32_t maxVertices, uint32_t maxTriangles);
+
 	std::vector<Vertex> m_vertices;
 	std::vector<uint32_t> m_indices;
+	std::vector<MeshLod> m_lods;
+	std::vector<Meshlet> m_meshlets;
+	std::vector<Submesh> m_submeshes;
+	std::vector<Material> m_materials;
+
+	// Bounding sphere in object space.
+	glm::vec3 m_center = glm::vec3(0);
+	float m_radius = 0.0f;
+
+private:
+	void LoadObj(const char* path);
+	void LoadGltf(const char* path);
+	void ComputeBounds();
 };
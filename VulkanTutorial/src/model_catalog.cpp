@@ -0,0 +1,258 @@
+#include "model_catalog.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "constants.h"
+#include "mesh.h"
+
+namespace
+{
+	bool IsModelFile(const std::filesystem::path& path)
+	{
+		auto extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		// Same formats Mesh::LoadModel understands.
+		return extension == ".obj" || extension == ".gltf" || extension == ".glb";
+	}
+
+	// Flat shaded front view of the mesh, scaled to fit. Small enough to rasterize on the CPU.
+	std::vector<uint8_t> RenderThumbnail(const Mesh& mesh)
+	{
+		const uint32_t size = MODEL_THUMBNAIL_SIZE;
+		std::vector<uint8_t> pixels(size * size, 0);
+
+		if (mesh.m_vertices.empty())
+		{
+			return pixels;
+		}
+
+		glm::vec3 minimum(std::numeric_limits<float>::max());
+		glm::vec3 maximum(std::numeric_limits<float>::lowest());
+		for (const auto& vertex : mesh.m_vertices)
+		{
+			minimum = glm::min(minimum, vertex.position);
+			maximum = glm::max(maximum, vertex.position);
+		}
+
+		// Same scale on both axes so the model isn't stretched, centered in the image.
+		glm::vec3 extent = maximum - minimum;
+		float scale = (size - 1) / std::max(std::max(extent.x, extent.y), 1e-6f);
+		glm::vec2 offset = (glm::vec2(size - 1) - glm::vec2(extent.x, extent.y) * scale) * 0.5f;
+
+		auto project = [&](const glm::vec3& position)
+		{
+			// Image rows go down, y goes up.
+			return glm::vec3(
+				(position.x - minimum.x) * scale + offset.x,
+				(size - 1) - ((position.y - minimum.y) * scale + offset.y),
+				position.z);
+		};
+
+		std::vector<float> depth(size * size, std::numeric_limits<float>::lowest());
+
+		// Only LOD 0, which is all LoadModel produces.
+		for (size_t i = 0; i + 2 < mesh.m_indices.size(); i += 3)
+		{
+			const auto& p0 = mesh.m_vertices[mesh.m_indices[i + 0]].position;
+			const auto& p1 = mesh.m_vertices[mesh.m_indices[i + 1]].position;
+			const auto& p2 = mesh.m_vertices[mesh.m_indices[i + 2]].position;
+
+			// Faces pointing at the viewer are brightest, either winding counts.
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length <= 0.0f)
+			{
+				continue;
+			}
+			auto shade = static_cast<uint8_t>(64 + 191 * std::abs(normal.z / length));
+
+			glm::vec3 a = project(p0);
+			glm::vec3 b = project(p1);
+			glm::vec3 c = project(p2);
+
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (std::abs(area) < 1e-12f)
+			{
+				continue;
+			}
+
+			auto xStart = static_cast<int>(std::max(0.0f, std::floor(std::min({ a.x, b.x, c.x }))));
+			auto xEnd = static_cast<int>(std::min(size - 1.0f, std::ceil(std::max({ a.x, b.x, c.x }))));
+			auto yStart = static_cast<int>(std::max(0.0f, std::floor(std::min({ a.y, b.y, c.y }))));
+			auto yEnd = static_cast<int>(std::min(size - 1.0f, std::ceil(std::max({ a.y, b.y, c.y }))));
+
+			for (int y = yStart; y <= yEnd; ++y)
+			{
+				for (int x = xStart; x <= xEnd; ++x)
+				{
+					// Sampled at the pixel center.
+					float px = x + 0.5f;
+					float py = y + 0.5f;
+
+					float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) / area;
+					float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) / area;
+					float w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					{
+						continue;
+					}
+
+					// Looking down -z, so larger z is closer.
+					float z = w0 * a.z + w1 * b.z + w2 * c.z;
+					auto& texelDepth = depth[y * size + x];
+					if (z > texelDepth)
+					{
+						texelDepth = z;
+						pixels[y * size + x] = shade;
+					}
+				}
+			}
+		}
+
+		return pixels;
+	}
+}
+
+void ModelCatalog::Open(const std::string& directory)
+{
+	m_directory = directory;
+	m_watcher.WatchDirectory(directory);
+
+	Rescan();
+}
+
+void ModelCatalog::Update()
+{
+	if (!m_watcher.PollDirectoryChanges().empty())
+	{
+		Rescan();
+	}
+
+	if (m_metadataJob.valid() && m_metadataJob.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		auto result = m_metadataJob.get();
+
+		// The file may have been changed or removed while it was loading, a rescan queues it again.
+		auto model = std::find_if(m_models.begin(), m_models.end(), [&result](const ModelInfo& info) { return info.path == result.path; });
+		if (model != m_models.end() && model->writeTime == result.writeTime)
+		{
+			model->metadata = result.loaded ? ModelInfo::Metadata::Ready : ModelInfo::Metadata::Failed;
+			model->vertexCount = result.vertexCount;
+			model->triangleCount = result.triangleCount;
+			model->thumbnail = std::move(result.thumbnail);
+		}
+	}
+
+	StartNextMetadata();
+}
+
+void ModelCatalog::RequestMetadata(size_t index)
+{
+	auto& model = m_models[index];
+	if (model.metadata != ModelInfo::Metadata::Missing)
+	{
+		return;
+	}
+
+	model.metadata = ModelInfo::Metadata::Pending;
+	m_metadataQueue.push_back(model.path);
+}
+
+void ModelCatalog::Rescan()
+{
+	namespace fs = std::filesystem;
+
+	std::vector<ModelInfo> models;
+
+	// Missing directories just mean an empty list.
+	std::error_code error;
+	for (fs::directory_iterator it(m_directory, error), end; !error && it != end; it.increment(error))
+	{
+		if (!it->is_regular_file(error) || !IsModelFile(it->path()))
+		{
+			continue;
+		}
+
+		ModelInfo model;
+		{
+			model.path = it->path().generic_string();
+			model.name = it->path().filename().string();
+			model.fileSize = it->file_size(error);
+			model.writeTime = it->last_write_time(error);
+		}
+
+		// Files that didn't change keep what's known about them.
+		auto existing = std::find_if(m_models.begin(), m_models.end(), [&model](const ModelInfo& info) { return info.path == model.path; });
+		if (existing != m_models.end() && existing->fileSize == model.fileSize && existing->writeTime == model.writeTime)
+		{
+			model = std::move(*existing);
+		}
+
+		models.push_back(std::move(model));
+	}
+
+	if (error)
+	{
+		std::cerr << "Failed to list " << m_directory << ": " << error.message() << std::endl;
+	}
+
+	std::sort(models.begin(), models.end(), [](const ModelInfo& a, const ModelInfo& b) { return a.name < b.name; });
+	m_models = std::move(models);
+
+	// Anything queued for a file that's gone or changed is requested again when it's drawn.
+	m_metadataQueue.erase(std::remove_if(m_metadataQueue.begin(), m_metadataQueue.end(), [this](const std::string& path)
+	{
+		return std::none_of(m_models.begin(), m_models.end(), [&path](const ModelInfo& info)
+		{
+			return info.path == path && info.metadata == ModelInfo::Metadata::Pending;
+		});
+	}), m_metadataQueue.end());
+}
+
+void ModelCatalog::StartNextMetadata()
+{
+	if (m_metadataJob.valid() || m_metadataQueue.empty())
+	{
+		return;
+	}
+
+	auto path = m_metadataQueue.front();
+	m_metadataQueue.pop_front();
+
+	auto model = std::find_if(m_models.begin(), m_models.end(), [&path](const ModelInfo& info) { return info.path == path; });
+	if (model == m_models.end())
+	{
+		return;
+	}
+
+	m_metadataJob = std::async(std::launch::async, LoadMetadata, path, model->writeTime);
+}
+
+ModelCatalog::MetadataResult ModelCatalog::LoadMetadata(const std::string& path, std::filesystem::file_time_type writeTime)
+{
+	MetadataResult result;
+	result.path = path;
+	result.writeTime = writeTime;
+
+	try
+	{
+		Mesh mesh;
+		mesh.LoadModel(path.c_str());
+
+		result.vertexCount = static_cast<uint32_t>(mesh.m_vertices.size());
+		result.triangleCount = static_cast<uint32_t>(mesh.m_indices.size() / 3);
+		result.thumbnail = RenderThumbnail(mesh);
+		result.loaded = true;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Failed to load " << path << " for the model browser: " << e.what() << std::endl;
+	}
+
+	return result;
+}
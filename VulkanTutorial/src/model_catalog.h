@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "file_watcher.h"
+
+// A model file the browser can show. The metadata is filled in on a background thread
+// the first time something asks for it.
+struct ModelInfo
+{
+	enum class Metadata
+	{
+		Missing,
+		Pending,
+		Ready,
+		Failed,
+	};
+
+	std::string path;
+	std::string name;
+	uintmax_t fileSize = 0;
+	std::filesystem::file_time_type writeTime;
+
+	Metadata metadata = Metadata::Missing;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+	std::vector<uint8_t> thumbnail;	// MODEL_THUMBNAIL_SIZE squared, brightness of the front view. Zero is empty.
+};
+
+// Index of the model files in a directory. It's listed once and after that only when the file
+// watcher reports a change, so drawing the browser never touches the file system.
+class ModelCatalog
+{
+public:
+	void Open(const std::string& directory);
+
+	// Once per frame, picks up directory changes and finished metadata.
+	void Update();
+
+	// Queues loading the model for its metadata, unless that already happened.
+	void RequestMetadata(size_t index);
+
+	const std::vector<ModelInfo>& Models() const { return m_models; }
+	const std::string& Directory() const { return m_directory; }
+
+private:
+	struct MetadataResult
+	{
+		std::string path;
+		std::filesystem::file_time_type writeTime;
+		bool loaded = false;
+		uint32_t vertexCount = 0;
+		uint32_t triangleCount = 0;
+		std::vector<uint8_t> thumbnail;
+	};
+
+	void Rescan();
+	void StartNextMetadata();
+	static MetadataResult LoadMetadata(const std::string& path, std::filesystem::file_time_type writeTime);
+
+	std::string m_directory;
+	FileWatcher m_watcher;
+	std::vector<ModelInfo> m_models;	// Sorted by name.
+
+	// Models are loaded one at a time, the browser isn't worth more than one core.
+	std::deque<std::string> m_metadataQueue;
+	std::future<MetadataResult> m_metadataJob;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#endif
+
+#include <vulkan/vulkan.h>
+
+#include "asset_cache.h"
+#include "vulkan_manager.h"
+
+// One VkPipelineCache shared by every pipeline the app creates (scene, culling, ImGui), written to disk
+// on shutdown and read back on the next launch. With a warm cache the driver skips compiling shaders
+// it has already seen, both at startup and when pipelines are recreated after a resize.
+class PipelineCache
+{
+	static inline PipelineCache* s_cache;
+
+public:
+	static PipelineCache& Get()
+	{
+		if (!s_cache)
+		{
+			s_cache = new PipelineCache();
+		}
+
+		return *s_cache;
+	}
+
+	// Has to run after the device is created, before the first pipeline.
+	void Load(const std::string& path)
+	{
+		m_path = path;
+
+		auto& vkManager = VulkanManager::GetVulkanManager();
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(vkManager.GetPhysicalDevice(), &properties);
+
+		auto data = ReadCache(properties);
+		if (!data.empty())
+		{
+			std::cout << "Loaded pipeline cache " << m_path << " (" << data.size() / 1024 << " KB)" << std::endl;
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		{
+			cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			cacheInfo.initialDataSize = data.size();
+			cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+		}
+
+		if (vkCreatePipelineCache(vkManager.GetDevice(), &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+		{
+			// The data passed every check but the driver still didn't like it, start over.
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			if (vkCreatePipelineCache(vkManager.GetDevice(), &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create pipeline cache");
+			}
+		}
+	}
+
+	VkPipelineCache GetHandle() const { return m_cache; }
+
+	// A failed write only costs the next launch its warm start.
+	bool Save() const
+	{
+		if (m_cache == VK_NULL_HANDLE || m_path.empty())
+		{
+			return false;
+		}
+
+		auto& vkManager = VulkanManager::GetVulkanManager();
+
+		size_t size = 0;
+		if (vkGetPipelineCacheData(vkManager.GetDevice(), m_cache, &size, nullptr) != VK_SUCCESS)
+		{
+			return false;
+		}
+
+		std::vector<char> data(size);
+		if (vkGetPipelineCacheData(vkManager.GetDevice(), m_cache, &size, data.data()) != VK_SUCCESS)
+		{
+			return false;
+		}
+		data.resize(size);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(vkManager.GetPhysicalDevice(), &properties);
+
+		FileHeader header;
+		{
+			header.magic = FILE_MAGIC;
+			header.version = FILE_VERSION;
+			header.vendorID = properties.vendorID;
+			header.deviceID = properties.deviceID;
+			header.driverVersion = properties.driverVersion;
+			memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+			header.dataSize = data.size();
+			header.dataHash = XXH3_64bits(data.data(), data.size());
+		}
+
+		return WriteFileAtomically(m_path, { ByteSpan(reinterpret_cast<const char*>(&header), sizeof(header)), ByteSpan(data) });
+	}
+
+	// Saves first, has to run before the device is destroyed and after every pipeline using it was created.
+	void Destroy()
+	{
+		if (m_cache == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		if (!Save())
+		{
+			std::cerr << "Failed to save pipeline cache to " << m_path << std::endl;
+		}
+
+		vkDestroyPipelineCache(VulkanManager::GetVulkanManager().GetDevice(), m_cache, nullptr);
+		m_cache = VK_NULL_HANDLE;
+	}
+
+private:
+	static const uint32_t FILE_MAGIC = 0x43505456;	// "VTPC"
+	static const uint32_t FILE_VERSION = 1;
+
+	// Written in front of the driver's data. The driver's own header has the UUID but not the driver
+	// version, and a driver update can keep the UUID while changing what it compiles.
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint32_t padding = 0;
+		uint64_t dataSize;
+		uint64_t dataHash;
+	};
+
+	// Anything that doesn't match this device and driver exactly is thrown away. Drivers are supposed to
+	// reject foreign data themselves, not all of them do.
+	std::vector<char> ReadCache(const VkPhysicalDeviceProperties& properties) const
+	{
+		std::ifstream file(m_path, std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			return {};
+		}
+
+		auto fileSize = static_cast<size_t>(file.tellg());
+		file.seekg(0);
+
+		FileHeader header;
+		if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		{
+			std::cout << "Pipeline cache " << m_path << " is truncated, starting empty" << std::endl;
+			return {};
+		}
+
+		if (header.magic != FILE_MAGIC ||
+			header.version != FILE_VERSION ||
+			header.vendorID != properties.vendorID ||
+			header.deviceID != properties.deviceID ||
+			header.driverVersion != properties.driverVersion ||
+			memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			std::cout << "Pipeline cache " << m_path << " was written for another device or driver, starting empty" << std::endl;
+			return {};
+		}
+
+		std::vector<char> data(fileSize - sizeof(header));
+		if (header.dataSize != data.size() ||
+			!file.read(data.data(), static_cast<std::streamsize>(data.size())) ||
+			header.dataHash != XXH3_64bits(data.data(), data.size()))
+		{
+			std::cout << "Pipeline cache " << m_path << " is corrupt, starting empty" << std::endl;
+			return {};
+		}
+
+		// Same checks against the driver's header at the start of the data.
+		const size_t driverHeaderSize = 16 + VK_UUID_SIZE;
+		if (data.size() < driverHeaderSize)
+		{
+			return {};
+		}
+
+		uint32_t driverHeader[4];
+		memcpy(driverHeader, data.data(), sizeof(driverHeader));
+		if (driverHeader[0] < driverHeaderSize ||
+			driverHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+			driverHeader[2] != properties.vendorID ||
+			driverHeader[3] != properties.deviceID ||
+			memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			std::cout << "Pipeline cache " << m_path << " has a mismatched driver header, starting empty" << std::endl;
+			return {};
+		}
+
+		return data;
+	}
+
+	std::string m_path;
+	VkPipelineCache m_cache = VK_NULL_HANDLE;
+};
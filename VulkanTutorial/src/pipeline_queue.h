@@ -0,0 +1,146 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "helpers.h"
+
+// Priorities for PipelineQueue::Submit.
+enum PipelinePriority : int
+{
+	PIPELINE_PRIORITY_BACKGROUND = 0,	// Might be needed later, e.g. material permutations nobody has selected yet.
+	PIPELINE_PRIORITY_IMMEDIATE = 1,	// Something is waiting on it, e.g. the first frame.
+};
+
+// Pool of worker threads creating pipelines in parallel. The driver compiles shaders inside
+// vkCreate*Pipelines, with tens of permutations that's most of startup when done one at a time.
+// Builds pass PipelineCache's handle, the driver synchronizes access to a VkPipelineCache internally
+// so every thread fills the same cache and it's saved once on exit.
+// Higher priorities are built first, equal priorities in submission order.
+class PipelineQueue
+{
+	static inline PipelineQueue* s_queue;
+
+public:
+	static PipelineQueue& Get()
+	{
+		if (!s_queue)
+		{
+			s_queue = new PipelineQueue();
+		}
+
+		return *s_queue;
+	}
+
+	// Creates and returns one pipeline, throws if it can't. Runs on a worker thread, so everything it
+	// reads has to stay unchanged until the future is ready.
+	using Build = std::function<VkPipeline()>;
+
+	// The future rethrows whatever the build threw. Threads are started on the first submit.
+	std::shared_future<VkPipeline> Submit(Build build, int priority = PIPELINE_PRIORITY_BACKGROUND)
+	{
+		std::packaged_task<VkPipeline()> task(std::move(build));
+		auto future = task.get_future().share();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (m_workers.empty())
+			{
+				StartWorkers();
+			}
+
+			m_queue.push({ std::move(task), priority, m_sequence++ });
+		}
+
+		m_workAvailable.notify_one();
+
+		return future;
+	}
+
+	// Queued builds are dropped, their futures throw std::future_error. Builds already running finish first.
+	void Shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+
+		m_workAvailable.notify_all();
+
+		for (auto& worker : m_workers)
+		{
+			worker.join();
+		}
+		m_workers.clear();
+
+		m_queue = {};
+		m_stopping = false;
+	}
+
+private:
+	struct QueuedBuild
+	{
+		// Mutable so it can be moved out of the priority queue's top().
+		mutable std::packaged_task<VkPipeline()> task;
+		int priority;
+		uint64_t sequence;
+
+		bool operator<(const QueuedBuild& other) const
+		{
+			if (priority != other.priority)
+			{
+				return priority < other.priority;
+			}
+
+			return sequence > other.sequence;
+		}
+	};
+
+	void StartWorkers()
+	{
+		// The main thread keeps loading (or drawing) while pipelines compile.
+		auto threadCount = WorkerThreadCount();
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			m_workers.emplace_back([this]() { WorkerLoop(); });
+		}
+	}
+
+	void WorkerLoop()
+	{
+		while (true)
+		{
+			std::packaged_task<VkPipeline()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_workAvailable.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+
+				if (m_stopping)
+				{
+					return;
+				}
+
+				task = std::move(m_queue.top().task);
+				m_queue.pop();
+			}
+
+			// Exceptions end up in the future.
+			task();
+		}
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_workAvailable;
+	std::priority_queue<QueuedBuild> m_queue;
+	std::vector<std::thread> m_workers;
+	uint64_t m_sequence = 0;
+	bool m_stopping = false;
+};
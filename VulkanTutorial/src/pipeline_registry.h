@@ -0,0 +1,821 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#endif
+
+#include <vulkan/vulkan.h>
+
+#include "mapped_file.h"
+#include "pipeline_cache.h"
+#include "pipeline_queue.h"
+#include "vulkan_helper.h"
+#include "vulkan_manager.h"
+
+// Everything that makes one graphics pipeline different from another. Defaults are an opaque,
+// depth tested triangle list. Viewport and scissor are always dynamic, set when recording.
+struct GraphicsPipelineDesc
+{
+	// Shaders
+	// Hashed by content, the code is only read when the pipeline has to be created.
+	ByteSpan vertexShader;
+	ByteSpan fragmentShader;
+	const VkSpecializationInfo* fragmentSpecialization = nullptr;	// e.g. MaterialPermutation::SpecializationInfo
+
+	// Vertex layout
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// Raster
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	// Depth
+	VkBool32 depthTest = VK_TRUE;
+	VkBool32 depthWrite = VK_TRUE;
+	VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+
+	// Blend, one color attachment
+	VkBool32 blend = VK_FALSE;
+	VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+	VkBlendFactor srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp alphaBlendOp = VK_BLEND_OP_ADD;
+
+	// MSAA
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Where it's used. Both come from VulkanObjectCache, so equal layouts and passes are equal handles.
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+
+	// Without a render pass (dynamic rendering) the pipeline declares its attachment formats instead.
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+};
+
+// Graphics pipelines keyed by their GraphicsPipelineDesc. Nothing is created until the first request, and
+// every request for the same description gets the same VkPipeline, so identical states asked for by
+// different code end up as one pipeline. Safe to call from several threads (e.g. PipelineQueue's),
+// a request for a pipeline another thread is still creating waits for that one instead of creating it twice.
+// The registry owns the pipelines, every GetGraphicsPipeline is paired with a Release.
+//
+// With VK_EXT_graphics_pipeline_library a pipeline is linked from four parts (vertex input, pre-rasterization,
+// fragment shader and fragment output), each compiled once and shared by every pipeline that has the same
+// state for it. Linking is fast, an optimized link of the same parts is then made on PipelineQueue's threads
+// and takes over through Resolve. Without the extension pipelines are created whole.
+class PipelineRegistry
+{
+	static inline PipelineRegistry* s_registry;
+
+public:
+	static PipelineRegistry& Get()
+	{
+		if (!s_registry)
+		{
+			s_registry = new PipelineRegistry();
+		}
+
+		return *s_registry;
+	}
+
+	// Throws if the pipeline can't be created.
+	VkPipeline GetGraphicsPipeline(const GraphicsPipelineDesc& desc)
+	{
+		auto key = MakeKey(desc);
+
+		std::promise<VkPipeline> promise;
+		std::shared_future<VkPipeline> pipeline;
+		bool create = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			auto [it, inserted] = m_pipelines.try_emplace(key);
+			if (inserted)
+			{
+				it->second.pipeline = promise.get_future().share();
+				create = true;
+			}
+
+			// Counted before it exists, a Release from elsewhere can't destroy it under us.
+			++it->second.references;
+			pipeline = it->second.pipeline;
+		}
+
+		if (!create)
+		{
+			return pipeline.get();
+		}
+
+		// Outside the lock, other threads can create other pipelines meanwhile.
+		try
+		{
+			std::vector<std::shared_ptr<PipelineLibrary>> libraries;
+			auto created = VulkanManager::GetVulkanManager().SupportsGraphicsPipelineLibrary() ? LinkGraphicsPipeline(desc, libraries) : CreateGraphicsPipeline(desc);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_keys.emplace(created, key);
+
+				auto& entry = m_pipelines.at(key);
+				entry.linked = created;
+				entry.libraries = libraries;
+				if (!libraries.empty())
+				{
+					entry.optimization = std::make_shared<Optimization>();
+					OptimizeInBackground(key, desc.layout, libraries, entry.optimization);
+				}
+			}
+			promise.set_value(created);
+
+			return created;
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_pipelines.erase(key);
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+	}
+
+	// The pipeline to bind for one GetGraphicsPipeline returned. That's the optimized link once it's done,
+	// until then (and without pipeline libraries) the pipeline itself. Both stay valid until it's released.
+	VkPipeline Resolve(VkPipeline pipeline)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto key = m_keys.find(pipeline);
+		if (key == m_keys.end())
+		{
+			return pipeline;
+		}
+
+		auto optimized = m_pipelines.at(key->second).optimized;
+		return optimized != VK_NULL_HANDLE ? optimized : pipeline;
+	}
+
+	// Goes up every time Resolve starts returning an optimized pipeline, anything recorded with
+	// resolved pipelines should be recorded again when it changes.
+	uint64_t Generation() const { return m_generation; }
+
+	// The pipeline is destroyed once every request for it has been released.
+	// The GPU has to be done with it by then, it's not deferred.
+	void Release(VkPipeline pipeline)
+	{
+		if (pipeline == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		Entry released;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			auto key = m_keys.find(pipeline);
+			if (key == m_keys.end())
+			{
+				throw std::runtime_error("Released a pipeline that isn't in the registry");
+			}
+
+			auto entry = m_pipelines.find(key->second);
+			if (--entry->second.references > 0)
+			{
+				return;
+			}
+
+			released = std::move(entry->second);
+			m_pipelines.erase(entry);
+			m_keys.erase(key);
+		}
+
+		// The optimized link uses the layout, which the caller is free to destroy once this returns.
+		// Waits if it's running right now, one still queued is skipped.
+		if (released.optimization)
+		{
+			std::lock_guard<std::mutex> lock(released.optimization->mutex);
+			released.optimization->cancelled = true;
+		}
+
+		// Libraries go with the last pipeline (or background link) that uses them.
+		DestroyPipelines(released);
+	}
+
+	// Number of distinct pipelines.
+	size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_keys.size();
+	}
+
+	// Has to run before the device is destroyed, after anything using the pipelines is gone
+	// and after PipelineQueue::Shutdown, so no optimized link is still running.
+	void Destroy()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto& [key, entry] : m_pipelines)
+		{
+			DestroyPipelines(entry);
+		}
+
+		m_keys.clear();
+		m_pipelines.clear();
+		m_libraries.clear();
+	}
+
+private:
+	// The description flattened field by field, same idea as VulkanObjectCache's keys.
+	struct Key
+	{
+		std::string bytes;
+
+		template<typename T>
+		void Add(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be part of a key");
+			bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		// Shader code (and specialization data) goes in as a hash, not byte by byte.
+		void AddCode(ByteSpan code)
+		{
+			Add(code.size);
+			Add(XXH3_64bits(code.data, code.size));
+		}
+
+		bool operator==(const Key& other) const { return bytes == other.bytes; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			return static_cast<size_t>(XXH3_64bits(key.bytes.data(), key.bytes.size()));
+		}
+	};
+
+	// One part of a pipeline made with VK_PIPELINE_CREATE_LIBRARY_BIT_KHR.
+	struct PipelineLibrary
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		~PipelineLibrary()
+		{
+			vkDestroyPipeline(VulkanManager::GetVulkanManager().GetDevice(), pipeline, nullptr);
+		}
+	};
+
+	// Shared by an entry and its optimized link.
+	struct Optimization
+	{
+		std::mutex mutex;		// Held while the link runs.
+		bool cancelled = false;	// Released before the link started.
+	};
+
+	struct Entry
+	{
+		std::shared_future<VkPipeline> pipeline;
+		uint32_t references = 0;
+
+		// Set once it's created. linked is what GetGraphicsPipeline returned, optimized replaces it in Resolve.
+		VkPipeline linked = VK_NULL_HANDLE;
+		VkPipeline optimized = VK_NULL_HANDLE;
+		std::vector<std::shared_ptr<PipelineLibrary>> libraries;	// Empty without pipeline libraries.
+		std::shared_ptr<Optimization> optimization;
+	};
+
+	static void DestroyPipelines(const Entry& entry)
+	{
+		auto device = VulkanManager::GetVulkanManager().GetDevice();
+		vkDestroyPipeline(device, entry.linked, nullptr);
+		vkDestroyPipeline(device, entry.optimized, nullptr);
+	}
+
+	// What each pipeline library part is made from. A full key is all four, so two descriptions
+	// that only differ in e.g. blending share their vertex input, pre-rasterization and fragment shader parts.
+	static void AddVertexInput(Key& key, const GraphicsPipelineDesc& desc)
+	{
+		key.Add(desc.vertexBindings.size());
+		for (const auto& binding : desc.vertexBindings)
+		{
+			key.Add(binding.binding);
+			key.Add(binding.stride);
+			key.Add(binding.inputRate);
+		}
+
+		key.Add(desc.vertexAttributes.size());
+		for (const auto& attribute : desc.vertexAttributes)
+		{
+			key.Add(attribute.location);
+			key.Add(attribute.binding);
+			key.Add(attribute.format);
+			key.Add(attribute.offset);
+		}
+
+		key.Add(desc.topology);
+	}
+
+	static void AddPreRasterization(Key& key, const GraphicsPipelineDesc& desc)
+	{
+		key.AddCode(desc.vertexShader);
+		key.Add(desc.polygonMode);
+		key.Add(desc.cullMode);
+		key.Add(desc.frontFace);
+		key.Add(desc.layout);
+		key.Add(desc.renderPass);
+		key.Add(desc.subpass);
+	}
+
+	static void AddFragmentShader(Key& key, const GraphicsPipelineDesc& desc)
+	{
+		key.AddCode(desc.fragmentShader);
+
+		key.Add(desc.fragmentSpecialization != nullptr);
+		if (desc.fragmentSpecialization)
+		{
+			const auto& specialization = *desc.fragmentSpecialization;
+			key.Add(specialization.mapEntryCount);
+			for (uint32_t i = 0; i < specialization.mapEntryCount; ++i)
+			{
+				key.Add(specialization.pMapEntries[i].constantID);
+				key.Add(specialization.pMapEntries[i].offset);
+				key.Add(specialization.pMapEntries[i].size);
+			}
+			key.AddCode(ByteSpan(static_cast<const char*>(specialization.pData), specialization.dataSize));
+		}
+
+		key.Add(desc.depthTest);
+		key.Add(desc.depthWrite);
+		key.Add(desc.depthCompare);
+		key.Add(desc.samples);
+		key.Add(desc.layout);
+		key.Add(desc.renderPass);
+		key.Add(desc.subpass);
+	}
+
+	static void AddFragmentOutput(Key& key, const GraphicsPipelineDesc& desc)
+	{
+		key.Add(desc.blend);
+		key.Add(desc.srcColorBlendFactor);
+		key.Add(desc.dstColorBlendFactor);
+		key.Add(desc.colorBlendOp);
+		key.Add(desc.srcAlphaBlendFactor);
+		key.Add(desc.dstAlphaBlendFactor);
+		key.Add(desc.alphaBlendOp);
+		key.Add(desc.samples);
+		key.Add(desc.renderPass);
+		key.Add(desc.subpass);
+		key.Add(desc.colorFormat);
+		key.Add(desc.depthFormat);
+	}
+
+	static Key MakeKey(const GraphicsPipelineDesc& desc)
+	{
+		Key key;
+		AddVertexInput(key, desc);
+		AddPreRasterization(key, desc);
+		AddFragmentShader(key, desc);
+		AddFragmentOutput(key, desc);
+
+		return key;
+	}
+
+	// Every create info a GraphicsPipelineDesc turns into, shared by the monolithic path and the library parts.
+	// The structs point at each other and into the desc, so it's never copied and can't outlive the desc.
+	struct PipelineState
+	{
+		explicit PipelineState(const GraphicsPipelineDesc& desc)
+		{
+			// Describe the vertex data being passed to the shader
+			// Bindings - spacing between data and whether the data is per vertex or per instance
+			// Attributes - the type of data being passed in and how to load them
+			{
+				vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+				vertexInput.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+				vertexInput.pVertexBindingDescriptions = desc.vertexBindings.data();
+				vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+				vertexInput.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+			}
+
+			// Input assembly
+			{
+				inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+				inputAssembly.topology = desc.topology;
+				inputAssembly.primitiveRestartEnable = VK_FALSE;
+			}
+
+			// Viewports and scissors
+			// Both are dynamic and set from the swap chain extent when the command buffers are recorded,
+			// so the pipeline doesn't depend on the window size and survives a resize.
+			{
+				viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+				viewport.viewportCount = 1;
+				viewport.scissorCount = 1;
+			}
+
+			// Rasterizer
+			{
+				rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+				rasterizer.depthClampEnable = VK_FALSE;
+				rasterizer.rasterizerDiscardEnable = VK_FALSE;	// Setting to true results in geometry never going to the fragment shader
+				rasterizer.polygonMode = desc.polygonMode;		// How fragments are generated for geometry
+				rasterizer.lineWidth = 1.0f;
+				rasterizer.cullMode = desc.cullMode;
+				rasterizer.frontFace = desc.frontFace;			// Vertex order to be considered front facing
+				rasterizer.depthBiasEnable = VK_FALSE;
+			}
+
+			// Multisampling (AA)
+			{
+				multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+				multisampling.sampleShadingEnable = VK_FALSE;
+				multisampling.rasterizationSamples = desc.samples;
+				multisampling.minSampleShading = 1.0f;
+			}
+
+			// Depth testing
+			{
+				depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+				depthStencil.depthTestEnable = desc.depthTest;
+				depthStencil.depthWriteEnable = desc.depthWrite;
+				depthStencil.depthCompareOp = desc.depthCompare;
+				depthStencil.depthBoundsTestEnable = VK_FALSE;
+				depthStencil.minDepthBounds = 0;
+				depthStencil.maxDepthBounds = 1;
+			}
+
+			// Color blending
+			// if (blend)
+			//		finalColor = (srcColorBlendFactor * newColor) <colorBlendOp> (dstColorBlendFactor * oldColor);
+			//		finalAlpha = (srcAlphaBlendFactor * newAlpha) <alphaBlendOp> (dstAlphaBlendFactor * oldAlpha)
+			// else
+			//		finalColor = newColor;
+			{
+				colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+				colorBlendAttachment.blendEnable = desc.blend;
+				colorBlendAttachment.srcColorBlendFactor = desc.srcColorBlendFactor;
+				colorBlendAttachment.dstColorBlendFactor = desc.dstColorBlendFactor;
+				colorBlendAttachment.colorBlendOp = desc.colorBlendOp;
+				colorBlendAttachment.srcAlphaBlendFactor = desc.srcAlphaBlendFactor;
+				colorBlendAttachment.dstAlphaBlendFactor = desc.dstAlphaBlendFactor;
+				colorBlendAttachment.alphaBlendOp = desc.alphaBlendOp;
+			}
+
+			{
+				colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+				colorBlending.logicOpEnable = VK_FALSE;
+				colorBlending.logicOp = VK_LOGIC_OP_COPY;
+				colorBlending.attachmentCount = 1;
+				colorBlending.pAttachments = &colorBlendAttachment;
+			}
+
+			// Dynamic state
+			{
+				dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+				dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+				dynamicState.pDynamicStates = dynamicStates.data();
+			}
+
+			// Without a render pass (dynamic rendering) the attachments are described here.
+			{
+				rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+				rendering.colorAttachmentCount = desc.colorFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+				rendering.pColorAttachmentFormats = &desc.colorFormat;
+				rendering.depthAttachmentFormat = desc.depthFormat;	// Nothing draws with stencil, it's never attached.
+			}
+
+			{
+				pipeline.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+				pipeline.pNext = desc.renderPass == VK_NULL_HANDLE ? &rendering : nullptr;
+				pipeline.layout = desc.layout;
+				pipeline.renderPass = desc.renderPass;
+				pipeline.subpass = desc.subpass;
+				pipeline.basePipelineHandle = VK_NULL_HANDLE;
+				pipeline.basePipelineIndex = -1;
+			}
+		}
+
+		PipelineState(const PipelineState&) = delete;
+		PipelineState& operator=(const PipelineState&) = delete;
+
+		VkPipelineVertexInputStateCreateInfo vertexInput{};
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+		VkPipelineViewportStateCreateInfo viewport{};
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		VkPipelineDepthStencilStateCreateInfo depthStencil{};
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		VkPipelineColorBlendStateCreateInfo colorBlending{};
+		std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		VkPipelineRenderingCreateInfoKHR rendering{};
+
+		// Everything but the stages and states, which depend on what's being created.
+		VkGraphicsPipelineCreateInfo pipeline{};
+	};
+
+	static VkPipelineShaderStageCreateInfo ShaderStage(VkShaderStageFlagBits stage, VkShaderModule module, const VkSpecializationInfo* specialization = nullptr)
+	{
+		VkPipelineShaderStageCreateInfo info{};
+		{
+			info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			info.stage = stage;
+			info.module = module;
+			info.pName = "main";						// Specify entry point function
+			info.pSpecializationInfo = specialization;	// Specify values for shader constants
+		}
+
+		return info;
+	}
+
+	// Not a VK_ASSERT, those compile out in release along with the call.
+	static VkPipeline CreatePipeline(const VkGraphicsPipelineCreateInfo& info, const char* error)
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		if (vkCreateGraphicsPipelines(VulkanManager::GetVulkanManager().GetDevice(), PipelineCache::Get().GetHandle(), 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error(error);
+		}
+
+		return pipeline;
+	}
+
+	// The whole pipeline in one go, without pipeline libraries.
+	static VkPipeline CreateGraphicsPipeline(const GraphicsPipelineDesc& desc)
+	{
+		auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+		// Modules are only needed while the pipeline is created.
+		auto vsModule = vkHelpers::CreateShaderModule(desc.vertexShader);
+		VkShaderModule fsModule = VK_NULL_HANDLE;
+		try
+		{
+			fsModule = vkHelpers::CreateShaderModule(desc.fragmentShader);
+		}
+		catch (...)
+		{
+			vkDestroyShaderModule(device, vsModule, nullptr);
+			throw;
+		}
+
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+			ShaderStage(VK_SHADER_STAGE_VERTEX_BIT, vsModule),
+			ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, fsModule, desc.fragmentSpecialization),
+		};
+
+		PipelineState state(desc);
+		auto& pipelineInfo = state.pipeline;
+		{
+			pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+			pipelineInfo.pStages = shaderStages.data();
+			pipelineInfo.pVertexInputState = &state.vertexInput;
+			pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+			pipelineInfo.pViewportState = &state.viewport;
+			pipelineInfo.pRasterizationState = &state.rasterizer;
+			pipelineInfo.pMultisampleState = &state.multisampling;
+			pipelineInfo.pDepthStencilState = &state.depthStencil;
+			pipelineInfo.pColorBlendState = &state.colorBlending;
+			pipelineInfo.pDynamicState = &state.dynamicState;
+		}
+
+		try
+		{
+			auto pipeline = CreatePipeline(pipelineInfo, "Failed to create a graphics pipeline");
+
+			vkDestroyShaderModule(device, vsModule, nullptr);
+			vkDestroyShaderModule(device, fsModule, nullptr);
+
+			return pipeline;
+		}
+		catch (...)
+		{
+			vkDestroyShaderModule(device, vsModule, nullptr);
+			vkDestroyShaderModule(device, fsModule, nullptr);
+			throw;
+		}
+	}
+
+	// Fast link of the four parts, creating whichever of them nobody has yet. The parts are handed back
+	// so the optimized link can use them too.
+	VkPipeline LinkGraphicsPipeline(const GraphicsPipelineDesc& desc, std::vector<std::shared_ptr<PipelineLibrary>>& libraries)
+	{
+		const PipelineState state(desc);
+
+		libraries = {
+			GetLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, desc, state),
+			GetLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, desc, state),
+			GetLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, desc, state),
+			GetLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, desc, state),
+		};
+
+		return Link(libraries, desc.layout, 0);
+	}
+
+	static VkPipeline Link(const std::vector<std::shared_ptr<PipelineLibrary>>& libraries, VkPipelineLayout layout, VkPipelineCreateFlags flags)
+	{
+		std::array<VkPipeline, 4> handles{};
+		for (size_t i = 0; i < libraries.size(); ++i)
+		{
+			handles[i] = libraries[i]->pipeline;
+		}
+
+		VkPipelineLibraryCreateInfoKHR libraryInfo{};
+		{
+			libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+			libraryInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+			libraryInfo.pLibraries = handles.data();
+		}
+
+		// Every state comes from the libraries.
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		{
+			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			pipelineInfo.pNext = &libraryInfo;
+			pipelineInfo.flags = flags;
+			pipelineInfo.layout = layout;
+			pipelineInfo.basePipelineIndex = -1;
+		}
+
+		return CreatePipeline(pipelineInfo, "Failed to link a graphics pipeline");
+	}
+
+	// Shared with every other pipeline that has the same state for this part, created if nobody has it.
+	// Two threads asking for the same new part at once both compile it and one copy is dropped.
+	std::shared_ptr<PipelineLibrary> GetLibrary(VkGraphicsPipelineLibraryFlagsEXT part, const GraphicsPipelineDesc& desc, const PipelineState& state)
+	{
+		Key key;
+		key.Add(part);
+		switch (part)
+		{
+		case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+			AddVertexInput(key, desc);
+			break;
+		case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+			AddPreRasterization(key, desc);
+			break;
+		case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+			AddFragmentShader(key, desc);
+			break;
+		default:
+			AddFragmentOutput(key, desc);
+			break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			auto cached = m_libraries.find(key);
+			if (cached != m_libraries.end())
+			{
+				if (auto library = cached->second.lock())
+				{
+					return library;
+				}
+
+				m_libraries.erase(cached);
+			}
+		}
+
+		auto library = std::make_shared<PipelineLibrary>();
+		library->pipeline = CreateLibrary(part, desc, state);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto& cached = m_libraries[key];
+		if (auto existing = cached.lock())
+		{
+			return existing;
+		}
+
+		cached = library;
+		return library;
+	}
+
+	static VkPipeline CreateLibrary(VkGraphicsPipelineLibraryFlagsEXT part, const GraphicsPipelineDesc& desc, const PipelineState& state)
+	{
+		auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+		{
+			libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+			libraryInfo.pNext = state.pipeline.pNext;
+			libraryInfo.flags = part;
+		}
+
+		// Kept for the optimized link, see OptimizeInBackground.
+		auto pipelineInfo = state.pipeline;
+		{
+			pipelineInfo.pNext = &libraryInfo;
+			pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		}
+
+		// Only the shader parts have a module, it's only needed while the library is created.
+		VkShaderModule module = VK_NULL_HANDLE;
+		VkPipelineShaderStageCreateInfo stage{};
+
+		switch (part)
+		{
+		case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+			pipelineInfo.pVertexInputState = &state.vertexInput;
+			pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+			break;
+		case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+			module = vkHelpers::CreateShaderModule(desc.vertexShader);
+			stage = ShaderStage(VK_SHADER_STAGE_VERTEX_BIT, module);
+			pipelineInfo.stageCount = 1;
+			pipelineInfo.pStages = &stage;
+			pipelineInfo.pViewportState = &state.viewport;
+			pipelineInfo.pRasterizationState = &state.rasterizer;
+			pipelineInfo.pDynamicState = &state.dynamicState;
+			break;
+		case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+			module = vkHelpers::CreateShaderModule(desc.fragmentShader);
+			stage = ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, module, desc.fragmentSpecialization);
+			pipelineInfo.stageCount = 1;
+			pipelineInfo.pStages = &stage;
+			pipelineInfo.pMultisampleState = &state.multisampling;
+			pipelineInfo.pDepthStencilState = &state.depthStencil;
+			break;
+		default:
+			pipelineInfo.pMultisampleState = &state.multisampling;
+			pipelineInfo.pColorBlendState = &state.colorBlending;
+			break;
+		}
+
+		// Only the shader parts use the layout.
+		if (module == VK_NULL_HANDLE)
+		{
+			pipelineInfo.layout = VK_NULL_HANDLE;
+		}
+
+		try
+		{
+			auto library = CreatePipeline(pipelineInfo, "Failed to create a graphics pipeline library");
+			vkDestroyShaderModule(device, module, nullptr);
+			return library;
+		}
+		catch (...)
+		{
+			vkDestroyShaderModule(device, module, nullptr);
+			throw;
+		}
+	}
+
+	// Never waited for, skipped if the pipeline is released before it starts. If the link fails the
+	// fast linked pipeline simply stays.
+	void OptimizeInBackground(const Key& key, VkPipelineLayout layout, std::vector<std::shared_ptr<PipelineLibrary>> libraries, std::shared_ptr<Optimization> optimization)
+	{
+		PipelineQueue::Get().Submit([this, key, layout, libraries = std::move(libraries), optimization = std::move(optimization)]()
+		{
+			std::lock_guard<std::mutex> linking(optimization->mutex);
+			if (optimization->cancelled)
+			{
+				return VkPipeline(VK_NULL_HANDLE);
+			}
+
+			auto optimized = Link(libraries, layout, VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				auto entry = m_pipelines.find(key);
+				if (entry != m_pipelines.end() && entry->second.linked != VK_NULL_HANDLE && entry->second.optimized == VK_NULL_HANDLE)
+				{
+					entry->second.optimized = optimized;
+					++m_generation;
+					return optimized;
+				}
+			}
+
+			vkDestroyPipeline(VulkanManager::GetVulkanManager().GetDevice(), optimized, nullptr);
+			return VkPipeline(VK_NULL_HANDLE);
+		}, PIPELINE_PRIORITY_BACKGROUND);
+	}
+
+	std::mutex m_mutex;
+	std::unordered_map<Key, Entry, KeyHash> m_pipelines;
+	std::unordered_map<VkPipeline, Key> m_keys;		// Created pipelines, for Release.
+	std::unordered_map<Key, std::weak_ptr<PipelineLibrary>, KeyHash> m_libraries;	// Alive as long as a pipeline uses them.
+	std::atomic<uint64_t> m_generation = 0;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "asset_cache.h"
+
+// Which pipeline variants a run actually drew with, read back by the next run so it can compile them
+// before anything asks for them. T identifies a variant (e.g. MaterialPermutation) and is written as raw bytes,
+// a log from a build where T looked different is dropped by its record size.
+template<typename T>
+class PipelineUsageLog
+{
+	static_assert(std::is_trivially_copyable_v<T>, "Records are written as raw bytes");
+
+public:
+	// A missing or unreadable log is an empty one, it's started over on the first Record.
+	void Open(const std::string& path)
+	{
+		m_path = path;
+		m_entries.clear();
+		m_fileValid = false;
+
+		std::ifstream file(path, std::ios::binary);
+
+		FileHeader header{};
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			header.magic != FILE_MAGIC ||
+			header.version != FILE_VERSION ||
+			header.recordSize != sizeof(T))
+		{
+			return;
+		}
+
+		T entry;
+		while (file.read(reinterpret_cast<char*>(&entry), sizeof(T)))
+		{
+			if (!Contains(entry))
+			{
+				m_entries.push_back(entry);
+			}
+		}
+
+		// A run that stopped halfway through an append leaves part of a record at the end. Appending after it
+		// would misalign everything that follows, so the complete entries are written out again instead.
+		m_fileValid = file.gcount() == 0;
+	}
+
+	// Everything earlier runs recorded, oldest first.
+	const std::vector<T>& Entries() const { return m_entries; }
+
+	// Appended right away so a run that doesn't exit cleanly still counts. Anything already logged is skipped.
+	// A failed write only costs the next launch its precompile.
+	void Record(const T& entry)
+	{
+		if (m_path.empty() || Contains(entry))
+		{
+			return;
+		}
+
+		m_entries.push_back(entry);
+
+		if (m_fileValid)
+		{
+			std::ofstream file(m_path, std::ios::binary | std::ios::app);
+			file.write(reinterpret_cast<const char*>(&entry), sizeof(T));
+			m_fileValid = file.good();
+			return;
+		}
+
+		FileHeader header;
+		{
+			header.magic = FILE_MAGIC;
+			header.version = FILE_VERSION;
+			header.recordSize = sizeof(T);
+		}
+
+		// Replaced as a whole, an interrupted rewrite leaves the old log rather than a broken one.
+		m_fileValid = WriteFileAtomically(m_path, {
+			ByteSpan(reinterpret_cast<const char*>(&header), sizeof(header)),
+			ByteSpan(reinterpret_cast<const char*>(m_entries.data()), m_entries.size() * sizeof(T)) });
+	}
+
+private:
+	static const uint32_t FILE_MAGIC = 0x474F4C50;	// "PLOG"
+	static const uint32_t FILE_VERSION = 1;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t recordSize;
+	};
+
+	bool Contains(const T& entry) const
+	{
+		return std::find(m_entries.begin(), m_entries.end(), entry) != m_entries.end();
+	}
+
+	std::string m_path;
+	std::vector<T> m_entries;
+	bool m_fileValid = false;	// The file on disk has a current header and every entry, Record can append.
+};
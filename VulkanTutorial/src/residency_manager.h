@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "asset_cache.h"
+#include "constants.h"
+#include "vulkan_manager.h"
+
+using ResidencyId = uint32_t;
+
+// How the residency manager takes memory from a resource and gives it back.
+// Any of them can be left empty if the resource doesn't support it.
+struct ResidencyCallbacks
+{
+	// Drops some detail (e.g. the top mip) and returns the bytes still resident.
+	// Returning the same size means there's nothing left to drop.
+	std::function<VkDeviceSize()> trim;
+
+	// Frees everything. Only resources that weren't used last frame are evicted.
+	std::function<void()> evict;
+
+	// Brings the resource back to full detail and returns its size. Returns nothing if it's still
+	// streaming in, the owner calls Restored once it's there. Evicted resources have to come back right away.
+	std::function<std::optional<VkDeviceSize>()> restore;
+};
+
+// Keeps textures and meshes under a device memory budget. Resources are touched every frame they're used,
+// and when the total is over budget the least recently used ones are trimmed or evicted until it fits.
+// Touching a resource that lost detail brings it back once there's room for it again.
+// Only used from the main thread, between frames.
+class ResidencyManager
+{
+	static inline ResidencyManager* s_manager;
+
+public:
+	static ResidencyManager& Get()
+	{
+		if (!s_manager)
+		{
+			s_manager = new ResidencyManager();
+		}
+
+		return *s_manager;
+	}
+
+	ResidencyId Register(const std::string& name, VkDeviceSize size, ResidencyCallbacks callbacks)
+	{
+		Resource resource;
+		{
+			resource.name = name;
+			resource.size = size;
+			resource.fullSize = size;
+			resource.lastUsedFrame = m_frame;
+			resource.callbacks = std::move(callbacks);
+		}
+
+		m_resident += size;
+		m_resources.emplace(m_nextId, std::move(resource));
+
+		return m_nextId++;
+	}
+
+	void Unregister(ResidencyId id)
+	{
+		auto it = m_resources.find(id);
+		if (it != m_resources.end())
+		{
+			m_resident -= it->second.size;
+			m_resources.erase(it);
+		}
+	}
+
+	// The resource is at full detail with this many bytes, after a restore that streamed in or a reload.
+	void Restored(ResidencyId id, VkDeviceSize size)
+	{
+		auto& resource = m_resources.at(id);
+
+		m_resident = m_resident - resource.size + size;
+		resource.size = size;
+		resource.fullSize = size;
+		resource.state = State::Full;
+		resource.restoring = false;
+	}
+
+	// A restore that was streaming in failed, the next touch tries again.
+	void RestoreFailed(ResidencyId id)
+	{
+		m_resources.at(id).restoring = false;
+	}
+
+	// Has to be called before recording anything that uses the resource.
+	// Evicted resources are restored right away, trimmed ones once full detail fits in the budget.
+	void Touch(ResidencyId id)
+	{
+		auto& resource = m_resources.at(id);
+		resource.lastUsedFrame = m_frame;
+
+		if (resource.state == State::Full || resource.restoring || !resource.callbacks.restore)
+		{
+			return;
+		}
+
+		// Otherwise it would be trimmed again on the next update and come right back after.
+		if (resource.state == State::Trimmed && m_resident - resource.size + resource.fullSize > Budget())
+		{
+			return;
+		}
+
+		resource.restoring = true;
+		if (auto size = resource.callbacks.restore())
+		{
+			Restored(id, *size);
+		}
+	}
+
+	// Once per frame, before anything is touched for it.
+	void Update()
+	{
+		++m_frame;
+
+		const auto budget = Budget();
+		if (m_resident <= budget)
+		{
+			m_warnedOverBudget = false;
+			return;
+		}
+
+		// Least recently used first.
+		std::vector<std::pair<ResidencyId, Resource*>> candidates;
+		for (auto& [id, resource] : m_resources)
+		{
+			if (resource.state != State::Evicted)
+			{
+				candidates.push_back({ id, &resource });
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b)
+		{
+			return a.second->lastUsedFrame < b.second->lastUsedFrame;
+		});
+
+		for (auto& [id, resource] : candidates)
+		{
+			// Drop detail one step at a time so nothing loses more than it has to.
+			while (m_resident > budget && resource->callbacks.trim)
+			{
+				auto size = resource->callbacks.trim();
+				if (size >= resource->size)
+				{
+					break;
+				}
+
+				m_resident = m_resident - resource->size + size;
+				resource->size = size;
+				resource->state = State::Trimmed;
+				resource->restoring = false;
+			}
+
+			// Evicting something that was just drawn would only bring it back next frame.
+			const bool usedLastFrame = resource->lastUsedFrame + 1 >= m_frame;
+			if (m_resident > budget && resource->callbacks.evict && !usedLastFrame)
+			{
+				resource->callbacks.evict();
+				m_evictions++;
+
+				m_resident -= resource->size;
+				resource->size = 0;
+				resource->state = State::Evicted;
+				resource->restoring = false;
+			}
+
+			if (m_resident <= budget)
+			{
+				return;
+			}
+		}
+
+		if (!m_warnedOverBudget)
+		{
+			std::cerr << "Resident assets need " << (m_resident >> 20) << " MB, over the budget of " << (budget >> 20) << " MB" << std::endl;
+			m_warnedOverBudget = true;
+		}
+	}
+
+	// Defaults to a share of the largest device local heap.
+	VkDeviceSize Budget()
+	{
+		if (m_budget == 0)
+		{
+			VkPhysicalDeviceMemoryProperties memoryProperties{};
+			vkGetPhysicalDeviceMemoryProperties(VulkanManager::GetVulkanManager().GetPhysicalDevice(), &memoryProperties);
+
+			VkDeviceSize deviceLocal = 0;
+			for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+			{
+				if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+				{
+					deviceLocal = std::max(deviceLocal, memoryProperties.memoryHeaps[i].size);
+				}
+			}
+
+			m_budget = static_cast<VkDeviceSize>(deviceLocal * RESIDENCY_BUDGET_FRACTION);
+		}
+
+		return m_budget;
+	}
+
+	void SetBudget(VkDeviceSize budget)
+	{
+		m_budget = budget;
+	}
+
+	VkDeviceSize ResidentSize() const
+	{
+		return m_resident;
+	}
+
+	// Resources evicted so far, for the stats UI.
+	uint32_t EvictionCount() const
+	{
+		return m_evictions;
+	}
+
+private:
+	enum class State
+	{
+		Full,
+		Trimmed,
+		Evicted,
+	};
+
+	struct Resource
+	{
+		std::string name;
+		VkDeviceSize size = 0;
+		VkDeviceSize fullSize = 0;
+		uint64_t lastUsedFrame = 0;
+		State state = State::Full;
+		bool restoring = false;
+		ResidencyCallbacks callbacks;
+	};
+
+	std::unordered_map<ResidencyId, Resource> m_resources;
+	ResidencyId m_nextId = 0;
+	uint64_t m_frame = 0;
+	VkDeviceSize m_budget = 0;
+	VkDeviceSize m_resident = 0;
+	uint32_t m_evictions = 0;
+	bool m_warnedOverBudget = false;
+};
+
+// Copies all but the top count mips into a new, smaller image, entirely on the GPU.
+// The source has to be in shader read layout and idle, it's back in that layout afterwards.
+static GpuTexture DropTopMips(const GpuTexture& texture, uint32_t count)
+{
+	auto& vkManager = VulkanManager::GetVulkanManager();
+	auto& commandPool = vkManager.GetCommandPool();
+
+	GpuTexture trimmed;
+	trimmed.format = texture.format;
+	trimmed.width = std::max(texture.width >> count, 1u);
+	trimmed.height = std::max(texture.height >> count, 1u);
+	trimmed.mipLevels = texture.mipLevels - count;
+	trimmed.layerCount = texture.layerCount;
+
+	// Can be trimmed again later.
+	vkManager.CreateImage(trimmed.width,
+		trimmed.height,
+		trimmed.mipLevels,
+		VK_SAMPLE_COUNT_1_BIT,
+		trimmed.format,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		trimmed.image.m_image, trimmed.image.m_memory,
+		trimmed.layerCount);
+
+	VkCommandBuffer commandBuffer = vkManager.BeginSingleTimeCommands(commandPool);
+
+	auto barrier = [](VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess, uint32_t mipLevels, uint32_t layerCount)
+	{
+		VkImageMemoryBarrier imageBarrier{};
+		{
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.oldLayout = oldLayout;
+			imageBarrier.newLayout = newLayout;
+			imageBarrier.srcAccessMask = srcAccess;
+			imageBarrier.dstAccessMask = dstAccess;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = image;
+			imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageBarrier.subresourceRange.baseMipLevel = 0;
+			imageBarrier.subresourceRange.levelCount = mipLevels;
+			imageBarrier.subresourceRange.baseArrayLayer = 0;
+			imageBarrier.subresourceRange.layerCount = layerCount;
+		}
+
+		return imageBarrier;
+	};
+
+	{
+		std::array<VkImageMemoryBarrier, 2> barriers = {
+			barrier(texture.image.m_image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT, texture.mipLevels, texture.layerCount),
+			barrier(trimmed.image.m_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, trimmed.mipLevels, trimmed.layerCount),
+		};
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+	}
+
+	// Level n of the new image is level n + count of the old one.
+	std::vector<VkImageCopy> regions(trimmed.mipLevels);
+	for (uint32_t level = 0; level < trimmed.mipLevels; ++level)
+	{
+		regions[level].srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[level].srcSubresource.mipLevel = level + count;
+		regions[level].srcSubresource.baseArrayLayer = 0;
+		regions[level].srcSubresource.layerCount = texture.layerCount;
+		regions[level].srcOffset = { 0, 0, 0 };
+		regions[level].dstSubresource = regions[level].srcSubresource;
+		regions[level].dstSubresource.mipLevel = level;
+		regions[level].dstOffset = { 0, 0, 0 };
+		regions[level].extent = { std::max(trimmed.width >> level, 1u), std::max(trimmed.height >> level, 1u), 1 };
+	}
+
+	vkCmdCopyImage(commandBuffer,
+		texture.image.m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		trimmed.image.m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(regions.size()), regions.data());
+
+	// The source may still be shared with something else that samples it.
+	{
+		std::array<VkImageMemoryBarrier, 2> barriers = {
+			barrier(texture.image.m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, texture.mipLevels, texture.layerCount),
+			barrier(trimmed.image.m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, trimmed.mipLevels, trimmed.layerCount),
+		};
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+	}
+
+	vkManager.EndSingleTimeCommands(commandBuffer, commandPool);
+
+	return trimmed;
+}
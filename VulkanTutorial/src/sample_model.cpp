@@ -1,77 +1,212 @@
 #include "sample_model.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
 
+#include "asset_archive.h"
+#include "asset_cache.h"
 #include "buffer.h"
 #include "helpers.h"
 #include "constants.h"
-#include "texture.h"
+#include "imgui_manager.h"
+#include "pipeline_cache.h"
+#include "pipeline_queue.h"
+#include "pipeline_registry.h"
+#include "shader_compiler.h"
+#include "texture_atlas.h"
+#include "texture_decoder.h"
 #include "vertex.h"
+#include "vulkan_object_cache.h"
 
-void SampleModel::Initialize()
+namespace
 {
-	CreateRenderPass();
-	CreateDescriptorSetLayout();
-	CreateGraphicsPipeline();
-	//CreateCommandPool();
-	
-	// Create multisampled color buffer
+	// Everything besides the source file that changes what ImportMesh produces.
+	struct MeshImportSettings
 	{
-		VkFormat colorFormat = VulkanManager::GetVulkanManager().GetSwapChainImageFormat();
+		uint32_t cookedVersion;
+		uint32_t vertexSize;
+		uint32_t lodCount;
+		float lodReduction;
+		uint32_t meshletMaxVertices;
+		uint32_t meshletMaxTriangles;
+	};
 
-		m_colorImage.CreateImage(
-			VulkanManager::GetVulkanManager().GetSwapChainExtent().width,
-			VulkanManager::GetVulkanManager().GetSwapChainExtent().height,
-			1,
-			VulkanManager::GetVulkanManager().GetMSAASamples(),
-			colorFormat,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	struct TextureImportSettings
+	{
+		uint32_t supportsBC;	// Decides what Basis Universal textures are transcoded to.
+	};
 
-		m_colorImage.CreateView(colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	AssetHash HashTexture(const std::string& path)
+	{
+		MappedAsset source(path);
+
+		TextureImportSettings settings{};
+		settings.supportsBC = VulkanManager::GetVulkanManager().SupportsTextureCompressionBC();
+
+		return HashAsset(source.Span(), settings);
 	}
-	
-	// Create depth buffer
+
+	void ImportMesh(Mesh& mesh)
 	{
-		VkFormat depthFormat = FindDepthFormat();
+		// Cooked meshes already have their LODs and meshlets.
+		if (auto cookedMesh = AssetArchive::Get().Find(MODEL_PATH))
+		{
+			mesh.LoadCooked(cookedMesh->data, cookedMesh->size);
+			return;
+		}
 
-		m_depthImage.CreateImage(
-			VulkanManager::GetVulkanManager().GetSwapChainExtent().width,
-			VulkanManager::GetVulkanManager().GetSwapChainExtent().height,
-			1,
-			VulkanManager::GetVulkanManager().GetMSAASamples(),
-			depthFormat,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		// Otherwise an earlier run may have processed the same file with the same settings already.
+		// Only the model file itself is hashed. .gltf keeps its buffers in separate files, so it's always processed.
+		std::string extension = MODEL_PATH.substr(MODEL_PATH.find_last_of('.') + 1);
+		const bool cacheable = extension != "gltf" && extension != "GLTF";
 
-		m_depthImage.CreateView(depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+		AssetHash hash;
+		if (cacheable)
+		{
+			MeshImportSettings settings{};
+			{
+				settings.cookedVersion = COOKED_MESH_VERSION;
+				settings.vertexSize = sizeof(Vertex);
+				settings.lodCount = MESH_LOD_COUNT;
+				settings.lodReduction = MESH_LOD_REDUCTION;
+				settings.meshletMaxVertices = MESHLET_MAX_VERTICES;
+				settings.meshletMaxTriangles = MESHLET_MAX_TRIANGLES;
+			}
+
+			MappedAsset source(MODEL_PATH);
+			hash = HashAsset(source.Span(), settings);
+
+			if (auto cachedMesh = AssetCache::Get().LoadDerived(hash, ".mesh"))
+			{
+				mesh.LoadCooked(cachedMesh->Data(), cachedMesh->Size());
+				return;
+			}
+		}
 
-		auto& commandPool = VulkanManager::GetVulkanManager().GetCommandPool();
-		VulkanManager::GetVulkanManager().TransitionImageLayout(commandPool, m_depthImage.m_image, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+		mesh.LoadModel(MODEL_PATH.c_str());
+		mesh.GenerateLods(MESH_LOD_COUNT, MESH_LOD_REDUCTION);
+		mesh.BuildMeshlets(MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+
+		if (cacheable)
+		{
+			AssetCache::Get().StoreDerived(hash, ".mesh", mesh.Serialize());
+		}
+	}
+
+	// GLSL sources, the AssetCooker packs each one compiled to SPIR-V under the same name.
+	const std::string VERTEX_SHADER = "vs.vert";
+	const std::string FRAGMENT_SHADER = "fs.frag";
+	const std::string CULL_SHADER = "cull.comp";
+
+	const std::array<std::string, 3> SHADER_SOURCES = { VERTEX_SHADER, FRAGMENT_SHADER, CULL_SHADER };
+
+	// Cooked SPIR-V if the archive has it, otherwise compiled from source. Compiling is skipped
+	// too if an earlier run already compiled the same source, see CompileShader. Either way it's
+	// read straight out of the mapping.
+	ShaderCode LoadShader(const std::string& shader)
+	{
+		if (auto cooked = AssetArchive::Get().Find(SHADER_DIRECTORY + shader))
+		{
+			return ShaderCode(*cooked);
+		}
+
+		return CompileShader(SHADER_DIRECTORY + shader);
+	}
+}
+
+void SampleModel::Initialize()
+{
+	// Images with the same content share one texture, it's only decoded if nobody has it uploaded yet.
+	m_textureHash = HashTexture(TEXTURE_PATH);
+	m_texture = AssetCache::Get().m_textures.Find(m_textureHash);
+	if (!m_texture)
+	{
+		// Decoding runs on the decoder's threads while the pipeline and mesh are set up.
+		m_textureRequest = TextureDecoder::Get().Submit(TEXTURE_PATH);
 	}
+
+	// What earlier runs drew with is compiled along with the first permutation.
+	m_pipelineUsage.Open(PIPELINE_USAGE_PATH);
+
+	CreateRenderPass();
+	CreateDescriptorSetLayout();
+	CreateGraphicsPipeline();
+	//CreateCommandPool();
 	
+	CreateAttachments();
 	CreateFrameBuffers();
+
+	ImportMesh(m_mesh);
+	m_transform = Transform(glm::vec3(0));
+
 	CreateTextureImage();
 	CreateTextureImageView();
 	CreateTextureSampler();
+	CreateTextureAtlas();
 
-	m_mesh.LoadModel(MODEL_PATH.c_str());
-	m_transform = Transform(glm::vec3(0));
+	m_meshletCulling = VulkanManager::GetVulkanManager().SupportsDrawIndirectCount() && !m_mesh.m_meshlets.empty();
+	if (m_meshletCulling)
+	{
+		CreateCullingPipeline();
+	}
 	
 	CreateBuffers();
-	CreateUniformBuffers();
-	CreateDescriptorPool();
-	CreateDescriptorSet();
-	CreateCommandBuffers();
+	CreateSwapChainImageResources();
+
+	RegisterResidency();
+
+	if (g_enableHotReload)
+	{
+		for (const auto& shader : SHADER_SOURCES)
+		{
+			m_fileWatcher.Watch(SHADER_DIRECTORY + shader);
+		}
+
+		m_fileWatcher.Watch(MODEL_PATH);
+		m_fileWatcher.Watch(TEXTURE_PATH);
+	}
 }
 
 void SampleModel::Reinitialize()
 {
-	CreateRenderPass();
-	CreateGraphicsPipeline();
-	
+	auto& vkManager = VulkanManager::GetVulkanManager();
+
+	// Viewport and scissor are dynamic, so a new extent only means new attachments and framebuffers
+	// (none with dynamic rendering). The render pass, or the formats the pipeline declares without one,
+	// only changes with the surface format.
+	if (vkManager.GetSwapChainImageFormat() != m_renderPassFormat)
+	{
+		DestroyGraphicsPipelines();
+
+		CreateRenderPass();
+		CreateGraphicsPipeline();
+	}
+
+	CreateAttachments();
+	CreateFrameBuffers();
+
+	// Uniform buffers, descriptor sets and command buffers are per swap chain image, they only need
+	// rebuilding if the driver handed back a different number of images.
+	if (vkManager.NumSwapChainImages() != m_uniformBuffers.size())
+	{
+		CleanupSwapChainImageResources();
+		CreateSwapChainImageResources();
+	}
+	else
+	{
+		// The framebuffers and extent are baked into the command buffers.
+		for (uint32_t i = 0; i < static_cast<uint32_t>(vkManager.GetCommandBuffers().size()); ++i)
+		{
+			RecordCommandBuffer(i);
+		}
+	}
+}
+
+void SampleModel::CreateAttachments()
+{
 	// Create multisampled color buffer
 	{
 		VkFormat colorFormat = VulkanManager::GetVulkanManager().GetSwapChainImageFormat();
@@ -108,26 +243,176 @@ void SampleModel::Reinitialize()
 		auto& commandPool = VulkanManager::GetVulkanManager().GetCommandPool();
 		VulkanManager::GetVulkanManager().TransitionImageLayout(commandPool, m_depthImage.m_image, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
 	}
+}
 
-	CreateFrameBuffers();
+void SampleModel::CreateSwapChainImageResources()
+{
 	CreateUniformBuffers();
+	CreateCullingBuffers();
 	CreateDescriptorPool();
 	CreateDescriptorSet();
 	CreateCommandBuffers();
 }
 
+void SampleModel::CleanupSwapChainImageResources()
+{
+	auto& vkManager = VulkanManager::GetVulkanManager();
+	auto& commandBuffers = vkManager.GetCommandBuffers();
+
+	if (commandBuffers.size() > 0)
+	{
+		vkFreeCommandBuffers(vkManager.GetDevice(), vkManager.GetCommandPool(), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	}
+
+	// CreateCommandBuffers sizes it to the new image count.
+	commandBuffers.clear();
+
+	for (auto& uniformBuffer : m_uniformBuffers)
+	{
+		vkDestroyBuffer(vkManager.GetDevice(), uniformBuffer.m_buffer, nullptr);
+		vkFreeMemory(vkManager.GetDevice(), uniformBuffer.m_memory, nullptr);
+	}
+
+	m_uniformBuffers.clear();
+
+	for (auto& buffer : m_drawCommandBuffers)
+	{
+		buffer.Destroy();
+	}
+
+	for (auto& buffer : m_drawCountBuffers)
+	{
+		buffer.Destroy();
+	}
+
+	m_drawCommandBuffers.clear();
+	m_drawCountBuffers.clear();
+
+	// Takes the descriptor sets with it.
+	vkDestroyDescriptorPool(vkManager.GetDevice(), m_descriptorPool, nullptr);
+}
+
 void SampleModel::SubmitDrawCall(uint32_t imageIndex, Camera& camera)
 {
+	// Brings back whatever was evicted or trimmed before anything gets bound.
+	ResidencyManager::Get().Touch(m_meshResidency);
+	ResidencyManager::Get().Touch(m_textureResidency);
+
 	UpdateUniformBuffers(imageIndex, camera);
+
+	// The fence for this image was already waited on, so the count from its last submission is ready.
+	if (m_recordedMeshletCulling[imageIndex])
+	{
+		m_drawCountBuffers[imageIndex].Read(&m_meshletsDrawn, sizeof(uint32_t));
+	}
+
+	// Pick the coarsest LOD whose simplification error stays below a pixel on screen.
+	{
+		glm::vec3 center = m_transform.matrix * glm::vec4(m_mesh.m_center, 1.0f);
+		float distance = glm::distance(camera.Eye(), center);
+		float viewportHeight = static_cast<float>(VulkanManager::GetVulkanManager().GetSwapChainExtent().height);
+
+		m_lod = m_mesh.SelectLod(distance, camera.FOV(), viewportHeight, MESH_LOD_PIXEL_ERROR);
+	}
+
+#if IMGUI_ENABLED
+	ImGui::Begin("Model");
+	ImGui::Text("LOD: %u / %u", m_lod, static_cast<uint32_t>(m_mesh.m_lods.size() - 1));
+	ImGui::Text("Triangles: %u", m_mesh.m_lods[m_lod].indexCount / 3);
+
+	if (!m_drawCountBuffers.empty())
+	{
+		ImGui::Separator();
+
+		bool changed = ImGui::Checkbox("Meshlet culling", &m_meshletCulling);
+		changed |= ImGui::Checkbox("Frustum", &m_frustumCulling);
+		changed |= ImGui::Checkbox("Backface cone", &m_coneCulling);
+
+		// Culling settings are baked into the command buffers.
+		if (changed)
+		{
+			std::fill(m_recordedLods.begin(), m_recordedLods.end(), UINT32_MAX);
+		}
+
+		auto meshletCount = static_cast<uint32_t>(m_mesh.m_meshlets.size());
+		if (m_recordedMeshletCulling[imageIndex])
+		{
+			ImGui::Text("Meshlets drawn: %u / %u", m_meshletsDrawn, meshletCount);
+			ImGui::Text("Meshlets culled: %u", meshletCount - m_meshletsDrawn);
+		}
+		else
+		{
+			ImGui::Text("Meshlets: %u (not culled)", meshletCount);
+		}
+	}
+
+	{
+		ImGui::Separator();
+
+		// Applied after the UI is drawn, the pipeline is only looked up (or created) when something changed.
+		auto permutation = m_permutation;
+		bool textured = permutation.textured;
+		bool vertexColor = permutation.vertexColor;
+		bool alphaTest = permutation.alphaTest;
+		int lightCount = static_cast<int>(permutation.lightCount);
+
+		bool changed = ImGui::Checkbox("Textured", &textured);
+		changed |= ImGui::Checkbox("Vertex color", &vertexColor);
+		changed |= ImGui::Checkbox("Alpha test", &alphaTest);
+		changed |= ImGui::SliderInt("Lights", &lightCount, 0, static_cast<int>(MATERIAL_MAX_LIGHTS));
+
+		if (changed)
+		{
+			permutation.textured = textured;
+			permutation.vertexColor = vertexColor;
+			permutation.alphaTest = alphaTest;
+			permutation.lightCount = static_cast<uint32_t>(lightCount);
+
+			SelectPermutation(permutation);
+		}
+
+		ImGui::Text("Permutations: %u (%u compiling)", static_cast<uint32_t>(m_permutationPipelines.size()), static_cast<uint32_t>(m_pendingPipelines.size()));
+		if (m_drawnPermutation != m_permutation)
+		{
+			ImGui::Text("Drawn with the fallback until it's compiled");
+		}
+		ImGui::Text("Pipelines: %u", static_cast<uint32_t>(PipelineRegistry::Get().Size()));
+	}
+
+	{
+		ImGui::Separator();
+
+		auto& residency = ResidencyManager::Get();
+
+		int budget = static_cast<int>(residency.Budget() >> 20);
+		if (ImGui::SliderInt("Budget (MB)", &budget, 1, 4096))
+		{
+			residency.SetBudget(static_cast<VkDeviceSize>(budget) << 20);
+		}
+
+		ImGui::Text("Resident: %.2f MB", residency.ResidentSize() / (1024.0 * 1024.0));
+		ImGui::Text("Evictions: %u", residency.EvictionCount());
+		ImGui::Text("Texture: %u x %u", m_texture->width, m_texture->height);
+		ImGui::Text("Atlas: %u x %u x %u", m_atlas.width, m_atlas.height, m_atlas.layerCount);
+	}
+
+	ImGui::End();
+#endif
+
+	// Command buffers are prerecorded, only this image's needs to change when the LOD does.
+	if (m_recordedLods[imageIndex] != m_lod)
+	{
+		RecordCommandBuffer(imageIndex);
+	}
 }
 
 void SampleModel::Cleanup(bool recreateSwapchain = false)
 {
-	auto& commandBuffers = VulkanManager::GetVulkanManager().GetCommandBuffers();
 	auto& commandPool = VulkanManager::GetVulkanManager().GetCommandPool();
 	
 	if (recreateSwapchain)
 	{
+		// Only what depends on the extent, everything else survives a resize. See Reinitialize.
 		m_colorImage.Cleanup();
 		m_depthImage.Cleanup();
 
@@ -135,43 +420,54 @@ void SampleModel::Cleanup(bool recreateSwapchain = false)
 		{
 			vkDestroyFramebuffer(VulkanManager::GetVulkanManager().GetDevice(), framebuffer, nullptr);
 		}
+	}
+	else
+	{
+		// Stops the decode threads and frees any staging buffers nobody picked up.
+		TextureDecoder::Get().Shutdown();
 
-		if (commandBuffers.size() > 0)
-			vkFreeCommandBuffers(VulkanManager::GetVulkanManager().GetDevice(), commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+		ResidencyManager::Get().Unregister(m_meshResidency);
+		ResidencyManager::Get().Unregister(m_textureResidency);
 
-		vkDestroyPipeline(VulkanManager::GetVulkanManager().GetDevice(), m_graphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(VulkanManager::GetVulkanManager().GetDevice(), m_pipelineLayout, nullptr);
-		vkDestroyRenderPass(VulkanManager::GetVulkanManager().GetDevice(), m_renderPass, nullptr);
+		CleanupSwapChainImageResources();
 
-		for (size_t i = 0; i < VulkanManager::GetVulkanManager().GetSwapChainImages().size(); ++i)
-		{
-			vkDestroyBuffer(VulkanManager::GetVulkanManager().GetDevice(), m_uniformBuffers[i].m_buffer, nullptr);
-			vkFreeMemory(VulkanManager::GetVulkanManager().GetDevice(), m_uniformBuffers[i].m_memory, nullptr);
-		}
+		// The layout and render pass belong to VulkanObjectCache.
+		DestroyGraphicsPipelines();
 
-		vkDestroyDescriptorPool(VulkanManager::GetVulkanManager().GetDevice(), m_descriptorPool, nullptr);
-	}
-	else
-	{
-		vkDestroySampler(VulkanManager::GetVulkanManager().GetDevice(), m_textureSampler, nullptr);
-		vkDestroyImageView(VulkanManager::GetVulkanManager().GetDevice(), m_texture.m_view, nullptr);
-		vkDestroyImage(VulkanManager::GetVulkanManager().GetDevice(), m_texture.m_image, nullptr);
-		vkFreeMemory(VulkanManager::GetVulkanManager().GetDevice(), m_texture.m_memory, nullptr);
+		// Destroyed once nothing else shares it.
+		m_texture.reset();
 
-		vkDestroyDescriptorSetLayout(VulkanManager::GetVulkanManager().GetDevice(), m_descriptorSetLayout, nullptr);
+		m_atlas.Destroy();
+		m_materialBuffer.Destroy();
 
-		vkDestroyBuffer(VulkanManager::GetVulkanManager().GetDevice(), m_vertexBuffer.m_buffer, nullptr);
-		vkFreeMemory(VulkanManager::GetVulkanManager().GetDevice(), m_vertexBuffer.m_memory, nullptr);
+		m_positionBuffer.Destroy();
+		m_attributeBuffer.Destroy();
 
 		vkDestroyBuffer(VulkanManager::GetVulkanManager().GetDevice(), m_indexBuffer.m_buffer, nullptr);
 		vkFreeMemory(VulkanManager::GetVulkanManager().GetDevice(), m_indexBuffer.m_memory, nullptr);
 
+		if (m_cullPipeline != VK_NULL_HANDLE)
+		{
+			m_meshletBuffer.Destroy();
+
+			vkDestroyPipeline(VulkanManager::GetVulkanManager().GetDevice(), m_cullPipeline, nullptr);
+		}
+
 		vkDestroyCommandPool(VulkanManager::GetVulkanManager().GetDevice(), commandPool, nullptr);
 	}
 }
 
 void SampleModel::CreateRenderPass()
 {
+	m_renderPassFormat = VulkanManager::GetVulkanManager().GetSwapChainImageFormat();
+
+	// The same attachments are described in BeginRendering instead.
+	if (VulkanManager::GetVulkanManager().UsesDynamicRendering())
+	{
+		m_renderPass = VK_NULL_HANDLE;
+		return;
+	}
+
 	VkAttachmentDescription colorAttachment{};
 	CreateAttachmentDescription(
 		colorAttachment,
@@ -273,365 +569,363 @@ void SampleModel::CreateRenderPass()
 		renderPassInfo.pDependencies = &dependency;
 	}
 
-	VK_ASSERT(vkCreateRenderPass(VulkanManager::GetVulkanManager().GetDevice(), &renderPassInfo, nullptr, &m_renderPass), "Failed to create render pass");
+	// Same attachments as last time (e.g. after a resize) means the same render pass.
+	m_renderPass = VulkanObjectCache::Get().GetRenderPass(renderPassInfo);
 }
 
 void SampleModel::CreateGraphicsPipeline()
 {
-	// Load shader code
-	auto vsCode = ReadFile(SHADER_DIRECTORY + "vert.spv");
-	auto fsCode = ReadFile(SHADER_DIRECTORY + "frag.spv");
+	// Builds already running read the current code and layout, the queued ones are dropped.
+	CancelPipelineBuilds();
 
-	// Create modules
-	auto vsModule = vkHelpers::CreateShaderModule(vsCode);
-	auto fsModule = vkHelpers::CreateShaderModule(fsCode);
+	// Load shader code, kept for every permutation built from it.
+	m_vertexCode = LoadShader(VERTEX_SHADER);
+	m_fragmentCode = LoadShader(FRAGMENT_SHADER);
 
-	// Create shader stages
-	VkPipelineShaderStageCreateInfo vsStageInfo{};
-	{
-		vsStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vsStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vsStageInfo.module = vsModule;
-		vsStageInfo.pName = "main";	// Specify entry point function
-		//vsStageInfo.pSpecializationInfo	// Specify values for shader constants
-	}
+	// The descriptor sets and push constants the shaders use, see CreateDescriptorSetLayout.
+	m_pipelineLayout = m_reflection.PipelineLayout();
 
-	VkPipelineShaderStageCreateInfo fsStageInfo{};
-	{
-		fsStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fsStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fsStageInfo.module = fsModule;
-		fsStageInfo.pName = "main";	// Specify entry point function
-		//fsStageInfo.pSpecializationInfo	// Specify values for shader constants
-	}
+	// The fallback is the only build anything waits for. A shader that doesn't compile fails here,
+	// not on a worker thread with the old pipelines already gone.
+	auto fallback = MaterialPermutation::Fallback();
+	m_permutationPipelines[fallback] = SubmitGraphicsPipeline(fallback, PIPELINE_PRIORITY_IMMEDIATE).get();
+	DrawPermutation(fallback);
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vsStageInfo, fsStageInfo };
+	// Only once the shaders are known to work, a broken one would fail every permutation.
+	SubmitPermutationBuilds();
+}
 
-	// Describe the vertex data being passed to the shader
-	// Bindings - spacing between data and whether the data is per vertex or per instance
-	auto bindingDescription = Vertex::GetBindingDescription();
-	// Attribute descriptions - the type of data being passed in and how to load them
-	auto attributeDescription = Vertex::GetAttributeDescriptions();
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	{
-		// We have no vertex data to pass to the shader so we don't really need to do anything else here.
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
-	}
-
-	// Input assembly
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	{
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
-	}
-
-	// Viewports
-	// Describe the region of the frame buffer to render to
-	VkViewport viewport{};
-	{
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)VulkanManager::GetVulkanManager().GetSwapChainExtent().width;
-		viewport.height = (float)VulkanManager::GetVulkanManager().GetSwapChainExtent().height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-	}
-
-	// Scissors
-	// Which regions pixels will be stored.
-	// The rasterizer will discard pixels that are outside the scissor.
-	VkRect2D scissor{};
-	{
-		scissor.offset = { 0, 0 };
-		scissor.extent = VulkanManager::GetVulkanManager().GetSwapChainExtent();
-	}
-
-	// Create the viewport
-	VkPipelineViewportStateCreateInfo viewportState{};
-	{
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
-	}
-
-	// Rasterizer
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	{
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;	// Setting to true results in geometry never going to the fragment shader
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;	// How fragments are generated for geometry
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_NONE;
-		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;	// Vertex order to be considered front facing
-		rasterizer.depthBiasEnable = VK_FALSE;
-		rasterizer.depthBiasConstantFactor = 0.0f;
-		rasterizer.depthBiasClamp = 0.0f;
-		rasterizer.depthBiasSlopeFactor = 0.0f;
-	}
-
-	// Multisampling (AA)
-	// Combines results of the fragment shader from multiple polygons that write to the same pixel.
-	// This only runs if *multiple* polygons are detected.
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	{
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VulkanManager::GetVulkanManager().GetMSAASamples();
-		multisampling.minSampleShading = 1.0f;
-		multisampling.pSampleMask = nullptr;
-		multisampling.alphaToCoverageEnable = VK_FALSE;
-		multisampling.alphaToOneEnable = VK_FALSE;
-	}
-
-	// Depth testing
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	{
-		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthStencil.depthTestEnable = VK_TRUE;
-		depthStencil.depthWriteEnable = VK_TRUE;
-		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-		depthStencil.depthBoundsTestEnable = VK_FALSE;
-		depthStencil.minDepthBounds = 0;
-		depthStencil.maxDepthBounds = 1;
-	}
-
-	// Color blending
-	// Describes how to blend results from the fragment shader of a pixel.
-	// VkPipelineColorBlendAttachmentState for the attached frame buffer
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	{
-		// The idea is:
-		// if(blendEnable)
-		// {
-		//		finalColor = (srcColorBlendFactor * newColor) <blend op> (dstColorBlendFactor * oldColor);
-		//		finalAlpha = (srcAlphaBlendFactor * newAlpha) <alpha blend op> (dstAlphaBlendFactor * oldAlpha)
-		// }
-		// else
-		// {
-		//		finalColor = newColor;	// just take the new color.
-		// }
-		// 
-		// finalColor = finalColor & colorWriteMask; // determine which channels get written to the buffer
-
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
-		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	}
-
-	// VkPipelineColorBlendStateCreateInfo for all frame buffers.
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	{
-		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlending.logicOpEnable = VK_FALSE;
-		colorBlending.logicOp = VK_LOGIC_OP_COPY;
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-		colorBlending.blendConstants[0] = 0.0f;
-		colorBlending.blendConstants[1] = 0.0f;
-		colorBlending.blendConstants[2] = 0.0f;
-		colorBlending.blendConstants[3] = 0.0f;
-	}
-
-	// Dynamic state
-	// Some states can be changed without recreating the pipeline (viewport, blending)
-	// We will need to specify these values at each draw call.
-	VkDynamicState dynamicStates[] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH,
-	};
+void SampleModel::SubmitPermutationBuilds()
+{
+	// Drawn with the fallback until it's compiled.
+	SelectPermutation(m_permutation);
 
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	{
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = 2;
-		dynamicState.pDynamicStates = dynamicStates;
-	}
+	// Equal priorities are built in submission order, so what earlier runs used comes before the rest.
+	PrecompileUsedPermutations();
 
-	// Describe the pipeline
-	// Specify which descriptor set the shaders are using.
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	if (g_prewarmPermutations)
 	{
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+		PrewarmPermutations();
 	}
+}
 
-	VK_ASSERT(vkCreatePipelineLayout(VulkanManager::GetVulkanManager().GetDevice(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout), "Failed to create pipeline layout");
-
-	// Create graphics pipeline
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
+std::shared_future<VkPipeline> SampleModel::SubmitGraphicsPipeline(const MaterialPermutation& permutation, int priority)
+{
+	return PipelineQueue::Get().Submit([this, permutation, cancelled = m_pipelineBuildsCancelled]()
 	{
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-
-		// Reference all the structures describing the fixed-function stage.
+		if (*cancelled)
 		{
-			pipelineInfo.pVertexInputState = &vertexInputInfo;
-			pipelineInfo.pInputAssemblyState = &inputAssembly;
-			pipelineInfo.pViewportState = &viewportState;
-			pipelineInfo.pRasterizationState = &rasterizer;
-			pipelineInfo.pMultisampleState = &multisampling;
-			pipelineInfo.pColorBlendState = &colorBlending;
+			return VkPipeline(VK_NULL_HANDLE);
 		}
 
-		pipelineInfo.layout = m_pipelineLayout;
+		return CreatePermutationPipeline(permutation);
+	}, priority);
+}
+
+void SampleModel::CancelPipelineBuilds()
+{
+	// Builds submitted from now on get a new flag.
+	*m_pipelineBuildsCancelled = true;
+	m_pipelineBuildsCancelled = std::make_shared<std::atomic<bool>>(false);
+
+	// The skipped ones are ready as soon as a worker pops them.
+	WaitForPipelineBuilds();
+}
 
-		// Reference render pass and the subpass of this graphics pipeline.
+void SampleModel::PrecompileUsedPermutations()
+{
+	for (const auto& permutation : m_pipelineUsage.Entries())
+	{
+		// Logged by a build whose shader took more lights.
+		if (permutation.lightCount > MATERIAL_MAX_LIGHTS)
 		{
-			pipelineInfo.renderPass = m_renderPass;
-			pipelineInfo.subpass = 0;
+			continue;
 		}
 
-		// Any render pass can be used with this pipeline as long as they are compatible with m_sampleModel.GetRenderPass().
-		// You can create a new pass by deriving from this pipeline.
+		if (!m_permutationPipelines.count(permutation) && !m_pendingPipelines.count(permutation))
 		{
-			pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-			pipelineInfo.basePipelineIndex = -1;
+			m_pendingPipelines.emplace(permutation, SubmitGraphicsPipeline(permutation, PIPELINE_PRIORITY_BACKGROUND));
 		}
-
-		pipelineInfo.pDepthStencilState = &depthStencil;
 	}
-
-	VK_ASSERT(vkCreateGraphicsPipelines(VulkanManager::GetVulkanManager().GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline), "Failed to create a graphics pipeline");
-
-	vkDestroyShaderModule(VulkanManager::GetVulkanManager().GetDevice(), vsModule, nullptr);
-	vkDestroyShaderModule(VulkanManager::GetVulkanManager().GetDevice(), fsModule, nullptr);
 }
 
-void SampleModel::CreateDescriptorSetLayout()
+void SampleModel::PrewarmPermutations()
 {
-	// Descriptors allow shaders to access buffers and images.
-	// Descriptor Layouts specify the type of resources being used by the shader.
-	// Descriptor Sets specify the buffer or image that get bound to the descriptor (frame buffers specify image views to render pass attachments)
-
-	VkDescriptorSetLayoutBinding uboLayoutBinding{};
-	{
-		uboLayoutBinding.binding = 0;											// Binding located in the shader
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;	// Type of descriptor
-		uboLayoutBinding.descriptorCount = 1;									// How many descriptors
-		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;				// Which stage to use the descriptor
-		uboLayoutBinding.pImmutableSamplers = nullptr;							// Image sampling descriptor
-	}
-
-	// We need to create a combined image sampler. This way teh shader can access the image through the sampler.
-	VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+	// Everything the Model window can select.
+	for (VkBool32 textured : { VK_TRUE, VK_FALSE })
 	{
-		samplerLayoutBinding.binding = 1;
-		samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		samplerLayoutBinding.descriptorCount = 1;
-		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;	// When do you want to use the image			
-		samplerLayoutBinding.pImmutableSamplers = nullptr;
-	}
-
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
-
-	VkDescriptorSetLayoutCreateInfo layoutInfo{};
-	{
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());;
-		layoutInfo.pBindings = bindings.data();
+		for (VkBool32 vertexColor : { VK_TRUE, VK_FALSE })
+		{
+			for (VkBool32 alphaTest : { VK_FALSE, VK_TRUE })
+			{
+				for (uint32_t lightCount = 0; lightCount <= MATERIAL_MAX_LIGHTS; ++lightCount)
+				{
+					MaterialPermutation permutation = m_permutation;
+					permutation.textured = textured;
+					permutation.vertexColor = vertexColor;
+					permutation.alphaTest = alphaTest;
+					permutation.lightCount = lightCount;
+
+					if (!m_permutationPipelines.count(permutation) && !m_pendingPipelines.count(permutation))
+					{
+						m_pendingPipelines.emplace(permutation, SubmitGraphicsPipeline(permutation, PIPELINE_PRIORITY_BACKGROUND));
+					}
+				}
+			}
+		}
 	}
-
-	VK_ASSERT(vkCreateDescriptorSetLayout(VulkanManager::GetVulkanManager().GetDevice(), &layoutInfo, nullptr, &m_descriptorSetLayout), "Failed to create descriptor set layout");
 }
 
-void SampleModel::CreateDescriptorSet()
+void SampleModel::CollectPipelineBuilds(bool wait)
 {
-	std::vector<VkDescriptorSetLayout> layouts(VulkanManager::GetVulkanManager().GetSwapChainImages().size(), GetDescriptorSetLayout());
-
-	VkDescriptorSetAllocateInfo allocInfo{};
-	{
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = GetDescriptorPool();
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(VulkanManager::GetVulkanManager().GetSwapChainImages().size());
-		allocInfo.pSetLayouts = layouts.data();
-	}
-
-	// Create one descriptor for each image in the swap chain.
-	m_descriptorSets.resize(VulkanManager::GetVulkanManager().GetSwapChainImages().size());
-
-	// Each descriptor set that gets allocated will also get a uniform buffer descriptor.
-	VK_ASSERT(vkAllocateDescriptorSets(VulkanManager::GetVulkanManager().GetDevice(), &allocInfo, m_descriptorSets.data()), "Failed to allocate descriptor sets");
-
-	// Configure descriptor sets.
-	for (size_t i = 0; i < VulkanManager::GetVulkanManager().NumSwapChainImages(); ++i)
+	for (auto it = m_pendingPipelines.begin(); it != m_pendingPipelines.end();)
 	{
-		// Specify which buffer we want the descriptor to refer to.
-		VkDescriptorBufferInfo bufferInfo{};
+		auto& [permutation, build] = *it;
+		if (!wait && build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
 		{
-			bufferInfo.buffer = m_uniformBuffers[i].m_buffer;
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
+			++it;
+			continue;
 		}
 
-		// Bind image and sampler
-		VkDescriptorImageInfo imageInfo{};
+		try
 		{
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.imageView = m_texture.m_view;
-			imageInfo.sampler = m_textureSampler;
+			auto pipeline = build.get();
+			if (pipeline == VK_NULL_HANDLE)
+			{
+				// Cancelled, whoever cancelled it submits it again if it's still wanted.
+				it = m_pendingPipelines.erase(it);
+				continue;
+			}
+
+			if (m_permutationPipelines.count(permutation))
+			{
+				// A second build of the same state, PipelineRegistry handed back the same pipeline with another reference.
+				PipelineRegistry::Get().Release(pipeline);
+			}
+			else
+			{
+				m_permutationPipelines[permutation] = pipeline;
+			}
+
+			// Replaces the fallback.
+			if (permutation == m_permutation && m_drawnPermutation != permutation)
+			{
+				DrawPermutation(permutation);
+			}
 		}
-
-		// Set up for update
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+		catch (const std::exception& e)
 		{
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = m_descriptorSets[i];
-			descriptorWrites[0].dstBinding = 0;										// Which slot the buffer is in the shader
-			descriptorWrites[0].dstArrayElement = 0;								// First index in array we're updating
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;	// Type of descriptor
-			descriptorWrites[0].descriptorCount = 1;								// How many array elements we're updating
-			descriptorWrites[0].pBufferInfo = &bufferInfo;							// What data is the descriptor referring to
-			descriptorWrites[0].pImageInfo = nullptr;								// What image is the descriptor referring to
-			descriptorWrites[0].pTexelBufferView = nullptr;							// What view is the descriptor referring to
+			std::cerr << "Failed to create the " << permutation.Name() << " pipeline: " << e.what() << std::endl;
 
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = m_descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;										// Which slot the buffer is in the shader
-			descriptorWrites[1].dstArrayElement = 0;								// First index in array we're updating
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;								// How many array elements we're updating
-			descriptorWrites[1].pBufferInfo = nullptr;								// What data is the descriptor referring to
-			descriptorWrites[1].pImageInfo = &imageInfo;							// What image is the descriptor referring to
-			descriptorWrites[1].pTexelBufferView = nullptr;							// What view is the descriptor referring to
+			// Whatever is on screen stays, the selection goes back to it.
+			if (permutation == m_permutation && !m_permutationPipelines.count(permutation))
+			{
+				m_permutation = m_drawnPermutation;
+			}
 		}
 
-		// Update the descriptor set
-		vkUpdateDescriptorSets(VulkanManager::GetVulkanManager().GetDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		it = m_pendingPipelines.erase(it);
 	}
-}
 
-void SampleModel::CreateDescriptorPool()
-{
-	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	// An optimized link of some pipeline finished, re-record so the drawn one is bound if it was that.
+	auto generation = PipelineRegistry::Get().Generation();
+	if (generation != m_pipelineGeneration)
 	{
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(VulkanManager::GetVulkanManager().GetSwapChainImages().size());
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(VulkanManager::GetVulkanManager().GetSwapChainImages().size());
+		m_pipelineGeneration = generation;
+		std::fill(m_recordedLods.begin(), m_recordedLods.end(), UINT32_MAX);
 	}
-
-	// Allocate one descriptor every frame.
-	VKCreateDescriptorPool(VulkanManager::GetVulkanManager().GetDevice(), &m_descriptorPool, poolSizes.data(), static_cast<uint32_t>(poolSizes.size()), static_cast<uint32_t>(VulkanManager::GetVulkanManager().NumSwapChainImages()));
 }
 
-void SampleModel::CreateCommandPool()
+VkPipeline SampleModel::CreatePermutationPipeline(const MaterialPermutation& permutation) const
+{
+	// The fragment shader's constants pick the material permutation.
+	auto specializationInfo = permutation.SpecializationInfo();
+
+	// Describe the vertex data being passed to the shader
+	// Bindings - spacing between data and whether the data is per vertex or per instance
+	// Attributes - the inputs the vertex shader declares, matched to the vertex streams by name
+	auto vertexInput = m_reflection.VertexInput(Vertex::GetStreamAttributes(), Vertex::GetBindingDescriptions());
+
+	// Everything else is the default opaque, depth tested state.
+	GraphicsPipelineDesc desc;
+	{
+		desc.vertexShader = m_vertexCode.Span();
+		desc.fragmentShader = m_fragmentCode.Span();
+		desc.fragmentSpecialization = &specializationInfo;
+		desc.vertexBindings = vertexInput.bindings;
+		desc.vertexAttributes = vertexInput.attributes;
+		desc.samples = VulkanManager::GetVulkanManager().GetMSAASamples();
+		desc.layout = m_pipelineLayout;
+		desc.renderPass = m_renderPass;
+		desc.colorFormat = VulkanManager::GetVulkanManager().GetSwapChainImageFormat();
+		desc.depthFormat = FindDepthFormat();
+	}
+
+	// Shared with anything else asking for the same state.
+	return PipelineRegistry::Get().GetGraphicsPipeline(desc);
+}
+
+void SampleModel::CreateCullingPipeline()
+{
+	// UBO, meshlets, draw commands and draw count, plus CullSettings as push constants.
+	m_cullReflection = PipelineReflection({ LoadShader(CULL_SHADER).Span() });
+	m_cullDescriptorSetLayout = m_cullReflection.SetLayout(0);
+	m_cullPipelineLayout = m_cullReflection.PipelineLayout();
+
+	CreateCullingComputePipeline();
+}
+
+void SampleModel::CreateCullingComputePipeline()
+{
+	auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+	auto csCode = LoadShader(CULL_SHADER);
+	auto csModule = vkHelpers::CreateShaderModule(csCode.Span());
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	{
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = csModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = m_cullPipelineLayout;
+	}
+
+	if (vkCreateComputePipelines(device, PipelineCache::Get().GetHandle(), 1, &pipelineInfo, nullptr, &m_cullPipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling pipeline");
+	}
+
+	vkDestroyShaderModule(device, csModule, nullptr);
+}
+
+void SampleModel::CreateDescriptorSetLayout()
+{
+	// Descriptors allow shaders to access buffers and images.
+	// Descriptor Layouts specify the type of resources being used by the shader.
+	// Descriptor Sets specify the buffer or image that get bound to the descriptor (frame buffers specify image views to render pass attachments)
+
+	// Bindings, types and stages are read from the shaders, so they can't disagree with what the shaders declare.
+	m_reflection = PipelineReflection({ LoadShader(VERTEX_SHADER).Span(), LoadShader(FRAGMENT_SHADER).Span() });
+	m_descriptorSetLayout = m_reflection.SetLayout(0);
+}
+
+DescriptorWriter SampleModel::WriteDescriptors(size_t image) const
+{
+	// Specify which buffer we want the descriptor to refer to.
+	VkDescriptorBufferInfo bufferInfo{};
+	{
+		bufferInfo.buffer = m_uniformBuffers[image].m_buffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = sizeof(UniformBufferObject);
+	}
+
+	// Bind image and sampler
+	VkDescriptorImageInfo imageInfo{};
+	{
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = m_texture->image.m_view;
+		imageInfo.sampler = m_textureSampler;
+	}
+
+	// Same sampler, the atlas view stops at the mips its gutter keeps clean.
+	VkDescriptorImageInfo atlasInfo = imageInfo;
+	atlasInfo.imageView = m_atlas.image.m_view;
+
+	DescriptorWriter writer(m_reflection);
+	writer.Buffer("ubo", bufferInfo)
+		.Image("texSampler", imageInfo)
+		.Buffer("Materials", { m_materialBuffer.m_buffer, 0, VK_WHOLE_SIZE })
+		.Image("atlasSampler", atlasInfo);
+
+	return writer;
+}
+
+DescriptorWriter SampleModel::WriteCullDescriptors(size_t image) const
+{
+	DescriptorWriter writer(m_cullReflection);
+	writer.Buffer("ubo", { m_uniformBuffers[image].m_buffer, 0, sizeof(UniformBufferObject) })
+		.Buffer("Meshlets", { m_meshletBuffer.m_buffer, 0, VK_WHOLE_SIZE })
+		.Buffer("DrawCommands", { m_drawCommandBuffers[image].m_buffer, 0, VK_WHOLE_SIZE })
+		.Buffer("DrawCount", { m_drawCountBuffers[image].m_buffer, 0, VK_WHOLE_SIZE });
+
+	return writer;
+}
+
+void SampleModel::CreateDescriptorSet()
+{
+	std::vector<VkDescriptorSetLayout> layouts(VulkanManager::GetVulkanManager().GetSwapChainImages().size(), GetDescriptorSetLayout());
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	{
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = GetDescriptorPool();
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(VulkanManager::GetVulkanManager().GetSwapChainImages().size());
+		allocInfo.pSetLayouts = layouts.data();
+	}
+
+	// Create one descriptor for each image in the swap chain.
+	m_descriptorSets.resize(VulkanManager::GetVulkanManager().GetSwapChainImages().size());
+
+	// Each descriptor set that gets allocated will also get a uniform buffer descriptor.
+	VK_ASSERT(vkAllocateDescriptorSets(VulkanManager::GetVulkanManager().GetDevice(), &allocInfo, m_descriptorSets.data()), "Failed to allocate descriptor sets");
+
+	// Configure descriptor sets.
+	for (size_t i = 0; i < VulkanManager::GetVulkanManager().NumSwapChainImages(); ++i)
+	{
+		WriteDescriptors(i).Update(m_descriptorSets[i]);
+	}
+
+	if (m_drawCountBuffers.empty())
+	{
+		return;
+	}
+
+	// Culling sets
+	std::vector<VkDescriptorSetLayout> cullLayouts(VulkanManager::GetVulkanManager().NumSwapChainImages(), m_cullDescriptorSetLayout);
+
+	VkDescriptorSetAllocateInfo cullAllocInfo{};
+	{
+		cullAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		cullAllocInfo.descriptorPool = GetDescriptorPool();
+		cullAllocInfo.descriptorSetCount = static_cast<uint32_t>(cullLayouts.size());
+		cullAllocInfo.pSetLayouts = cullLayouts.data();
+	}
+
+	// Not a VK_ASSERT, the sets are written to right after.
+	m_cullDescriptorSets.resize(cullLayouts.size());
+	if (vkAllocateDescriptorSets(VulkanManager::GetVulkanManager().GetDevice(), &cullAllocInfo, m_cullDescriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate culling descriptor sets");
+	}
+
+	for (size_t i = 0; i < m_cullDescriptorSets.size(); ++i)
+	{
+		WriteCullDescriptors(i).Update(m_cullDescriptorSets[i]);
+	}
+}
+
+void SampleModel::CreateDescriptorPool()
+{
+	auto numSwapChainImages = static_cast<uint32_t>(VulkanManager::GetVulkanManager().NumSwapChainImages());
+
+	// Exactly what one set per image needs, by what the shaders declare.
+	auto poolSizes = m_reflection.PoolSizes(numSwapChainImages);
+	auto maxSets = numSwapChainImages;
+
+	// The culling sets, if there are culling buffers to bind.
+	if (!m_drawCountBuffers.empty())
+	{
+		auto cullPoolSizes = m_cullReflection.PoolSizes(numSwapChainImages);
+		poolSizes.insert(poolSizes.end(), cullPoolSizes.begin(), cullPoolSizes.end());
+		maxSets += numSwapChainImages;
+	}
+
+	VKCreateDescriptorPool(VulkanManager::GetVulkanManager().GetDevice(), &m_descriptorPool, poolSizes.data(), static_cast<uint32_t>(poolSizes.size()), maxSets);
+}
+
+void SampleModel::CreateCommandPool()
 {
 	//auto queueFamilyIndices = VulkanManager::GetVulkanManager().FindQueueFamilies(VulkanManager::GetVulkanManager().GetPhysicalDevice());
 
@@ -647,6 +941,13 @@ void SampleModel::CreateCommandPool()
 
 void SampleModel::CreateFrameBuffers()
 {
+	// Dynamic rendering takes the image views directly.
+	if (VulkanManager::GetVulkanManager().UsesDynamicRendering())
+	{
+		m_frameBuffers.clear();
+		return;
+	}
+
 	// Each FBO will need to reference each of the image view objects.
 
 	m_frameBuffers.resize(VulkanManager::GetVulkanManager().GetSwapChainImageViews().size());
@@ -689,15 +990,9 @@ void SampleModel::CreateCommandBuffers()
 	auto& commandPool = vkManager.GetCommandPool();
 	
 	if (commandBuffers.size() == 0)
-		commandBuffers.resize(m_frameBuffers.size());
+		commandBuffers.resize(vkManager.NumSwapChainImages());
 	//m_commandBuffers.resize(m_frameBuffers.size());
 
-	std::array<VkClearValue, 2> clearValues{};
-	{
-		clearValues[0].color = { 0, 0, 0, 1 };
-		clearValues[1].depthStencil = { 1, 0 };
-	}
-
 	VkCommandBufferAllocateInfo allocInfo{};
 	{
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -708,19 +1003,97 @@ void SampleModel::CreateCommandBuffers()
 		VK_ASSERT(vkAllocateCommandBuffers(VulkanManager::GetVulkanManager().GetDevice(), &allocInfo, commandBuffers.data()), "Failed to allocate command buffers");
 	}
 
+	m_recordedLods.resize(commandBuffers.size());
+	m_recordedMeshletCulling.resize(commandBuffers.size());
+
 	// Starting command buffer recording
-	for (auto i = 0; i < commandBuffers.size(); ++i)
+	for (uint32_t i = 0; i < commandBuffers.size(); ++i)
+	{
+		RecordCommandBuffer(i);
+	}
+}
+
+void SampleModel::RecordCommandBuffer(uint32_t i)
+{
+	auto& commandBuffers = VulkanManager::GetVulkanManager().GetCommandBuffers();
+
+	std::array<VkClearValue, 2> clearValues{};
+	{
+		clearValues[0].color = { 0, 0, 0, 1 };
+		clearValues[1].depthStencil = { 1, 0 };
+	}
+
+	// Describe how the command buffers are being used.
+	VkCommandBufferBeginInfo beginInfo{};
 	{
-		// Describe how the command buffers are being used.
-		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = 0;					// How to use command buffer.
+		beginInfo.pInheritanceInfo = nullptr;	// Only relevant for secondary command buffers - which state to inherit from primary buffer.
+	}
+
+	VK_ASSERT(vkBeginCommandBuffer(commandBuffers[i], &beginInfo), "Failed to begin recording command buffer");
+
+	// Meshlets split the full resolution mesh, the coarser LODs are cheap enough to draw whole.
+	const bool cullMeshlets = m_meshletCulling && m_lod == 0;
+	const auto meshletCount = static_cast<uint32_t>(m_mesh.m_meshlets.size());
+
+	// Cull meshlets before the render pass starts.
+	if (cullMeshlets)
+	{
+		vkCmdFillBuffer(commandBuffers[i], m_drawCountBuffers[i].m_buffer, 0, sizeof(uint32_t), 0);
+
+		VkBufferMemoryBarrier resetBarrier{};
+		{
+			resetBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			resetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			resetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			resetBarrier.buffer = m_drawCountBuffers[i].m_buffer;
+			resetBarrier.offset = 0;
+			resetBarrier.size = VK_WHOLE_SIZE;
+		}
+
+		vkCmdPipelineBarrier(commandBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &resetBarrier, 0, nullptr);
+
+		CullSettings settings{};
 		{
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0;					// How to use command buffer.
-			beginInfo.pInheritanceInfo = nullptr;	// Only relevant for secondary command buffers - which state to inherit from primary buffer.
+			settings.meshletCount = meshletCount;
+			settings.frustumCulling = m_frustumCulling;
+			settings.coneCulling = m_coneCulling;
 		}
 
-		VK_ASSERT(vkBeginCommandBuffer(commandBuffers[i], &beginInfo), "Failed to begin recording command buffer");
+		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 1, &m_cullDescriptorSets[i], 0, nullptr);
+		vkCmdPushConstants(commandBuffers[i], m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullSettings), &settings);
+		vkCmdDispatch(commandBuffers[i], (meshletCount + MESHLET_CULL_GROUP_SIZE - 1) / MESHLET_CULL_GROUP_SIZE, 1, 1);
 
+		// The draw list feeds the indirect draw. The count is also read back on the CPU for the stats.
+		std::array<VkBufferMemoryBarrier, 2> cullBarriers{};
+		{
+			cullBarriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			cullBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			cullBarriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+			cullBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			cullBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			cullBarriers[0].buffer = m_drawCommandBuffers[i].m_buffer;
+			cullBarriers[0].offset = 0;
+			cullBarriers[0].size = VK_WHOLE_SIZE;
+
+			cullBarriers[1] = cullBarriers[0];
+			cullBarriers[1].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+			cullBarriers[1].buffer = m_drawCountBuffers[i].m_buffer;
+		}
+
+		vkCmdPipelineBarrier(commandBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, static_cast<uint32_t>(cullBarriers.size()), cullBarriers.data(), 0, nullptr);
+	}
+
+	if (VulkanManager::GetVulkanManager().UsesDynamicRendering())
+	{
+		BeginRendering(i, clearValues);
+	}
+	else
+	{
 		// Starting a render pass
 		VkRenderPassBeginInfo renderPassInfo{};
 		{
@@ -738,84 +1111,772 @@ void SampleModel::CreateCommandBuffers()
 			&renderPassInfo,
 			VK_SUBPASS_CONTENTS_INLINE	// Details the render pass - It's a primary command buffer, everything will be sent in one go.
 		);
+	}
 
-		// Basic drawing
-		vkCmdBindPipeline(commandBuffers[i],
-			VK_PIPELINE_BIND_POINT_GRAPHICS,	// Graphics or compute pipeline	
-			m_graphicsPipeline
-		);
+	// Basic drawing
+	vkCmdBindPipeline(commandBuffers[i],
+		VK_PIPELINE_BIND_POINT_GRAPHICS,	// Graphics or compute pipeline	
+		PipelineRegistry::Get().Resolve(m_graphicsPipeline)	// The optimized link once it's done, see PipelineRegistry.
+	);
 
-		// Bind vertex buffer
-		VkBuffer vertexBuffers[] = { m_vertexBuffer.m_buffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+	// Viewport and scissor are dynamic state, see CreateGraphicsPipeline.
+	{
+		auto extent = VulkanManager::GetVulkanManager().GetSwapChainExtent();
 
-		// Bind index buffer
-		vkCmdBindIndexBuffer(commandBuffers[i], m_indexBuffer.m_buffer, 0, VK_INDEX_TYPE_UINT32);
+		VkViewport viewport{};
+		{
+			viewport.x = 0.0f;
+			viewport.y = 0.0f;
+			viewport.width = static_cast<float>(extent.width);
+			viewport.height = static_cast<float>(extent.height);
+			viewport.minDepth = 0.0f;
+			viewport.maxDepth = 1.0f;
+		}
+
+		VkRect2D scissor{};
+		{
+			scissor.offset = { 0, 0 };
+			scissor.extent = extent;
+		}
+
+		vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
+	}
+
+	// Bind vertex buffers, one per VertexBinding
+	VkBuffer vertexBuffers[] = { m_positionBuffer.m_buffer, m_attributeBuffer.m_buffer };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffers[i], VERTEX_BINDING_POSITION, 2, vertexBuffers, offsets);
 
-		// Bind descriptor sets
-		vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[i], 0, nullptr);
+	// Bind index buffer
+	vkCmdBindIndexBuffer(commandBuffers[i], m_indexBuffer.m_buffer, 0, VK_INDEX_TYPE_UINT32);
 
-		// Draw
-		vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(m_mesh.m_indices.size()), 1, 0, 0, 0);
+	// Bind descriptor sets
+	vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[i], 0, nullptr);
 
-		// End render pass
+	// Draw
+	if (cullMeshlets)
+	{
+		// One draw per meshlet that survived culling.
+		vkCmdDrawIndexedIndirectCount(commandBuffers[i], m_drawCommandBuffers[i].m_buffer, 0, m_drawCountBuffers[i].m_buffer, 0, meshletCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else
+	{
+		// Every LOD lives in the same index buffer, only the range changes.
+		const auto& lod = m_mesh.m_lods[m_lod];
+		vkCmdDrawIndexed(commandBuffers[i], lod.indexCount, 1, lod.firstIndex, 0, 0);
+	}
+
+	// End render pass
+	if (VulkanManager::GetVulkanManager().UsesDynamicRendering())
+	{
+		VulkanManager::GetVulkanManager().EndRendering(commandBuffers[i]);
+	}
+	else
+	{
 		vkCmdEndRenderPass(commandBuffers[i]);
+	}
+
+	VK_ASSERT(vkEndCommandBuffer(commandBuffers[i]), "Failed to record command buffer");
+
+	m_recordedLods[i] = m_lod;
+	m_recordedMeshletCulling[i] = cullMeshlets;
+}
+
+void SampleModel::BeginRendering(uint32_t i, const std::array<VkClearValue, 2>& clearValues)
+{
+	auto& vkManager = VulkanManager::GetVulkanManager();
+	auto commandBuffer = vkManager.GetCommandBuffers()[i];
+
+	// What CreateRenderPass's initial layouts and subpass dependency did. Nothing is kept from last frame,
+	// the barriers only wait for its writes to finish. The resolve target is left as a color attachment for ImGui.
+	std::array<VkImageMemoryBarrier, 3> barriers = {
+		vkHelpers::ImageBarrier(m_colorImage.m_image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT),
+		vkHelpers::ImageBarrier(vkManager.GetSwapChainImages()[i], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT),
+		vkHelpers::ImageBarrier(m_depthImage.m_image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT),
+	};
+
+	if (vkHelpers::HasStencilComponent(FindDepthFormat()))
+	{
+		barriers[2].subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	// Multisampled color resolved into the swap chain image at the end of the pass. Only the resolve is
+	// read afterwards, so the multisampled image is never written out.
+	VkRenderingAttachmentInfoKHR colorAttachment{};
+	{
+		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		colorAttachment.imageView = m_colorImage.m_view;
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		colorAttachment.resolveImageView = vkManager.GetSwapChainImageViews()[i];
+		colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.clearValue = clearValues[0];
+	}
+
+	VkRenderingAttachmentInfoKHR depthAttachment{};
+	{
+		depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		depthAttachment.imageView = m_depthImage.m_view;
+		depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.clearValue = clearValues[1];
+	}
 
-		VK_ASSERT(vkEndCommandBuffer(commandBuffers[i]), "Failed to record command buffer");
+	VkRenderingInfoKHR renderingInfo{};
+	{
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+		renderingInfo.renderArea.offset = { 0, 0 };
+		renderingInfo.renderArea.extent = vkManager.GetSwapChainExtent();
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachments = &colorAttachment;
+		renderingInfo.pDepthAttachment = &depthAttachment;
 	}
+
+	vkManager.BeginRendering(commandBuffer, renderingInfo);
 }
 
 void SampleModel::CreateTextureImage()
 {
-	auto& commandPool = VulkanManager::GetVulkanManager().GetCommandPool();
-	
-	Texture texture(TEXTURE_PATH.c_str());
+	// Textures are uploaded in whatever order they finish decoding.
+	while (auto decoded = TextureDecoder::Get().WaitNext())
+	{
+		if (!decoded->error.empty())
+		{
+			throw std::runtime_error(decoded->error);
+		}
 
-	m_mipLevels = vkHelpers::CaclulateMipLevels(texture.width, texture.height);
+		if (decoded == m_textureRequest)
+		{
+			m_texture = AssetCache::Get().m_textures.Insert(m_textureHash, UploadTexture(*decoded));
+			m_textureRequest.reset();
+		}
 
-	VkDeviceSize imageSize = texture.width * texture.height * 4;	// Multiply by 4 for each channel RGBA
+		decoded->DestroyStaging();
+	}
+}
 
-	Buffer stagingBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+GpuTexture SampleModel::UploadTexture(const DecodedTexture& texture)
+{
+	auto& commandPool = VulkanManager::GetVulkanManager().GetCommandPool();
 
-	// Map to temp buffer
-	stagingBuffer.Map(texture.m_pixels);
+	// KTX2 textures come with their mips (usually block compressed), everything else gets them blitted on the GPU.
+	const bool prebuiltMips = texture.HasMipChain();
 
-	texture.Free();
+	GpuTexture gpuTexture;
+	gpuTexture.format = texture.format;
+	gpuTexture.width = static_cast<uint32_t>(texture.width);
+	gpuTexture.height = static_cast<uint32_t>(texture.height);
+	gpuTexture.mipLevels = prebuiltMips ? static_cast<uint32_t>(texture.levels.size()) : vkHelpers::CaclulateMipLevels(texture.width, texture.height);
+
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(VulkanManager::GetVulkanManager().GetPhysicalDevice(), gpuTexture.format, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+		{
+			throw std::runtime_error("Texture format isn't supported by the device: " + texture.path);
+		}
+	}
 
 	// With mipmapping enabled, source has to also be VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
-	auto usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	// Prebuilt mips need it too, DropTopMips copies the smaller ones out when the residency budget is tight.
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
 	// Create the image
 	VulkanManager::GetVulkanManager().CreateImage(texture.width,
 		texture.height,
-		m_mipLevels,
+		gpuTexture.mipLevels,
 		VK_SAMPLE_COUNT_1_BIT,
-		VK_FORMAT_R8G8B8A8_SRGB,
+		gpuTexture.format,
 		VK_IMAGE_TILING_OPTIMAL,
 		usage,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_texture.m_image, m_texture.m_memory);
+		gpuTexture.image.m_image, gpuTexture.image.m_memory);
+
+	// Copy the staging buffer the decoder filled to the image
+	VulkanManager::GetVulkanManager().TransitionImageLayout(commandPool, gpuTexture.image.m_image, gpuTexture.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, gpuTexture.mipLevels);
 
-	// Copy the staging buffer to the image
-	VulkanManager::GetVulkanManager().TransitionImageLayout(commandPool, m_texture.m_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_mipLevels);
-	VulkanManager::GetVulkanManager().CopyBufferToImage(commandPool, stagingBuffer.m_buffer, m_texture.m_image, texture.width, texture.height);
+	if (prebuiltMips)
+	{
+		// Every level goes straight from the file to its mip, one region each.
+		std::vector<VkBufferImageCopy> regions(texture.levels.size());
+		for (uint32_t level = 0; level < regions.size(); ++level)
+		{
+			const auto& textureLevel = texture.levels[level];
+
+			regions[level].bufferOffset = textureLevel.offset;
+			regions[level].bufferRowLength = 0;
+			regions[level].bufferImageHeight = 0;
+			regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			regions[level].imageSubresource.mipLevel = level;
+			regions[level].imageSubresource.baseArrayLayer = 0;
+			regions[level].imageSubresource.layerCount = 1;
+			regions[level].imageOffset = { 0, 0, 0 };
+			regions[level].imageExtent = { textureLevel.width, textureLevel.height, 1 };
+		}
+
+		VulkanManager::GetVulkanManager().CopyBufferToImage(commandPool, texture.staging.m_buffer, gpuTexture.image.m_image, regions);
+		VulkanManager::GetVulkanManager().TransitionImageLayout(commandPool, gpuTexture.image.m_image, gpuTexture.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, gpuTexture.mipLevels);
+	}
+	else
+	{
+		VulkanManager::GetVulkanManager().CopyBufferToImage(commandPool, texture.staging.m_buffer, gpuTexture.image.m_image, texture.width, texture.height);
 
-	vkDestroyBuffer(VulkanManager::GetVulkanManager().GetDevice(), stagingBuffer.m_buffer, nullptr);
-	vkFreeMemory(VulkanManager::GetVulkanManager().GetDevice(), stagingBuffer.m_memory, nullptr);
+		// Generating mipmaps transitions the layout to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+		VulkanManager::GetVulkanManager().GenerateMipMaps(commandPool, gpuTexture.image.m_image, gpuTexture.format, texture.width, texture.height, gpuTexture.mipLevels);
+	}
 
-	// Generating mipmaps transitions the layout to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
-	VulkanManager::GetVulkanManager().GenerateMipMaps(commandPool, m_texture.m_image, VK_FORMAT_R8G8B8A8_SRGB, texture.width, texture.height, m_mipLevels);
+	return gpuTexture;
 }
 
 void SampleModel::CreateTextureImageView()
 {
-	m_texture.m_view = VulkanManager::GetVulkanManager().CreateImageView(m_texture.m_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, m_mipLevels);
+	// A texture shared from the cache already has one.
+	if (m_texture->image.m_view == VK_NULL_HANDLE)
+	{
+		m_texture->image.CreateView(m_texture->format, VK_IMAGE_ASPECT_COLOR_BIT, m_texture->mipLevels);
+	}
 }
 
 void SampleModel::CreateTextureSampler()
 {
-	VulkanManager::GetVulkanManager().CreateTextureSampler(m_textureSampler, static_cast<float>(m_mipLevels));
+	VulkanManager::GetVulkanManager().CreateTextureSampler(m_textureSampler, static_cast<float>(m_texture->mipLevels));
+}
+
+void SampleModel::CreateTextureAtlas()
+{
+	// Materials without a texture of their own keep sampling texSampler, as do those the atlas can't take.
+	std::vector<MaterialRegion> regions(m_mesh.m_materials.size(), { glm::vec4(1.0f, 1.0f, 0.0f, 0.0f), -1 });
+
+	// Remapped UVs only stay inside the texture's rectangle if they don't leave [0, 1] to begin with.
+	std::vector<bool> repeats(m_mesh.m_materials.size(), false);
+	for (const auto& submesh : m_mesh.m_submeshes)
+	{
+		for (uint32_t v = submesh.firstVertex; v < submesh.firstVertex + submesh.vertexCount && !repeats[submesh.material]; ++v)
+		{
+			const auto& uv = m_mesh.m_vertices[v].uv;
+			repeats[submesh.material] = uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f;
+		}
+	}
+
+	// Materials sharing an image share its region.
+	TextureAtlasBuilder builder;
+	std::unordered_map<std::string, uint32_t> added;
+	std::vector<uint32_t> materialTextures(m_mesh.m_materials.size(), UINT32_MAX);
+	for (size_t i = 0; i < m_mesh.m_materials.size(); ++i)
+	{
+		const auto& path = m_mesh.m_materials[i].baseColorTexture;
+		if (path.empty() || repeats[i])
+		{
+			continue;
+		}
+
+		if (auto it = added.find(path); it != added.end())
+		{
+			materialTextures[i] = it->second;
+			continue;
+		}
+
+		// KTX2 textures are already compressed with their own mips, they stay on their own.
+		Texture texture(path.c_str());
+		const auto width = static_cast<uint32_t>(texture.width);
+		const auto height = static_cast<uint32_t>(texture.height);
+		if (texture.IsValid() && !texture.HasMipChain() && TextureAtlasBuilder::IsCandidate(width, height))
+		{
+			materialTextures[i] = added[path] = builder.Add(path, width, height, texture.m_pixels);
+		}
+
+		texture.Free();
+	}
+
+	// The binding always needs an image, even if nothing was packed.
+	if (builder.Count() == 0)
+	{
+		const uint8_t white[4] = { 255, 255, 255, 255 };
+		builder.Add("white", 1, 1, white);
+	}
+
+	auto atlas = builder.Build();
+	for (size_t i = 0; i < regions.size(); ++i)
+	{
+		if (materialTextures[i] != UINT32_MAX)
+		{
+			const auto& region = atlas.regions[materialTextures[i]];
+			regions[i] = { glm::vec4(region.scale, region.offset), static_cast<int32_t>(region.layer) };
+		}
+	}
+
+	m_atlas = UploadTextureAtlas(atlas);
+	m_materialBuffer = Buffer(regions, VulkanManager::GetVulkanManager().GetCommandPool(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void SampleModel::HotReload()
+{
+	if (!g_enableHotReload)
+	{
+		return;
+	}
+
+	bool reloadGraphicsPipeline = false;
+	bool reloadCullingPipeline = false;
+
+	for (const auto& path : m_fileWatcher.PollChanges())
+	{
+		// Whatever was cooked into the archive is out of date now.
+		AssetArchive::Get().Remove(path);
+
+		for (const auto& shader : SHADER_SOURCES)
+		{
+			// Compiled in the background, the pipeline is rebuilt once it's done and picks the SPIR-V up
+			// from the cache. If it doesn't compile the error is printed and the old pipeline stays.
+			if (path == SHADER_DIRECTORY + shader)
+			{
+				std::cout << "Recompiling " << path << std::endl;
+
+				m_shaderCompiles.push_back(std::async(std::launch::async, [shader]()
+				{
+					try
+					{
+						CompileShader(SHADER_DIRECTORY + shader);
+						return shader;
+					}
+					catch (const std::exception& e)
+					{
+						std::cerr << e.what() << std::endl;
+						return std::string();
+					}
+				}));
+			}
+		}
+
+		if (path == MODEL_PATH)
+		{
+			// One import at a time, a change in the middle of one starts another once it's done.
+			if (m_meshImport.valid())
+			{
+				m_meshChangedDuringImport = true;
+			}
+			else
+			{
+				m_meshImport = std::async(std::launch::async, []() { Mesh mesh; ImportMesh(mesh); return mesh; });
+			}
+		}
+
+		if (path == TEXTURE_PATH)
+		{
+			auto hash = HashTexture(TEXTURE_PATH);
+			if (!(hash == m_textureHash))
+			{
+				if (m_textureRequest)
+				{
+					TextureDecoder::Get().Cancel(m_textureRequest);
+					m_textureRequest.reset();
+				}
+
+				std::cout << "Reloading " << TEXTURE_PATH << std::endl;
+
+				m_textureHash = hash;
+				if (auto texture = AssetCache::Get().m_textures.Find(hash))
+				{
+					SwapTexture(texture);
+					ResidencyManager::Get().Restored(m_textureResidency, m_texture->MemorySize());
+				}
+				else
+				{
+					// Ahead of anything else that might be queued, it's on screen.
+					m_textureRequest = TextureDecoder::Get().Submit(TEXTURE_PATH, 1);
+				}
+			}
+		}
+	}
+
+	m_shaderCompiles.erase(std::remove_if(m_shaderCompiles.begin(), m_shaderCompiles.end(), [&](std::future<std::string>& compile)
+	{
+		if (compile.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return false;
+		}
+
+		auto source = compile.get();
+		reloadGraphicsPipeline |= source == VERTEX_SHADER || source == FRAGMENT_SHADER;
+		reloadCullingPipeline |= source == CULL_SHADER;
+		return true;
+	}), m_shaderCompiles.end());
+
+	if (reloadGraphicsPipeline)
+	{
+		ReloadGraphicsPipeline();
+	}
+
+	if (reloadCullingPipeline && m_cullPipeline != VK_NULL_HANDLE)
+	{
+		ReloadCullingPipeline();
+	}
+
+	if (m_meshImport.valid() && m_meshImport.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		try
+		{
+			SwapMesh(m_meshImport.get());
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to reload " << MODEL_PATH << ": " << e.what() << std::endl;
+		}
+
+		if (m_meshChangedDuringImport)
+		{
+			m_meshChangedDuringImport = false;
+			m_meshImport = std::async(std::launch::async, []() { Mesh mesh; ImportMesh(mesh); return mesh; });
+		}
+	}
+}
+
+void SampleModel::ReloadGraphicsPipeline()
+{
+	auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+	// Permutations still compiling read the reflection and modules that are about to be replaced. The ones
+	// that haven't started are dropped, CreateGraphicsPipeline (or the rollback below) submits them again.
+	CancelPipelineBuilds();
+
+	// The shaders may declare different resources now, so the layouts are reflected again. They come from
+	// VulkanObjectCache, an unchanged shader interface gets the same handles back.
+	// Only the fallback is waited for, the others are rebuilt in the background.
+	auto oldReflection = m_reflection;
+	auto oldSetLayout = m_descriptorSetLayout;
+	auto oldPipelineLayout = m_pipelineLayout;
+	auto oldPipeline = m_graphicsPipeline;
+	auto oldDrawnPermutation = m_drawnPermutation;
+	auto oldPipelines = std::move(m_permutationPipelines);
+	m_permutationPipelines.clear();
+	// CreateGraphicsPipeline loads the new code before it knows the fallback builds.
+	auto oldVertexCode = std::move(m_vertexCode);
+	auto oldFragmentCode = std::move(m_fragmentCode);
+
+	try
+	{
+		CreateDescriptorSetLayout();
+		// Before anything is destroyed, a binding nothing is provided for would only fail once the sets are rebuilt.
+		WriteDescriptors(0).Validate();
+		CreateGraphicsPipeline();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Failed to rebuild the graphics pipeline: " << e.what() << std::endl;
+
+		m_reflection = oldReflection;
+		m_descriptorSetLayout = oldSetLayout;
+		m_pipelineLayout = oldPipelineLayout;
+		m_graphicsPipeline = oldPipeline;
+		m_drawnPermutation = oldDrawnPermutation;
+		m_permutationPipelines = std::move(oldPipelines);
+		m_vertexCode = std::move(oldVertexCode);
+		m_fragmentCode = std::move(oldFragmentCode);
+
+		// The cancelled builds, with the old code again.
+		SubmitPermutationBuilds();
+		return;
+	}
+
+	// The old pipelines may still be in use by the last frame.
+	vkDeviceWaitIdle(device);
+	for (auto& [permutation, pipeline] : oldPipelines)
+	{
+		PipelineRegistry::Get().Release(pipeline);
+	}
+
+	// The sets have to match the new layout.
+	if (m_descriptorSetLayout != oldSetLayout)
+	{
+		RebindResources();
+		return;
+	}
+
+	// Pipelines are baked into the command buffers.
+	std::fill(m_recordedLods.begin(), m_recordedLods.end(), UINT32_MAX);
+}
+
+void SampleModel::SelectPermutation(const MaterialPermutation& permutation)
+{
+	m_permutation = permutation;
+
+	if (m_permutationPipelines.count(permutation))
+	{
+		DrawPermutation(permutation);
+		return;
+	}
+
+	// Never waited for, CollectPipelineBuilds swaps it in once it's compiled. A background build of it can be
+	// queued behind the rest of the prewarm, so it's asked for again up front. PipelineRegistry only creates it once.
+	m_pendingPipelines.emplace(permutation, SubmitGraphicsPipeline(permutation, PIPELINE_PRIORITY_IMMEDIATE));
+
+	auto fallback = MaterialPermutation::Fallback();
+	if (m_drawnPermutation != fallback)
+	{
+		DrawPermutation(fallback);
+	}
+}
+
+void SampleModel::DrawPermutation(const MaterialPermutation& permutation)
+{
+	m_drawnPermutation = permutation;
+	m_graphicsPipeline = m_permutationPipelines.at(permutation);
+
+	// Only what was picked, not the fallback standing in for it.
+	if (permutation == m_permutation)
+	{
+		m_pipelineUsage.Record(permutation);
+	}
+
+	// Pipelines are baked into the command buffers. The old one stays alive, frames in flight can keep using it.
+	std::fill(m_recordedLods.begin(), m_recordedLods.end(), UINT32_MAX);
+}
+
+void SampleModel::DestroyGraphicsPipelines()
+{
+	// Anything already compiling ends up in m_permutationPipelines first, the rest is skipped.
+	CancelPipelineBuilds();
+
+	// Destroyed unless something else asked for the same state.
+	for (auto& [permutation, pipeline] : m_permutationPipelines)
+	{
+		PipelineRegistry::Get().Release(pipeline);
+	}
+
+	m_permutationPipelines.clear();
+	m_graphicsPipeline = VK_NULL_HANDLE;
+}
+
+void SampleModel::ReloadCullingPipeline()
+{
+	auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+	// Same as ReloadGraphicsPipeline, the layouts follow whatever the shader declares now.
+	auto oldReflection = m_cullReflection;
+	auto oldSetLayout = m_cullDescriptorSetLayout;
+	auto oldPipelineLayout = m_cullPipelineLayout;
+	auto oldPipeline = m_cullPipeline;
+
+	try
+	{
+		CreateCullingPipeline();
+		if (!m_drawCountBuffers.empty())
+		{
+			WriteCullDescriptors(0).Validate();
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Failed to rebuild the culling pipeline: " << e.what() << std::endl;
+
+		if (m_cullPipeline != oldPipeline)
+		{
+			vkDestroyPipeline(device, m_cullPipeline, nullptr);
+		}
+
+		m_cullReflection = oldReflection;
+		m_cullDescriptorSetLayout = oldSetLayout;
+		m_cullPipelineLayout = oldPipelineLayout;
+		m_cullPipeline = oldPipeline;
+		return;
+	}
+
+	vkDeviceWaitIdle(device);
+	vkDestroyPipeline(device, oldPipeline, nullptr);
+
+	if (m_cullDescriptorSetLayout != oldSetLayout)
+	{
+		RebindResources();
+		return;
+	}
+
+	std::fill(m_recordedLods.begin(), m_recordedLods.end(), UINT32_MAX);
+}
+
+void SampleModel::SwapMesh(Mesh&& mesh)
+{
+	// Nothing can be drawing from the old buffers anymore.
+	vkDeviceWaitIdle(VulkanManager::GetVulkanManager().GetDevice());
+
+	m_positionBuffer.Destroy();
+	m_attributeBuffer.Destroy();
+	m_indexBuffer.Destroy();
+	m_meshletBuffer.Destroy();
+
+	for (auto& buffer : m_drawCommandBuffers)
+	{
+		buffer.Destroy();
+	}
+
+	for (auto& buffer : m_drawCountBuffers)
+	{
+		buffer.Destroy();
+	}
+
+	m_drawCommandBuffers.clear();
+	m_drawCountBuffers.clear();
+
+	// The materials may have changed along with the mesh.
+	m_atlas.Destroy();
+	m_materialBuffer.Destroy();
+
+	m_mesh = std::move(mesh);
+	m_meshletCulling = m_meshletCulling && !m_mesh.m_meshlets.empty();
+	m_lod = 0;
+
+	CreateBuffers();
+	CreateCullingBuffers();
+	CreateTextureAtlas();
+
+	RebindResources();
+
+	ResidencyManager::Get().Restored(m_meshResidency, MeshMemorySize());
+
+	std::cout << "Reloaded " << MODEL_PATH << std::endl;
+}
+
+void SampleModel::SwapTexture(std::shared_ptr<GpuTexture> texture)
+{
+	// The descriptor sets still point at the old texture.
+	vkDeviceWaitIdle(VulkanManager::GetVulkanManager().GetDevice());
+
+	m_texture = texture;
+	CreateTextureImageView();
+
+	// The sampler's LOD range depends on the mip count.
+	CreateTextureSampler();
+
+	RebindResources();
+}
+
+void SampleModel::RegisterResidency()
+{
+	auto& residency = ResidencyManager::Get();
+
+	ResidencyCallbacks meshCallbacks;
+	{
+		// Only the GPU copies go, the mesh stays in memory to be uploaded again.
+		meshCallbacks.evict = [this]()
+		{
+			vkDeviceWaitIdle(VulkanManager::GetVulkanManager().GetDevice());
+
+			m_positionBuffer.Destroy();
+			m_attributeBuffer.Destroy();
+			m_indexBuffer.Destroy();
+			m_meshletBuffer.Destroy();
+
+			// The descriptor sets are rewritten once the buffers are back, until then nothing can be recorded with them.
+			std::fill(m_recordedLods.begin(), m_recordedLods.end(), UINT32_MAX);
+		};
+
+		meshCallbacks.restore = [this]() -> std::optional<VkDeviceSize>
+		{
+			vkDeviceWaitIdle(VulkanManager::GetVulkanManager().GetDevice());
+
+			CreateBuffers();
+			RebindResources();
+
+			return MeshMemorySize();
+		};
+	}
+
+	m_meshResidency = residency.Register(MODEL_PATH, MeshMemorySize(), std::move(meshCallbacks));
+
+	ResidencyCallbacks textureCallbacks;
+	{
+		textureCallbacks.trim = [this]()
+		{
+			if (m_texture->mipLevels <= 1 || std::max(m_texture->width, m_texture->height) / 2 < RESIDENCY_MIN_TEXTURE_SIZE)
+			{
+				return m_texture->MemorySize();
+			}
+
+			// Nothing can be sampling it while its layout changes for the copy.
+			vkDeviceWaitIdle(VulkanManager::GetVulkanManager().GetDevice());
+
+			// Not shared through the cache, it no longer matches the content hash.
+			SwapTexture(MakeSharedResource(DropTopMips(*m_texture, 1)));
+
+			return m_texture->MemorySize();
+		};
+
+		textureCallbacks.restore = [this]() -> std::optional<VkDeviceSize>
+		{
+			// Something else may still be holding on to the full texture.
+			if (auto texture = AssetCache::Get().m_textures.Find(m_textureHash))
+			{
+				SwapTexture(texture);
+				return m_texture->MemorySize();
+			}
+
+			// Picked up by StreamResources, the trimmed texture stays bound until then.
+			if (!m_textureRequest)
+			{
+				m_textureRequest = TextureDecoder::Get().Submit(TEXTURE_PATH, 1);
+			}
+
+			return std::nullopt;
+		};
+	}
+
+	m_textureResidency = residency.Register(TEXTURE_PATH, m_texture->MemorySize(), std::move(textureCallbacks));
+}
+
+void SampleModel::StreamResources()
+{
+	// Full textures that finished decoding, either reloaded or coming back after being trimmed.
+	while (m_textureRequest)
+	{
+		auto decoded = TextureDecoder::Get().Poll();
+		if (!decoded)
+		{
+			break;
+		}
+
+		if (decoded == m_textureRequest)
+		{
+			m_textureRequest.reset();
+
+			if (decoded->error.empty())
+			{
+				SwapTexture(AssetCache::Get().m_textures.Insert(m_textureHash, UploadTexture(*decoded)));
+				ResidencyManager::Get().Restored(m_textureResidency, m_texture->MemorySize());
+			}
+			else
+			{
+				std::cerr << "Failed to load " << TEXTURE_PATH << ": " << decoded->error << std::endl;
+				ResidencyManager::Get().RestoreFailed(m_textureResidency);
+			}
+		}
+
+		decoded->DestroyStaging();
+	}
+
+	ResidencyManager::Get().Update();
+}
+
+void SampleModel::RebindResources()
+{
+	// Reallocating is simpler than updating every set, and the pool size depends on whether culling buffers exist.
+	vkDestroyDescriptorPool(VulkanManager::GetVulkanManager().GetDevice(), m_descriptorPool, nullptr);
+
+	CreateDescriptorPool();
+	CreateDescriptorSet();
+
+	std::fill(m_recordedLods.begin(), m_recordedLods.end(), UINT32_MAX);
 }
 
 void SampleModel::UpdateUniformBuffers(uint32_t currentImage, Camera& camera)
@@ -1,11 +1,42 @@
 #pragma once
 
+#include "asset_cache.h"
 #include "buffer.h"
+#include "file_watcher.h"
 #include "image.h"
+#include "material_permutation.h"
 #include "mesh.h"
+#include "pipeline_usage_log.h"
+#include "residency_manager.h"
+#include "shader_compiler.h"
+#include "shader_reflection.h"
 #include "transform.h"
 #include "vulkan_base.h"
 
+#include <array>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <unordered_map>
+
+struct DecodedTexture;
+
+// Matches the push constants in cull.comp.
+struct CullSettings
+{
+	uint32_t meshletCount;
+	uint32_t frustumCulling;
+	uint32_t coneCulling;
+};
+
+// A material's texture in the atlas. Matches MaterialRegion in vs.vert (std430).
+struct MaterialRegion
+{
+	glm::vec4 uvTransform;	// xy - scale, zw - offset
+	int32_t layer;			// -1 if the material samples texSampler instead
+	uint32_t padding[3];
+};
+
 class SampleModel : public VulkanBase
 {
 public:
@@ -22,10 +53,64 @@ public:
 	void CreateCommandPool() override;
 	void CreateFrameBuffers() override;
 	void CreateCommandBuffers() override;
+	void RecordCommandBuffer(uint32_t imageIndex);
+	// Dynamic rendering's vkCmdBeginRenderPass, transitions the attachments itself.
+	void BeginRendering(uint32_t imageIndex, const std::array<VkClearValue, 2>& clearValues);
+
+	// Resize, see Reinitialize.
+	void CreateAttachments();
+	void CreateSwapChainImageResources();
+	void CleanupSwapChainImageResources();
+
+	// Material permutations, each one gets its own pipeline. They're built on PipelineQueue's threads,
+	// only the fallback is waited for. Anything selected before it's built is drawn with the fallback.
+	// Replacing the code, layout or render pass cancels the builds that haven't started, see CancelPipelineBuilds.
+	void SelectPermutation(const MaterialPermutation& permutation);
+	void DrawPermutation(const MaterialPermutation& permutation);	// Has to be built already.
+	void DestroyGraphicsPipelines();
+	std::shared_future<VkPipeline> SubmitGraphicsPipeline(const MaterialPermutation& permutation, int priority);	// Not tracked in m_pendingPipelines.
+	VkPipeline CreatePermutationPipeline(const MaterialPermutation& permutation) const;
+	void PrecompileUsedPermutations();
+	void PrewarmPermutations();
+
+	// Moves finished builds into m_permutationPipelines and swaps in the selected permutation once it's ready,
+	// called between frames.
+	void CollectPipelineBuilds(bool wait = false);
+	void WaitForPipelineBuilds() { CollectPipelineBuilds(true); }
+	// Queued builds are skipped, only the ones already running are waited for.
+	void CancelPipelineBuilds();
+	// The selected permutation, then what earlier runs used and the prewarm.
+	void SubmitPermutationBuilds();
+
+	void CreateCullingPipeline();
+	void CreateCullingComputePipeline();
+
+	// What each image's sets bind, by the names the shaders use.
+	DescriptorWriter WriteDescriptors(size_t image) const;
+	DescriptorWriter WriteCullDescriptors(size_t image) const;
+
+	// Hot reload, called between frames.
+	void HotReload();
+	void ReloadGraphicsPipeline();
+	void ReloadCullingPipeline();
+	void SwapMesh(Mesh&& mesh);
+	void SwapTexture(std::shared_ptr<GpuTexture> texture);
+	void RebindResources();
+
+	// Residency, see ResidencyManager.
+	void RegisterResidency();
+	void StreamResources();
+	VkDeviceSize MeshMemorySize() const
+	{
+		return m_positionBuffer.m_allocationSize + m_attributeBuffer.m_allocationSize + m_indexBuffer.m_allocationSize + m_meshletBuffer.m_allocationSize;
+	}
 
 	void CreateTextureImage();
+	GpuTexture UploadTexture(const DecodedTexture& texture);
 	void CreateTextureImageView();
 	void CreateTextureSampler();
+	// Packs the material textures into m_atlas and writes each material's region to m_materialBuffer.
+	void CreateTextureAtlas();
 	
 	void UpdateUniformBuffers(uint32_t currentImage, Camera& camera);
 
@@ -42,8 +127,20 @@ public:
 	void CreateBuffers()
 	{
 		auto& commandPool = VulkanManager::GetVulkanManager().GetCommandPool();
-		m_vertexBuffer = Buffer(m_mesh.m_vertices, commandPool, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+		// Positions and the rest of the attributes go in separate streams.
+		auto positions = m_mesh.GetPositionStream();
+		auto attributes = m_mesh.GetAttributeStream();
+		m_positionBuffer = Buffer(positions, commandPool, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		m_attributeBuffer = Buffer(attributes, commandPool, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
 		m_indexBuffer = Buffer(m_mesh.m_indices, commandPool, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+		// Kept even while the UI has culling turned off, see CreateCullingBuffers.
+		if (m_cullPipeline != VK_NULL_HANDLE && !m_mesh.m_meshlets.empty())
+		{
+			m_meshletBuffer = Buffer(m_mesh.m_meshlets, commandPool, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		}
 	}
 
 	void CreateUniformBuffers()
@@ -63,21 +160,116 @@ public:
 		}
 	}
 
-	Image m_texture;
+	void CreateCullingBuffers()
+	{
+		// Stays available when the UI toggle turns culling off so it can be turned back on.
+		if (m_cullPipeline == VK_NULL_HANDLE || m_mesh.m_meshlets.empty())
+		{
+			return;
+		}
+
+		auto numSwapChainImages = VulkanManager::GetVulkanManager().NumSwapChainImages();
+		m_drawCommandBuffers.resize(numSwapChainImages);
+		m_drawCountBuffers.resize(numSwapChainImages);
+
+		// Worst case every meshlet is visible.
+		VkDeviceSize drawsSize = sizeof(VkDrawIndexedIndirectCommand) * m_mesh.m_meshlets.size();
+
+		for (size_t i = 0; i < numSwapChainImages; ++i)
+		{
+			m_drawCommandBuffers[i] = Buffer(drawsSize,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			// Host visible so the number of drawn meshlets can be shown in the UI.
+			m_drawCountBuffers[i] = Buffer(sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+			uint32_t zero = 0;
+			m_drawCountBuffers[i].Map(&zero);
+		}
+	}
+
+	std::shared_ptr<DecodedTexture> m_textureRequest;	// See TextureDecoder, only set until the texture is uploaded.
+	AssetHash m_textureHash;
+	std::shared_ptr<GpuTexture> m_texture;				// Shared through AssetCache with anything else using the same image.
 	VkSampler m_textureSampler;
-	uint32_t m_mipLevels;
+	// Material textures small enough to share one array image and one binding, see CreateTextureAtlas.
+	GpuTexture m_atlas;
+	Buffer m_materialBuffer;
 
 	// Buffers should be allocated in one go.
-	Buffer m_vertexBuffer;
+	Buffer m_positionBuffer;
+	Buffer m_attributeBuffer;
 	Buffer m_indexBuffer;
 	// Copying new data each frame so no staging buffer.
 	// Multiple buffers make sense since multiple frames can be in flight at the same time.
 	std::vector<Buffer> m_uniformBuffers;
 
 	Mesh m_mesh;
+	uint32_t m_lod = 0;
+	// Which LOD each prerecorded command buffer draws.
+	std::vector<uint32_t> m_recordedLods;
+	// Whether each prerecorded command buffer runs the meshlet culling pass.
+	std::vector<bool> m_recordedMeshletCulling;
+
+	// Layouts, pool sizes and vertex input come from what the shaders declare.
+	PipelineReflection m_reflection;
+	PipelineReflection m_cullReflection;
+
+	// Material permutations
+	// m_permutation is the one selected, m_graphicsPipeline is m_drawnPermutation's. They only differ while the
+	// selected one compiles. Every variant created so far stays around so switching back and forth only
+	// re-records the command buffers.
+	MaterialPermutation m_permutation;
+	MaterialPermutation m_drawnPermutation;
+	std::unordered_map<MaterialPermutation, VkPipeline> m_permutationPipelines;
+	// Builds in flight read the code, layout and render pass, those are only replaced once they're done.
+	// The pipelines themselves belong to PipelineRegistry. A permutation selected while it waits in the background
+	// is submitted again up front, so it can have two builds of the same pipeline.
+	std::unordered_multimap<MaterialPermutation, std::shared_future<VkPipeline>> m_pendingPipelines;
+	// Checked by each build before it starts, replaced by CancelPipelineBuilds. Cancelled builds yield VK_NULL_HANDLE.
+	std::shared_ptr<std::atomic<bool>> m_pipelineBuildsCancelled = std::make_shared<std::atomic<bool>>(false);
+	// PipelineRegistry::Generation the command buffers were recorded at.
+	uint64_t m_pipelineGeneration = 0;
+	// Every permutation that was drawn with, across runs.
+	PipelineUsageLog<MaterialPermutation> m_pipelineUsage;
+	ShaderCode m_vertexCode;
+	ShaderCode m_fragmentCode;
+
+	// Meshlet culling
+	// LOD 0 is split into meshlets that a compute pass culls into a compacted indirect draw list.
+	bool m_meshletCulling = false;
+	bool m_frustumCulling = true;
+	bool m_coneCulling = true;
+	uint32_t m_meshletsDrawn = 0;
+
+	Buffer m_meshletBuffer;
+	std::vector<Buffer> m_drawCommandBuffers;
+	std::vector<Buffer> m_drawCountBuffers;
+
+	VkDescriptorSetLayout m_cullDescriptorSetLayout;
+	std::vector<VkDescriptorSet> m_cullDescriptorSets;
+	VkPipelineLayout m_cullPipelineLayout;
+	VkPipeline m_cullPipeline = VK_NULL_HANDLE;
+
+	// Hot reload
+	// Shaders are recompiled in the background, pipelines are rebuilt once the new SPIR-V is cached.
+	// Meshes are imported in the background and swapped in between frames, textures go through TextureDecoder.
+	FileWatcher m_fileWatcher;
+	std::vector<std::future<std::string>> m_shaderCompiles;	// Each yields the source it compiled, empty if it failed.
+	std::future<Mesh> m_meshImport;
+	bool m_meshChangedDuringImport = false;
+
+	// Residency
+	// The mesh is evicted when unused, the texture loses its top mips instead so there's always something to bind.
+	ResidencyId m_meshResidency = 0;
+	ResidencyId m_textureResidency = 0;
 
 	Transform m_transform;
 	
 	Image m_colorImage;
 	Image m_depthImage;
+	VkFormat m_renderPassFormat = VK_FORMAT_UNDEFINED;	// Swap chain format the render pass was created for.
 };
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include "shader_compiler.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <shaderc/shaderc.hpp>
+
+#include "asset_cache.h"
+#include "constants.h"
+
+namespace
+{
+	// Bump when the compile options change, SPIR-V cached by older builds is ignored then.
+	const uint32_t SHADER_CACHE_VERSION = 2;
+
+	std::string ReadSource(const std::filesystem::path& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error("Failed to open shader " + path.generic_string());
+		}
+
+		std::stringstream source;
+		source << file.rdbuf();
+		return source.str();
+	}
+
+	shaderc_shader_kind StageFromExtension(const std::filesystem::path& path)
+	{
+		static const std::unordered_map<std::string, shaderc_shader_kind> stages = {
+			{ ".vert", shaderc_vertex_shader },
+			{ ".frag", shaderc_fragment_shader },
+			{ ".comp", shaderc_compute_shader },
+			{ ".geom", shaderc_geometry_shader },
+			{ ".tesc", shaderc_tess_control_shader },
+			{ ".tese", shaderc_tess_evaluation_shader },
+		};
+
+		auto stage = stages.find(path.extension().string());
+		if (stage == stages.end())
+		{
+			throw std::runtime_error("Unknown shader stage: " + path.generic_string());
+		}
+
+		return stage->second;
+	}
+
+	// Next to the file doing the including first, then the shader directory.
+	std::filesystem::path ResolveInclude(const std::filesystem::path& includingFile, const std::string& requested)
+	{
+		auto relative = includingFile.parent_path() / requested;
+
+		std::error_code error;
+		if (std::filesystem::exists(relative, error))
+		{
+			return relative;
+		}
+
+		return std::filesystem::path(SHADER_DIRECTORY) / requested;
+	}
+
+	// Feeds the file and everything it includes into the hash. The #include lines are scanned as text,
+	// so a changed include invalidates the cached SPIR-V without running the preprocessor.
+	// Both "file" and <file> are followed, Includer resolves them the same way.
+	void HashSource(XXH3_state_t& state, const std::filesystem::path& path, const std::string& source, std::unordered_set<std::string>& visited)
+	{
+		if (!visited.insert(path.lexically_normal().generic_string()).second)
+		{
+			return;
+		}
+
+		XXH3_64bits_update(&state, source.data(), source.size());
+
+		std::istringstream lines(source);
+		for (std::string line; std::getline(lines, line);)
+		{
+			auto directive = line.find_first_not_of(" \t");
+			if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0)
+			{
+				continue;
+			}
+
+			auto open = line.find_first_of("\"<", directive + 8);
+			auto close = open == std::string::npos ? open : line.find(line[open] == '<' ? '>' : '"', open + 1);
+			if (close == std::string::npos)
+			{
+				continue;
+			}
+
+			auto include = ResolveInclude(path, line.substr(open + 1, close - open - 1));
+			HashSource(state, include, ReadSource(include), visited);
+		}
+	}
+
+	class Includer : public shaderc::CompileOptions::IncluderInterface
+	{
+	public:
+		shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type type, const char* requestingSource, size_t includeDepth) override
+		{
+			auto include = std::make_unique<Include>();
+			include->path = ResolveInclude(requestingSource, requestedSource).generic_string();
+
+			try
+			{
+				include->content = ReadSource(include->path);
+			}
+			catch (const std::exception& e)
+			{
+				// An empty name tells shaderc the include failed, the content is the error.
+				include->path.clear();
+				include->content = e.what();
+			}
+
+			include->result.source_name = include->path.c_str();
+			include->result.source_name_length = include->path.size();
+			include->result.content = include->content.c_str();
+			include->result.content_length = include->content.size();
+			include->result.user_data = include.get();
+
+			return &include.release()->result;
+		}
+
+		void ReleaseInclude(shaderc_include_result* result) override
+		{
+			delete static_cast<Include*>(result->user_data);
+		}
+
+	private:
+		struct Include
+		{
+			shaderc_include_result result;
+			std::string path;
+			std::string content;
+		};
+	};
+}
+
+ShaderCode CompileShader(const std::string& path, const std::vector<ShaderDefine>& defines)
+{
+	auto stage = StageFromExtension(path);
+
+	// Read once, the same text is hashed and compiled.
+	auto source = ReadSource(path);
+
+	XXH3_state_t state;
+	XXH3_64bits_reset(&state);
+	XXH3_64bits_update(&state, &SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+	XXH3_64bits_update(&state, &stage, sizeof(stage));
+	for (const auto& define : defines)
+	{
+		// Separated by the terminators, so ("AB", "") and ("A", "B") don't hash the same.
+		XXH3_64bits_update(&state, define.name.c_str(), define.name.size() + 1);
+		XXH3_64bits_update(&state, define.value.c_str(), define.value.size() + 1);
+	}
+
+	std::unordered_set<std::string> visited;
+	HashSource(state, path, source, visited);
+
+	AssetHash hash{ XXH3_64bits_digest(&state) };
+
+	if (auto cached = AssetCache::Get().LoadDerived(hash, ".spv"))
+	{
+		return ShaderCode(std::move(*cached));
+	}
+
+	shaderc::CompileOptions options;
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	options.SetIncluder(std::make_unique<Includer>());
+	// Always, release builds too. Reflection finds bindings and vertex inputs by their names, which the
+	// optimizer strips without it.
+	options.SetGenerateDebugInfo();
+
+	for (const auto& define : defines)
+	{
+		options.AddMacroDefinition(define.name, define.value);
+	}
+
+	// A compiler per call, nothing is shared between threads compiling at the same time.
+	shaderc::Compiler compiler;
+	auto result = compiler.CompileGlslToSpv(source, stage, path.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+	{
+		throw std::runtime_error("Failed to compile " + path + ":\n" + result.GetErrorMessage());
+	}
+
+	std::vector<char> spirv(reinterpret_cast<const char*>(result.cbegin()), reinterpret_cast<const char*>(result.cend()));
+
+	AssetCache::Get().StoreDerived(hash, ".spv", spirv);
+
+	return ShaderCode(std::move(spirv));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Same as #define name value at the top of the source.
+struct ShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+// SPIR-V along with whatever holds it: the asset archive, a mapping of the cached file or, when it couldn't be
+// cached, the compiler's output. Span() stays valid when it's moved, it's passed to vkCreateShaderModule as is.
+class ShaderCode
+{
+public:
+	ShaderCode() = default;
+	explicit ShaderCode(ByteSpan archived) : m_bytes(archived) {}
+	explicit ShaderCode(MappedFile&& file) : m_file(std::move(file)), m_bytes(m_file.Span()) {}
+	explicit ShaderCode(std::vector<char>&& compiled) : m_compiled(std::move(compiled)), m_bytes(m_compiled) {}
+
+	ByteSpan Span() const { return m_bytes; }
+
+private:
+	MappedFile m_file;
+	std::vector<char> m_compiled;
+	ByteSpan m_bytes;
+};
+
+// Compiles a GLSL file to SPIR-V with shaderc, the stage comes from the extension (.vert, .frag, .comp, ...).
+// #include "file" and <file> are looked up next to the including file, then in SHADER_DIRECTORY.
+// The SPIR-V is kept in AssetCache keyed by the source, everything it includes and the defines, so a shader
+// that hasn't changed since the last run isn't compiled at all. Throws with the compiler's log if it fails.
+// Safe to call from several threads at once.
+ShaderCode CompileShader(const std::string& path, const std::vector<ShaderDefine>& defines = {});
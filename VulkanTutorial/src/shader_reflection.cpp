@@ -0,0 +1,743 @@
+#include "shader_reflection.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#endif
+
+#include "vulkan_object_cache.h"
+
+namespace
+{
+	// Only the parts of the SPIR-V spec the declarations need, see the "Binary Form" section.
+	const uint32_t SPIRV_MAGIC = 0x07230203;
+	const size_t SPIRV_HEADER_WORDS = 5;
+
+	enum Op : uint32_t
+	{
+		OpName = 5,
+		OpEntryPoint = 15,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+	};
+
+	enum Decoration : uint32_t
+	{
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationLocation = 30,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35,
+	};
+
+	enum StorageClass : uint32_t
+	{
+		StorageClassUniformConstant = 0,
+		StorageClassInput = 1,
+		StorageClassUniform = 2,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12,
+	};
+
+	enum Dim : uint32_t
+	{
+		DimBuffer = 5,
+		DimSubpassData = 6,
+	};
+
+	VkShaderStageFlagBits StageFromExecutionModel(uint32_t model)
+	{
+		switch (model)
+		{
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		default: throw std::runtime_error("Unsupported shader execution model " + std::to_string(model));
+		}
+	}
+
+	// Everything about one id the declarations care about, filled in by a single pass over the module.
+	struct Id
+	{
+		uint32_t opcode = 0;
+		std::vector<uint32_t> operands;		// Everything after the result id, constants and variables have their result type in front.
+		std::string name;
+
+		uint32_t set = 0;
+		uint32_t binding = UINT32_MAX;
+		uint32_t location = UINT32_MAX;
+		uint32_t arrayStride = 0;
+		bool builtIn = false;
+		bool bufferBlock = false;
+
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> memberMatrixStrides;
+	};
+
+	class Module
+	{
+	public:
+		explicit Module(ByteSpan spirv)
+		{
+			if (spirv.size % sizeof(uint32_t) != 0 || spirv.size < SPIRV_HEADER_WORDS * sizeof(uint32_t))
+			{
+				throw std::runtime_error("SPIR-V has to be a whole number of words");
+			}
+
+			// The code can come straight out of a mapped archive, copy instead of assuming it's aligned.
+			m_words.resize(spirv.size / sizeof(uint32_t));
+			std::memcpy(m_words.data(), spirv.data, spirv.size);
+
+			if (m_words[0] != SPIRV_MAGIC)
+			{
+				throw std::runtime_error("Not SPIR-V, or the wrong endianness");
+			}
+
+			m_ids.resize(m_words[3]);	// The id bound.
+
+			for (size_t i = SPIRV_HEADER_WORDS; i < m_words.size();)
+			{
+				uint32_t wordCount = m_words[i] >> 16;
+				uint32_t opcode = m_words[i] & 0xFFFF;
+				if (wordCount == 0 || i + wordCount > m_words.size())
+				{
+					throw std::runtime_error("Truncated SPIR-V instruction");
+				}
+
+				Parse(opcode, &m_words[i + 1], wordCount - 1);
+				i += wordCount;
+			}
+		}
+
+		ShaderReflection Reflect() const
+		{
+			if (m_entryPoints != 1)
+			{
+				throw std::runtime_error("Reflection expects exactly one entry point per module");
+			}
+
+			ShaderReflection reflection;
+			reflection.stage = m_stage;
+
+			for (uint32_t variableId : m_variables)
+			{
+				const auto& variable = m_ids[variableId];
+				uint32_t storageClass = variable.operands[1];
+				const auto& pointer = Get(variable.operands[0]);
+				uint32_t typeId = pointer.operands[1];
+
+				switch (storageClass)
+				{
+				case StorageClassUniformConstant:
+				case StorageClassUniform:
+				case StorageClassStorageBuffer:
+				{
+					ReflectedBinding binding;
+					binding.set = variable.set;
+					binding.binding = variable.binding;
+					binding.stages = m_stage;
+
+					// Arrays of descriptors, e.g. sampler2D textures[4].
+					const Id* type = &Get(typeId);
+					if (type->opcode == OpTypeRuntimeArray)
+					{
+						throw std::runtime_error("Unsized descriptor arrays aren't supported");
+					}
+					if (type->opcode == OpTypeArray)
+					{
+						binding.count = Constant(type->operands[1]);
+						typeId = type->operands[0];
+						type = &Get(typeId);
+					}
+
+					binding.type = DescriptorType(storageClass, *type);
+					binding.name = !variable.name.empty() ? variable.name : type->name;
+
+					if (variable.binding == UINT32_MAX)
+					{
+						throw std::runtime_error("Descriptor " + binding.name + " has no binding");
+					}
+
+					reflection.bindings.push_back(binding);
+					break;
+				}
+
+				case StorageClassPushConstant:
+				{
+					const auto& block = Get(typeId);
+					uint32_t begin = UINT32_MAX;
+					for (uint32_t offset : block.memberOffsets)
+					{
+						begin = std::min(begin, offset);
+					}
+
+					VkPushConstantRange range{};
+					{
+						range.stageFlags = m_stage;
+						range.offset = begin == UINT32_MAX ? 0 : begin;
+						range.size = Size(typeId) - range.offset;
+					}
+
+					reflection.pushConstants.push_back(range);
+					break;
+				}
+
+				case StorageClassInput:
+				{
+					// Built-ins (gl_VertexIndex, ...) don't come from a vertex buffer. Other stages' inputs come from the previous stage.
+					if (m_stage != VK_SHADER_STAGE_VERTEX_BIT || variable.builtIn || Get(typeId).opcode == OpTypeStruct)
+					{
+						break;
+					}
+
+					ReflectedInput input;
+					input.name = variable.name;
+					input.location = variable.location;
+					input.format = Format(Get(typeId));
+					reflection.inputs.push_back(input);
+					break;
+				}
+				}
+			}
+
+			return reflection;
+		}
+
+	private:
+		void Parse(uint32_t opcode, const uint32_t* operands, uint32_t count)
+		{
+			switch (opcode)
+			{
+			case OpName:
+				if (count >= 2)
+				{
+					At(operands[0]).name = String(operands + 1, count - 1);
+				}
+				break;
+
+			case OpEntryPoint:
+				m_stage = StageFromExecutionModel(operands[0]);
+				++m_entryPoints;
+				break;
+
+			case OpDecorate:
+			{
+				auto& id = At(operands[0]);
+				uint32_t value = count >= 3 ? operands[2] : 0;
+				switch (operands[1])
+				{
+				case DecorationBufferBlock: id.bufferBlock = true; break;
+				case DecorationArrayStride: id.arrayStride = value; break;
+				case DecorationBuiltIn: id.builtIn = true; break;
+				case DecorationLocation: id.location = value; break;
+				case DecorationBinding: id.binding = value; break;
+				case DecorationDescriptorSet: id.set = value; break;
+				}
+				break;
+			}
+
+			case OpMemberDecorate:
+			{
+				auto& id = At(operands[0]);
+				uint32_t member = operands[1];
+				uint32_t value = count >= 4 ? operands[3] : 0;
+				if (operands[2] == DecorationOffset)
+				{
+					Grow(id.memberOffsets, member)[member] = value;
+				}
+				else if (operands[2] == DecorationMatrixStride)
+				{
+					Grow(id.memberMatrixStrides, member)[member] = value;
+				}
+				break;
+			}
+
+			case OpTypeInt:
+			case OpTypeFloat:
+			case OpTypeVector:
+			case OpTypeMatrix:
+			case OpTypeImage:
+			case OpTypeSampler:
+			case OpTypeSampledImage:
+			case OpTypeArray:
+			case OpTypeRuntimeArray:
+			case OpTypeStruct:
+			case OpTypePointer:
+				Define(opcode, operands[0], operands + 1, count - 1);
+				break;
+
+			case OpConstant:
+			case OpVariable:
+				// Result type first, then the result id. Kept as (result type, value) and (pointer type, storage class).
+				Define(opcode, operands[1], operands + 2, count - 2);
+				At(operands[1]).operands.insert(At(operands[1]).operands.begin(), operands[0]);
+				if (opcode == OpVariable)
+				{
+					m_variables.push_back(operands[1]);
+				}
+				break;
+			}
+		}
+
+		void Define(uint32_t opcode, uint32_t result, const uint32_t* operands, uint32_t count)
+		{
+			auto& id = At(result);
+			id.opcode = opcode;
+			id.operands.assign(operands, operands + count);
+		}
+
+		Id& At(uint32_t id)
+		{
+			if (id >= m_ids.size())
+			{
+				throw std::runtime_error("SPIR-V id is out of bounds");
+			}
+
+			return m_ids[id];
+		}
+
+		const Id& Get(uint32_t id) const
+		{
+			if (id >= m_ids.size() || m_ids[id].opcode == 0)
+			{
+				throw std::runtime_error("SPIR-V refers to an undefined id");
+			}
+
+			return m_ids[id];
+		}
+
+		static std::vector<uint32_t>& Grow(std::vector<uint32_t>& values, uint32_t index)
+		{
+			if (values.size() <= index)
+			{
+				values.resize(index + 1, 0);
+			}
+
+			return values;
+		}
+
+		// Literal strings are nul terminated and padded out to a whole word.
+		static std::string String(const uint32_t* words, uint32_t count)
+		{
+			auto chars = reinterpret_cast<const char*>(words);
+			return std::string(chars, strnlen(chars, count * sizeof(uint32_t)));
+		}
+
+		uint32_t Constant(uint32_t id) const
+		{
+			const auto& constant = Get(id);
+			if (constant.opcode != OpConstant || constant.operands.size() < 2)
+			{
+				throw std::runtime_error("Array sizes have to be constants, not specialization constants");
+			}
+
+			return constant.operands[1];
+		}
+
+		// Bytes the type takes up in a block, with the strides the compiler decorated it with.
+		uint32_t Size(uint32_t typeId, uint32_t matrixStride = 0) const
+		{
+			const auto& type = Get(typeId);
+			switch (type.opcode)
+			{
+			case OpTypeInt:
+			case OpTypeFloat:
+				return type.operands[0] / 8;
+
+			case OpTypeVector:
+				return type.operands[1] * Size(type.operands[0]);
+
+			case OpTypeMatrix:
+				return type.operands[1] * (matrixStride ? matrixStride : Size(type.operands[0]));
+
+			case OpTypeArray:
+				return Constant(type.operands[1]) * (type.arrayStride ? type.arrayStride : Size(type.operands[0]));
+
+			case OpTypeRuntimeArray:
+				return 0;
+
+			case OpTypeStruct:
+			{
+				uint32_t size = 0;
+				for (size_t member = 0; member < type.operands.size(); ++member)
+				{
+					uint32_t offset = member < type.memberOffsets.size() ? type.memberOffsets[member] : 0;
+					uint32_t stride = member < type.memberMatrixStrides.size() ? type.memberMatrixStrides[member] : 0;
+					size = std::max(size, offset + Size(type.operands[member], stride));
+				}
+				return size;
+			}
+
+			default:
+				throw std::runtime_error("Can't size a SPIR-V type with opcode " + std::to_string(type.opcode));
+			}
+		}
+
+		static VkDescriptorType DescriptorType(uint32_t storageClass, const Id& type)
+		{
+			if (storageClass == StorageClassStorageBuffer)
+			{
+				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			}
+
+			if (storageClass == StorageClassUniform)
+			{
+				// Older SPIR-V marks storage buffers as BufferBlock in the Uniform storage class.
+				return type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			}
+
+			switch (type.opcode)
+			{
+			case OpTypeSampler:
+				return VK_DESCRIPTOR_TYPE_SAMPLER;
+
+			case OpTypeSampledImage:
+				return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+			case OpTypeImage:
+			{
+				// Sampled type, Dim, Depth, Arrayed, MS, Sampled (1 - with a sampler, 2 - storage)
+				uint32_t dim = type.operands[1];
+				uint32_t sampled = type.operands[5];
+				if (dim == DimSubpassData)
+				{
+					return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				}
+				if (dim == DimBuffer)
+				{
+					return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				}
+				return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			}
+
+			default:
+				throw std::runtime_error("Unsupported descriptor type " + (type.name.empty() ? std::to_string(type.opcode) : type.name));
+			}
+		}
+
+		VkFormat Format(const Id& type) const
+		{
+			uint32_t components = 1;
+			const Id* scalar = &type;
+			if (type.opcode == OpTypeVector)
+			{
+				components = type.operands[1];
+				scalar = &Get(type.operands[0]);
+			}
+
+			// Width first, then signedness for ints.
+			uint32_t width = scalar->operands[0];
+			if (width != 32 || components < 1 || components > 4)
+			{
+				throw std::runtime_error("Unsupported vertex input type");
+			}
+
+			static const VkFormat floats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+			static const VkFormat ints[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+			static const VkFormat uints[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+			switch (scalar->opcode)
+			{
+			case OpTypeFloat: return floats[components - 1];
+			case OpTypeInt: return scalar->operands[1] ? ints[components - 1] : uints[components - 1];
+			default: throw std::runtime_error("Unsupported vertex input type");
+			}
+		}
+
+		std::vector<uint32_t> m_words;
+		std::vector<Id> m_ids;
+		std::vector<uint32_t> m_variables;
+		VkShaderStageFlagBits m_stage = VK_SHADER_STAGE_ALL;
+		uint32_t m_entryPoints = 0;
+	};
+}
+
+const ShaderReflection& ReflectShader(ByteSpan spirv)
+{
+	static std::mutex mutex;
+	static std::unordered_map<XXH64_hash_t, std::unique_ptr<ShaderReflection>> reflections;
+
+	auto hash = XXH3_64bits(spirv.data, spirv.size);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = reflections.find(hash);
+		if (it != reflections.end())
+		{
+			return *it->second;
+		}
+	}
+
+	// Parsed outside the lock, two threads reflecting the same code both parse it and the first one wins.
+	auto reflection = std::make_unique<ShaderReflection>(Module(spirv).Reflect());
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return *reflections.emplace(hash, std::move(reflection)).first->second;
+}
+
+PipelineReflection::PipelineReflection(std::initializer_list<ByteSpan> stages)
+{
+	// Keyed by (set, binding) so the result comes out sorted.
+	std::map<std::pair<uint32_t, uint32_t>, ReflectedBinding> bindings;
+
+	for (const auto& spirv : stages)
+	{
+		const auto& stage = ReflectShader(spirv);
+
+		for (const auto& binding : stage.bindings)
+		{
+			auto [it, inserted] = bindings.try_emplace({ binding.set, binding.binding }, binding);
+			if (inserted)
+			{
+				continue;
+			}
+
+			// Declared by more than one stage, e.g. the UBO used by both the vertex and fragment shader.
+			auto& existing = it->second;
+			if (existing.type != binding.type || existing.count != binding.count)
+			{
+				throw std::runtime_error("Stages disagree about set " + std::to_string(binding.set) + " binding " + std::to_string(binding.binding));
+			}
+			existing.stages |= binding.stages;
+		}
+
+		// One range covering every stage's block. Stages sharing a block see the same bytes,
+		// and vkCmdPushConstants only has to name every stage once.
+		for (const auto& range : stage.pushConstants)
+		{
+			if (m_pushConstants.empty())
+			{
+				m_pushConstants.push_back(range);
+				continue;
+			}
+
+			auto& merged = m_pushConstants.front();
+			uint32_t end = std::max(merged.offset + merged.size, range.offset + range.size);
+			merged.offset = std::min(merged.offset, range.offset);
+			merged.size = end - merged.offset;
+			merged.stageFlags |= range.stageFlags;
+		}
+
+		if (stage.stage == VK_SHADER_STAGE_VERTEX_BIT)
+		{
+			m_inputs = stage.inputs;
+		}
+	}
+
+	for (auto& [key, binding] : bindings)
+	{
+		m_bindings.push_back(binding);
+	}
+}
+
+const ReflectedBinding& PipelineReflection::Find(const std::string& name) const
+{
+	auto it = std::find_if(m_bindings.begin(), m_bindings.end(), [&name](const ReflectedBinding& binding) { return binding.name == name; });
+	if (it == m_bindings.end())
+	{
+		throw std::runtime_error("No shader stage declares " + name);
+	}
+
+	return *it;
+}
+
+uint32_t PipelineReflection::SetCount() const
+{
+	return m_bindings.empty() ? 0 : m_bindings.back().set + 1;
+}
+
+VkDescriptorSetLayout PipelineReflection::SetLayout(uint32_t set) const
+{
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+	for (const auto& binding : m_bindings)
+	{
+		if (binding.set != set)
+		{
+			continue;
+		}
+
+		VkDescriptorSetLayoutBinding layoutBinding{};
+		{
+			layoutBinding.binding = binding.binding;
+			layoutBinding.descriptorType = binding.type;
+			layoutBinding.descriptorCount = binding.count;
+			layoutBinding.stageFlags = binding.stages;
+		}
+
+		layoutBindings.push_back(layoutBinding);
+	}
+
+	VkDescriptorSetLayoutCreateInfo createInfo{};
+	{
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		createInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+		createInfo.pBindings = layoutBindings.data();
+	}
+
+	return VulkanObjectCache::Get().GetDescriptorSetLayout(createInfo);
+}
+
+VkPipelineLayout PipelineReflection::PipelineLayout() const
+{
+	std::vector<VkDescriptorSetLayout> setLayouts;
+	for (uint32_t set = 0; set < SetCount(); ++set)
+	{
+		setLayouts.push_back(SetLayout(set));
+	}
+
+	VkPipelineLayoutCreateInfo createInfo{};
+	{
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		createInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		createInfo.pSetLayouts = setLayouts.data();
+		createInfo.pushConstantRangeCount = static_cast<uint32_t>(m_pushConstants.size());
+		createInfo.pPushConstantRanges = m_pushConstants.data();
+	}
+
+	return VulkanObjectCache::Get().GetPipelineLayout(createInfo);
+}
+
+std::vector<VkDescriptorPoolSize> PipelineReflection::PoolSizes(uint32_t setCount) const
+{
+	std::map<VkDescriptorType, uint32_t> counts;
+	for (const auto& binding : m_bindings)
+	{
+		counts[binding.type] += binding.count * setCount;
+	}
+
+	std::vector<VkDescriptorPoolSize> sizes;
+	for (const auto& [type, count] : counts)
+	{
+		sizes.push_back({ type, count });
+	}
+
+	return sizes;
+}
+
+VertexInputState PipelineReflection::VertexInput(const VertexStreamAttribute* streams, size_t streamCount, const VkVertexInputBindingDescription* bindings, size_t bindingCount) const
+{
+	VertexInputState state;
+
+	for (const auto& input : m_inputs)
+	{
+		auto stream = std::find_if(streams, streams + streamCount, [&input](const VertexStreamAttribute& stream) { return input.name == stream.name; });
+		if (stream == streams + streamCount)
+		{
+			throw std::runtime_error("No vertex stream provides " + input.name);
+		}
+
+		VkVertexInputAttributeDescription attribute{};
+		{
+			attribute.binding = stream->binding;
+			attribute.location = input.location;
+			attribute.format = input.format;
+			attribute.offset = stream->offset;
+		}
+
+		state.attributes.push_back(attribute);
+	}
+
+	for (size_t i = 0; i < bindingCount; ++i)
+	{
+		bool used = std::any_of(state.attributes.begin(), state.attributes.end(), [&](const VkVertexInputAttributeDescription& attribute) { return attribute.binding == bindings[i].binding; });
+		if (used)
+		{
+			state.bindings.push_back(bindings[i]);
+		}
+	}
+
+	return state;
+}
+
+const ReflectedBinding& DescriptorWriter::FindInSet(const std::string& name) const
+{
+	const auto& binding = m_reflection.Find(name);
+	if (binding.set != m_set)
+	{
+		throw std::runtime_error(name + " isn't in set " + std::to_string(m_set));
+	}
+
+	return binding;
+}
+
+DescriptorWriter& DescriptorWriter::Buffer(const std::string& name, const VkDescriptorBufferInfo& info)
+{
+	m_resources.push_back({ &FindInSet(name), info, {} });
+	return *this;
+}
+
+DescriptorWriter& DescriptorWriter::Image(const std::string& name, const VkDescriptorImageInfo& info)
+{
+	m_resources.push_back({ &FindInSet(name), {}, info });
+	return *this;
+}
+
+void DescriptorWriter::Validate() const
+{
+	for (const auto& binding : m_reflection.Bindings())
+	{
+		bool provided = std::any_of(m_resources.begin(), m_resources.end(), [&binding](const Resource& resource) { return resource.binding == &binding; });
+		if (binding.set == m_set && !provided)
+		{
+			throw std::runtime_error("Nothing bound to " + binding.name);
+		}
+	}
+}
+
+void DescriptorWriter::Update(VkDescriptorSet descriptorSet) const
+{
+	Validate();
+
+	std::vector<VkWriteDescriptorSet> writes;
+	for (const auto& resource : m_resources)
+	{
+		bool isImage = resource.binding->type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			resource.binding->type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+			resource.binding->type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+			resource.binding->type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+			resource.binding->type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+
+		VkWriteDescriptorSet write{};
+		{
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = descriptorSet;
+			write.dstBinding = resource.binding->binding;
+			write.dstArrayElement = 0;
+			write.descriptorType = resource.binding->type;
+			write.descriptorCount = 1;
+			write.pBufferInfo = isImage ? nullptr : &resource.bufferInfo;
+			write.pImageInfo = isImage ? &resource.imageInfo : nullptr;
+		}
+
+		writes.push_back(write);
+	}
+
+	vkUpdateDescriptorSets(VulkanManager::GetVulkanManager().GetDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
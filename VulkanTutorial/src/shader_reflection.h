@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "mapped_file.h"
+#include "vertex.h"
+
+// A descriptor a shader declares. Named after its variable, or after its block for blocks without an instance name
+// (e.g. "ubo" for "uniform UniformBufferObject { ... } ubo", "Meshlets" for "buffer Meshlets { ... }").
+struct ReflectedBinding
+{
+	std::string name;
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	uint32_t count = 1;
+	VkShaderStageFlags stages = 0;
+};
+
+// A vertex shader input that isn't a built-in.
+struct ReflectedInput
+{
+	std::string name;
+	uint32_t location = 0;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+};
+
+// What one shader stage declares.
+struct ShaderReflection
+{
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+	std::vector<ReflectedBinding> bindings;
+	std::vector<VkPushConstantRange> pushConstants;	// At most one, a stage only has one push constant block.
+	std::vector<ReflectedInput> inputs;				// Only filled in for vertex shaders.
+};
+
+// Parses the declarations out of SPIR-V. Results are kept by a hash of the code, reflecting
+// the same shader again (e.g. for another permutation or after a resize) is a lookup.
+const ShaderReflection& ReflectShader(ByteSpan spirv);
+
+struct VertexInputState
+{
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+// Every stage of one pipeline merged, the single source for its set layouts, pipeline layout,
+// descriptor pool sizes and vertex input. Layouts come from VulkanObjectCache.
+class PipelineReflection
+{
+public:
+	PipelineReflection() = default;
+	PipelineReflection(std::initializer_list<ByteSpan> stages);
+
+	const std::vector<ReflectedBinding>& Bindings() const { return m_bindings; }
+
+	// Throws if no stage declares it.
+	const ReflectedBinding& Find(const std::string& name) const;
+
+	// Highest set number used plus one, sets in between that nothing uses get an empty layout.
+	uint32_t SetCount() const;
+	VkDescriptorSetLayout SetLayout(uint32_t set) const;
+	VkPipelineLayout PipelineLayout() const;
+
+	// Exactly what setCount copies of every set need, no more.
+	std::vector<VkDescriptorPoolSize> PoolSizes(uint32_t setCount) const;
+
+	// Inputs are matched to the vertex streams by name, locations and formats come from the shader.
+	// Only bindings that something reads from are included.
+	template<size_t StreamCount, size_t BindingCount>
+	VertexInputState VertexInput(const std::array<VertexStreamAttribute, StreamCount>& streams, const std::array<VkVertexInputBindingDescription, BindingCount>& bindings) const
+	{
+		return VertexInput(streams.data(), streams.size(), bindings.data(), bindings.size());
+	}
+
+private:
+	VertexInputState VertexInput(const VertexStreamAttribute* streams, size_t streamCount, const VkVertexInputBindingDescription* bindings, size_t bindingCount) const;
+
+	std::vector<ReflectedBinding> m_bindings;	// Sorted by set, then binding.
+	std::vector<VkPushConstantRange> m_pushConstants;
+	std::vector<ReflectedInput> m_inputs;
+};
+
+// Fills a descriptor set by the names the shaders use, so the binding numbers only live in the shaders.
+// Throws if a name isn't in the set.
+class DescriptorWriter
+{
+public:
+	DescriptorWriter(const PipelineReflection& reflection, uint32_t set = 0) : m_reflection(reflection), m_set(set) {}
+
+	DescriptorWriter& Buffer(const std::string& name, const VkDescriptorBufferInfo& info);
+	DescriptorWriter& Image(const std::string& name, const VkDescriptorImageInfo& info);
+
+	// Throws if a binding in the set was never given anything. Update checks too, this is for
+	// finding out before anything is destroyed.
+	void Validate() const;
+	void Update(VkDescriptorSet descriptorSet) const;
+
+private:
+	struct Resource
+	{
+		const ReflectedBinding* binding;
+		VkDescriptorBufferInfo bufferInfo;
+		VkDescriptorImageInfo imageInfo;
+	};
+
+	const ReflectedBinding& FindInSet(const std::string& name) const;
+
+	const PipelineReflection& m_reflection;
+	uint32_t m_set;
+	std::vector<Resource> m_resources;
+};
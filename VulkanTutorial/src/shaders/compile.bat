@@ -1,3 +0,0 @@
-C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe vs.vert -o vert.spv
-C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe fs.frag -o frag.spv
-pause
\ No newline at end of file
@@ -1,19 +1,64 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// Material permutation, see MaterialPermutation. Set when the pipeline is created,
+// so everything a variant doesn't use is compiled out.
+layout(constant_id = 0) const bool TEXTURED = true;
+layout(constant_id = 1) const bool VERTEX_COLOR = true;
+layout(constant_id = 2) const uint LIGHT_COUNT = 1;
+layout(constant_id = 3) const bool ALPHA_TEST = false;
+layout(constant_id = 4) const float ALPHA_CUTOFF = 0.5;
+
+// Has to match MATERIAL_MAX_LIGHTS.
+const uint MAX_LIGHTS = 4;
+const vec3 LIGHT_DIRECTIONS[MAX_LIGHTS] = vec3[](
+	vec3(1, -1, 0),
+	vec3(-1, 0, 1),
+	vec3(0, 1, 1),
+	vec3(0, -1, -1)
+);
+
 layout(binding = 1) uniform sampler2D texSampler;
+layout(binding = 3) uniform sampler2DArray atlasSampler;	// Every material texture small enough to share one image.
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragUv;
 layout(location = 2) in vec3 fragNormal;
-layout(location = 3) in vec3 fragLightDir;
+layout(location = 3) flat in int fragLayer;
+
+layout(location = 0) out vec4 outColor;
 
 void main()
 {
-	vec3 lightDir = vec3(1, -1, 0);
-	float ldotn = dot(lightDir, fragNormal);
+	vec4 albedo = vec4(1.0);
+	if (TEXTURED)
+	{
+		// Gradients are taken before branching, a quad can straddle triangles of different materials.
+		vec2 dx = dFdx(fragUv);
+		vec2 dy = dFdy(fragUv);
+		albedo = fragLayer < 0 ? textureGrad(texSampler, fragUv, dx, dy) : textureGrad(atlasSampler, vec3(fragUv, fragLayer), dx, dy);
+	}
+
+	if (ALPHA_TEST && albedo.a < ALPHA_CUTOFF)
+	{
+		discard;
+	}
+
+	vec3 color = albedo.rgb;
+	if (VERTEX_COLOR)
+	{
+		color *= fragColor;
+	}
+
+	if (LIGHT_COUNT > 0)
+	{
+		float lighting = 0.0;
+		for (uint i = 0; i < min(LIGHT_COUNT, MAX_LIGHTS); ++i)
+		{
+			lighting += max(dot(LIGHT_DIRECTIONS[i], fragNormal), 0.0);
+		}
+		color *= lighting;
+	}
 
-	vec3 color = fragColor * texture(texSampler, fragUv).rgb; 
-	color *= ldotn;
-    outColor = vec4(color, 1.0);
-}
\ No newline at end of file
+	outColor = vec4(color, 1.0);
+}
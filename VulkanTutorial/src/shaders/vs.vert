@@ -8,21 +8,35 @@ layout(binding = 0) uniform UniformBufferObject
 	mat4 proj;
 } ubo;
 
+// Where each material's texture sits in the atlas, see SampleModel::CreateTextureAtlas.
+struct MaterialRegion
+{
+	vec4 uvTransform;	// xy - scale, zw - offset
+	int layer;			// -1 if the material samples texSampler instead
+};
+
+layout(std430, binding = 2) readonly buffer Materials
+{
+	MaterialRegion regions[];
+};
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inUv;
 layout(location = 3) in vec3 inNormal;
+layout(location = 4) in uint inMaterial;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragUv;
 layout(location = 2) out vec3 fragNormal;
+layout(location = 3) flat out int fragLayer;
 
 void main() 
 {
     gl_Position = ubo.proj * ubo.view *  ubo.model * vec4(inPosition, 1.0);
-	fragUv = inUv;
+	MaterialRegion region = regions[inMaterial];
+	fragUv = inUv * region.uvTransform.xy + region.uvTransform.zw;
+	fragLayer = region.layer;
     fragColor = inColor;
 	fragNormal = inNormal;
-	
-	fragLightDir = inLightDir;
 }
\ No newline at end of file
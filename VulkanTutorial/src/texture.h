@@ -1,17 +1,52 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
 #ifndef STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #endif
 
+#include <ktx.h>
+
+#include "mapped_file.h"
+
+// One mip level inside the image data Texture::Load writes.
+struct TextureLevel
+{
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t width;
+	uint32_t height;
+};
+
+// The image data is written out by Load. KTX2 levels that are stored as they are go straight from the file
+// into the caller's memory (e.g. a mapped staging buffer), only their header is read up front. stb images and
+// transcoded or supercompressed KTX2 textures are decoded into memory of their own and copied by Load.
 class Texture
 {
 public:
-	Texture(const char* path)
+	// supportsBC picks what Basis Universal textures are transcoded to.
+	Texture(const char* path, bool supportsBC = true)
 	{
-		// Get image
-		m_pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+		std::string extension = path;
+		extension = extension.substr(extension.find_last_of('.') + 1);
+
+		if (extension == "ktx2" || extension == "KTX2")
+		{
+			LoadKtx2(path, supportsBC);
+			return;
+		}
+
+		// Get image, decoded straight out of the mapping instead of through stdio.
+		MappedFile file(path, MappedFileAccess::Sequential);
+		m_pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file.Data()), static_cast<int>(file.Size()), &width, &height, &channels, STBI_rgb_alpha);
 
 		//if (!m_pixels)
 		//{
@@ -19,12 +54,133 @@ public:
 		//}
 	}
 
+	// KTX2 data already in memory, e.g. out of the asset archive. It has to stay valid until Load.
+	Texture(const void* data, size_t size, bool supportsBC = true)
+	{
+		auto result = ktxTexture2_CreateFromMemory(static_cast<const ktx_uint8_t*>(data), size, KTX_TEXTURE_CREATE_NO_FLAGS, &m_ktx);
+		if (result != KTX_SUCCESS)
+		{
+			throw std::runtime_error(std::string("Failed to load cooked KTX2 texture (") + ktxErrorString(result) + ")");
+		}
+
+		PrepareKtx2("cooked texture", supportsBC);
+	}
+
 	void Free()
 	{
+		m_file = MappedFile();
+
+		if (m_ktx)
+		{
+			ktxTexture_Destroy(ktxTexture(m_ktx));
+			m_ktx = nullptr;
+			return;
+		}
+
 		// We loaded everything into data so we can now clean up pixels.
 		stbi_image_free(m_pixels);
+		m_pixels = nullptr;
+	}
+
+	// False if the image couldn't be decoded.
+	bool IsValid() const { return m_ktx != nullptr || m_pixels != nullptr; }
+
+	// KTX2 files come with all their mip levels, stb images only have the base level.
+	bool HasMipChain() const { return m_ktx != nullptr; }
+
+	// Writes Size() bytes of image data, laid out as m_levels describes, to destination.
+	void Load(void* destination)
+	{
+		if (!m_ktx)
+		{
+			memcpy(destination, m_pixels, static_cast<size_t>(Size()));
+			return;
+		}
+
+		if (auto data = ktxTexture_GetData(ktxTexture(m_ktx)))
+		{
+			memcpy(destination, data, static_cast<size_t>(Size()));
+			return;
+		}
+
+		auto result = ktxTexture_LoadImageData(ktxTexture(m_ktx), static_cast<ktx_uint8_t*>(destination), static_cast<ktx_size_t>(Size()));
+		if (result != KTX_SUCCESS)
+		{
+			throw std::runtime_error(std::string("Failed to read KTX2 image data (") + ktxErrorString(result) + ")");
+		}
 	}
 
+	VkDeviceSize Size() const { return m_ktx ? ktxTexture_GetDataSize(ktxTexture(m_ktx)) : static_cast<VkDeviceSize>(width) * height * 4; }	// Multiply by 4 for each channel RGBA
+
 	int width, height, channels;
-	stbi_uc* m_pixels;
-};
\ No newline at end of file
+	stbi_uc* m_pixels = nullptr;
+
+	VkFormat m_format = VK_FORMAT_R8G8B8A8_SRGB;
+	std::vector<TextureLevel> m_levels;
+
+private:
+	void LoadKtx2(const char* path, bool supportsBC)
+	{
+		// Kept mapped until Load reads the levels out of it.
+		m_file = MappedFile(path, MappedFileAccess::Sequential);
+		auto result = ktxTexture2_CreateFromMemory(reinterpret_cast<const ktx_uint8_t*>(m_file.Data()), m_file.Size(), KTX_TEXTURE_CREATE_NO_FLAGS, &m_ktx);
+		if (result != KTX_SUCCESS)
+		{
+			throw std::runtime_error(std::string("Failed to load KTX2 texture: ") + path + " (" + ktxErrorString(result) + ")");
+		}
+
+		PrepareKtx2(path, supportsBC);
+	}
+
+	void PrepareKtx2(const char* name, bool supportsBC)
+	{
+		// Supercompressed levels have to be inflated by libktx before they can be used or transcoded,
+		// only plain ones are left for Load to read in place.
+		if (ktxTexture2_NeedsTranscoding(m_ktx) || m_ktx->supercompressionScheme != KTX_SS_NONE)
+		{
+			auto result = ktxTexture_LoadImageData(ktxTexture(m_ktx), nullptr, 0);
+			if (result != KTX_SUCCESS)
+			{
+				Free();
+				throw std::runtime_error(std::string("Failed to read KTX2 texture: ") + name + " (" + ktxErrorString(result) + ")");
+			}
+		}
+
+		// Basis Universal (ETC1S/UASTC) textures are transcoded once here.
+		// BC7 keeps most of UASTC's quality, RGBA8 is the fallback for devices without BC support.
+		if (ktxTexture2_NeedsTranscoding(m_ktx))
+		{
+			auto result = ktxTexture2_TranscodeBasis(m_ktx, supportsBC ? KTX_TTF_BC7_RGBA : KTX_TTF_RGBA32, 0);
+			if (result != KTX_SUCCESS)
+			{
+				Free();
+				throw std::runtime_error(std::string("Failed to transcode KTX2 texture: ") + name + " (" + ktxErrorString(result) + ")");
+			}
+		}
+
+		// BC1/BC3/BC5/BC7 files are used as they are.
+		m_format = static_cast<VkFormat>(m_ktx->vkFormat);
+		width = static_cast<int>(m_ktx->baseWidth);
+		height = static_cast<int>(m_ktx->baseHeight);
+		channels = 4;
+
+		for (uint32_t level = 0; level < m_ktx->numLevels; ++level)
+		{
+			ktx_size_t offset = 0;
+			ktxTexture_GetImageOffset(ktxTexture(m_ktx), level, 0, 0, &offset);
+
+			TextureLevel textureLevel{};
+			{
+				textureLevel.offset = offset;
+				textureLevel.size = ktxTexture_GetImageSize(ktxTexture(m_ktx), level);
+				textureLevel.width = std::max(1u, m_ktx->baseWidth >> level);
+				textureLevel.height = std::max(1u, m_ktx->baseHeight >> level);
+			}
+
+			m_levels.push_back(textureLevel);
+		}
+	}
+
+	ktxTexture2* m_ktx = nullptr;
+	MappedFile m_file;	// KTX2 file the levels are read from, empty for stb images and in-memory data.
+};
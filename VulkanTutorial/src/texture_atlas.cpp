@@ -0,0 +1,291 @@
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "buffer.h"
+#include "vulkan_manager.h"
+
+// imgui_draw.cpp compiles its own static copy for the font atlas.
+#ifndef STB_RECT_PACK_IMPLEMENTATION
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../libs/imgui/imstb_rectpack.h"
+#endif
+
+namespace
+{
+	struct Placement
+	{
+		uint32_t layer;
+		uint32_t x;
+		uint32_t y;
+	};
+
+	uint32_t AlignUp(uint32_t value, uint32_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Mips are averaged in linear space, same as the blits for sRGB images do.
+	float SrgbToLinear(uint8_t value)
+	{
+		static const auto table = []()
+		{
+			std::vector<float> linear(256);
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				float srgb = i / 255.0f;
+				linear[i] = srgb <= 0.04045f ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+			}
+			return linear;
+		}();
+
+		return table[value];
+	}
+
+	uint8_t LinearToSrgb(float value)
+	{
+		float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+		return static_cast<uint8_t>(std::clamp(srgb * 255.0f + 0.5f, 0.0f, 255.0f));
+	}
+
+	// 2x2 box filter, alpha is linear to begin with.
+	void Downsample(const uint8_t* source, uint32_t sourceSize, uint8_t* destination)
+	{
+		const uint32_t size = sourceSize / 2;
+
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			for (uint32_t x = 0; x < size; ++x)
+			{
+				const uint8_t* texels[4] = {
+					source + ((2 * y) * sourceSize + 2 * x) * 4,
+					source + ((2 * y) * sourceSize + 2 * x + 1) * 4,
+					source + ((2 * y + 1) * sourceSize + 2 * x) * 4,
+					source + ((2 * y + 1) * sourceSize + 2 * x + 1) * 4,
+				};
+
+				uint8_t* texel = destination + (y * size + x) * 4;
+				for (uint32_t channel = 0; channel < 3; ++channel)
+				{
+					float sum = 0.0f;
+					for (auto sourceTexel : texels)
+					{
+						sum += SrgbToLinear(sourceTexel[channel]);
+					}
+					texel[channel] = LinearToSrgb(sum * 0.25f);
+				}
+
+				uint32_t alpha = 0;
+				for (auto sourceTexel : texels)
+				{
+					alpha += sourceTexel[3];
+				}
+				texel[3] = static_cast<uint8_t>((alpha + 2) / 4);
+			}
+		}
+	}
+}
+
+size_t TextureAtlas::LevelOffset(uint32_t layer, uint32_t level) const
+{
+	size_t layerSize = 0;
+	size_t levelOffset = 0;
+	for (uint32_t i = 0; i < mipLevels; ++i)
+	{
+		size_t levelSize = static_cast<size_t>(size >> i) * (size >> i) * 4;
+		if (i < level)
+		{
+			levelOffset += levelSize;
+		}
+		layerSize += levelSize;
+	}
+
+	return layer * layerSize + levelOffset;
+}
+
+uint32_t TextureAtlasBuilder::Add(const std::string& name, uint32_t width, uint32_t height, const uint8_t* pixels)
+{
+	if (width == 0 || height == 0)
+	{
+		throw std::runtime_error("Can't add an empty texture to an atlas: " + name);
+	}
+
+	SourceTexture texture;
+	{
+		texture.name = name;
+		texture.width = width;
+		texture.height = height;
+		texture.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	}
+
+	m_textures.push_back(std::move(texture));
+
+	return static_cast<uint32_t>(m_textures.size() - 1);
+}
+
+TextureAtlas TextureAtlasBuilder::Build(uint32_t size, uint32_t gutter) const
+{
+	if (gutter == 0 || (gutter & (gutter - 1)) != 0 || (size & (size - 1)) != 0 || size < gutter)
+	{
+		throw std::runtime_error("Atlas size and gutter have to be powers of two");
+	}
+
+	TextureAtlas atlas;
+	atlas.size = size;
+	// A gutter of 2^n texels is still at least one texel wide n mips down. Past that neighbours bleed, so the chain stops there.
+	atlas.mipLevels = static_cast<uint32_t>(std::log2(gutter)) + 1;
+
+	// Every rectangle is a multiple of the gutter in both directions, so the packer's skyline only ever
+	// places them on multiples of it as well. That keeps each 2x2 block of every mip inside one texture.
+	std::vector<stbrp_rect> pending(m_textures.size());
+	for (size_t i = 0; i < m_textures.size(); ++i)
+	{
+		const auto& texture = m_textures[i];
+
+		pending[i].id = static_cast<int>(i);
+		pending[i].w = static_cast<stbrp_coord>(AlignUp(texture.width + 2 * gutter, gutter));
+		pending[i].h = static_cast<stbrp_coord>(AlignUp(texture.height + 2 * gutter, gutter));
+
+		if (static_cast<uint32_t>(pending[i].w) > size || static_cast<uint32_t>(pending[i].h) > size)
+		{
+			throw std::runtime_error("Texture is too large for the atlas: " + texture.name);
+		}
+	}
+
+	// Fill a layer, whatever didn't fit goes to the next one.
+	std::vector<Placement> placements(m_textures.size());
+	std::vector<stbrp_node> nodes(size);
+	while (!pending.empty())
+	{
+		stbrp_context context;
+		stbrp_init_target(&context, static_cast<int>(size), static_cast<int>(size), nodes.data(), static_cast<int>(nodes.size()));
+		stbrp_pack_rects(&context, pending.data(), static_cast<int>(pending.size()));
+
+		std::vector<stbrp_rect> remaining;
+		for (const auto& rect : pending)
+		{
+			if (rect.was_packed)
+			{
+				placements[rect.id] = { atlas.layerCount, static_cast<uint32_t>(rect.x), static_cast<uint32_t>(rect.y) };
+			}
+			else
+			{
+				remaining.push_back(rect);
+			}
+		}
+
+		++atlas.layerCount;
+		pending = std::move(remaining);
+	}
+
+	atlas.pixels.resize(atlas.LevelOffset(atlas.layerCount, 0));
+	atlas.regions.resize(m_textures.size());
+
+	// Copy each texture in, the gutter and any padding from alignment repeat its edge texels.
+	for (size_t i = 0; i < m_textures.size(); ++i)
+	{
+		const auto& texture = m_textures[i];
+		const auto& placement = placements[i];
+
+		uint8_t* layer = atlas.pixels.data() + atlas.LevelOffset(placement.layer, 0);
+
+		const uint32_t width = AlignUp(texture.width + 2 * gutter, gutter);
+		const uint32_t height = AlignUp(texture.height + 2 * gutter, gutter);
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			auto sourceY = std::clamp(static_cast<int>(y) - static_cast<int>(gutter), 0, static_cast<int>(texture.height) - 1);
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				auto sourceX = std::clamp(static_cast<int>(x) - static_cast<int>(gutter), 0, static_cast<int>(texture.width) - 1);
+
+				memcpy(layer + ((placement.y + y) * size + placement.x + x) * 4,
+					texture.pixels.data() + (sourceY * texture.width + sourceX) * 4,
+					4);
+			}
+		}
+
+		auto& region = atlas.regions[i];
+		{
+			region.layer = placement.layer;
+			region.scale = glm::vec2(texture.width, texture.height) / static_cast<float>(size);
+			region.offset = glm::vec2(placement.x + gutter, placement.y + gutter) / static_cast<float>(size);
+		}
+	}
+
+	for (uint32_t layer = 0; layer < atlas.layerCount; ++layer)
+	{
+		for (uint32_t level = 1; level < atlas.mipLevels; ++level)
+		{
+			Downsample(atlas.pixels.data() + atlas.LevelOffset(layer, level - 1), size >> (level - 1), atlas.pixels.data() + atlas.LevelOffset(layer, level));
+		}
+	}
+
+	return atlas;
+}
+
+GpuTexture UploadTextureAtlas(const TextureAtlas& atlas)
+{
+	auto& vkManager = VulkanManager::GetVulkanManager();
+	auto& commandPool = vkManager.GetCommandPool();
+
+	GpuTexture gpuTexture;
+	gpuTexture.format = VK_FORMAT_R8G8B8A8_SRGB;
+	gpuTexture.width = atlas.size;
+	gpuTexture.height = atlas.size;
+	gpuTexture.mipLevels = atlas.mipLevels;
+	gpuTexture.layerCount = atlas.layerCount;
+
+	Buffer staging(atlas.pixels.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	staging.Map(atlas.pixels.data());
+
+	vkManager.CreateImage(atlas.size,
+		atlas.size,
+		atlas.mipLevels,
+		VK_SAMPLE_COUNT_1_BIT,
+		gpuTexture.format,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,	// Source for DropTopMips.
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		gpuTexture.image.m_image, gpuTexture.image.m_memory,
+		atlas.layerCount);
+
+	vkManager.TransitionImageLayout(commandPool, gpuTexture.image.m_image, gpuTexture.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, atlas.mipLevels, atlas.layerCount);
+
+	// One region per mip of every layer, all from the same staging buffer.
+	std::vector<VkBufferImageCopy> regions;
+	for (uint32_t layer = 0; layer < atlas.layerCount; ++layer)
+	{
+		for (uint32_t level = 0; level < atlas.mipLevels; ++level)
+		{
+			VkBufferImageCopy region{};
+			{
+				region.bufferOffset = atlas.LevelOffset(layer, level);
+				region.bufferRowLength = 0;
+				region.bufferImageHeight = 0;
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = level;
+				region.imageSubresource.baseArrayLayer = layer;
+				region.imageSubresource.layerCount = 1;
+				region.imageOffset = { 0, 0, 0 };
+				region.imageExtent = { atlas.size >> level, atlas.size >> level, 1 };
+			}
+
+			regions.push_back(region);
+		}
+	}
+
+	vkManager.CopyBufferToImage(commandPool, staging.m_buffer, gpuTexture.image.m_image, regions);
+
+	vkManager.TransitionImageLayout(commandPool, gpuTexture.image.m_image, gpuTexture.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, atlas.mipLevels, atlas.layerCount);
+
+	staging.Destroy();
+
+	// Sampled as a sampler2DArray even if everything fit in one layer.
+	gpuTexture.image.m_view = vkManager.CreateImageView(gpuTexture.image.m_image, gpuTexture.format, VK_IMAGE_ASPECT_COLOR_BIT, atlas.mipLevels, VK_IMAGE_VIEW_TYPE_2D_ARRAY, atlas.layerCount);
+
+	return gpuTexture;
+}
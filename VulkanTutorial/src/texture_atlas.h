@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "asset_cache.h"
+#include "constants.h"
+
+// Where a texture ended up in an atlas. Its UVs become uv * scale + offset, sampled from layer.
+// Only UVs inside [0, 1] can be remapped, textures that repeat have to stay on their own.
+struct AtlasRegion
+{
+	uint32_t layer = 0;
+	glm::vec2 scale = glm::vec2(1.0f);
+	glm::vec2 offset = glm::vec2(0.0f);
+
+	glm::vec2 Apply(glm::vec2 uv) const
+	{
+		return uv * scale + offset;
+	}
+};
+
+// Square RGBA8 array image, every layer with the same (short) mip chain.
+struct TextureAtlas
+{
+	uint32_t size = 0;
+	uint32_t layerCount = 0;
+	uint32_t mipLevels = 0;
+	std::vector<uint8_t> pixels;		// Layer by layer, each layer's mips from largest to smallest.
+	std::vector<AtlasRegion> regions;	// In the order the textures were added.
+
+	// Offset of a mip of a layer in bytes.
+	size_t LevelOffset(uint32_t layer, uint32_t level) const;
+};
+
+// Packs small textures into the layers of a few array images so they share one image, one
+// descriptor and one allocation instead of one each.
+// Every texture is surrounded by a gutter of its own edge texels so bilinear filtering and the
+// smaller mips don't bleed in neighbouring textures.
+class TextureAtlasBuilder
+{
+public:
+	// Larger textures gain little from sharing an image and would crowd out the small ones.
+	static bool IsCandidate(uint32_t width, uint32_t height)
+	{
+		return width <= TEXTURE_ATLAS_MAX_TEXTURE_SIZE && height <= TEXTURE_ATLAS_MAX_TEXTURE_SIZE;
+	}
+
+	// Pixels are tightly packed RGBA8 and copied. Returns the index of the texture's region.
+	uint32_t Add(const std::string& name, uint32_t width, uint32_t height, const uint8_t* pixels);
+
+	// The gutter has to be a power of two, it decides how many mips stay free of bleeding.
+	TextureAtlas Build(uint32_t size = TEXTURE_ATLAS_SIZE, uint32_t gutter = TEXTURE_ATLAS_GUTTER) const;
+
+	size_t Count() const { return m_textures.size(); }
+
+private:
+	struct SourceTexture
+	{
+		std::string name;
+		uint32_t width;
+		uint32_t height;
+		std::vector<uint8_t> pixels;
+	};
+
+	std::vector<SourceTexture> m_textures;
+};
+
+// Uploads every layer and mip in one copy and creates a 2D array view over all layers.
+GpuTexture UploadTextureAtlas(const TextureAtlas& atlas);
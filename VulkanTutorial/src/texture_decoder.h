@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asset_archive.h"
+#include "buffer.h"
+#include "helpers.h"
+#include "texture.h"
+#include "vulkan_manager.h"
+
+// A texture decoded off the main thread, waiting in a host visible staging buffer to be copied to an image.
+struct DecodedTexture
+{
+	std::string path;
+	int priority = 0;
+	std::atomic<bool> cancelled{ false };
+
+	// Filled in by the decoder.
+	int width = 0;
+	int height = 0;
+	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	std::vector<TextureLevel> levels;	// Only set for textures with prebuilt mips.
+	Buffer staging;
+	std::string error;					// Set instead of the above if decoding failed.
+
+	bool HasMipChain() const { return !levels.empty(); }
+
+	// The staging buffer is only needed until the copy to the image has been submitted.
+	void DestroyStaging()
+	{
+		if (staging.m_buffer != VK_NULL_HANDLE)
+		{
+			staging.Destroy();
+		}
+	}
+};
+
+using TextureDecodeHandle = std::shared_ptr<DecodedTexture>;
+
+// Pool of worker threads that decode textures (stb images, KTX2 transcoding) in parallel.
+// Each texture is decoded straight into a mapped staging buffer sized for it (see Texture::Load),
+// so the main thread only has to record the copy. Higher priorities are decoded first, equal priorities in submission order.
+class TextureDecoder
+{
+	static inline TextureDecoder* s_decoder;
+
+public:
+	static TextureDecoder& Get()
+	{
+		if (!s_decoder)
+		{
+			s_decoder = new TextureDecoder();
+		}
+
+		return *s_decoder;
+	}
+
+	// Threads are started on the first submit.
+	TextureDecodeHandle Submit(const std::string& path, int priority = 0)
+	{
+		auto texture = std::make_shared<DecodedTexture>();
+		texture->path = path;
+		texture->priority = priority;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (m_workers.empty())
+			{
+				StartWorkers();
+			}
+
+			m_queue.push({ texture, m_sequence++ });
+			++m_outstanding;
+		}
+
+		m_workAvailable.notify_one();
+
+		return texture;
+	}
+
+	// Queued textures are dropped without being decoded. One that's already being decoded is
+	// thrown away as soon as it finishes.
+	void Cancel(const TextureDecodeHandle& texture)
+	{
+		texture->cancelled = true;
+	}
+
+	// Next finished texture, or nullptr if none is ready yet.
+	TextureDecodeHandle Poll()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return PopFinished();
+	}
+
+	// Blocks until the next texture finishes. Returns nullptr once nothing is left to wait for.
+	TextureDecodeHandle WaitNext()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		while (true)
+		{
+			if (auto texture = PopFinished())
+			{
+				return texture;
+			}
+
+			if (m_outstanding == 0)
+			{
+				return nullptr;
+			}
+
+			m_decoded.wait(lock);
+		}
+	}
+
+	// Has to run before the device is destroyed, finished textures still own their staging buffers.
+	void Shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+
+		m_workAvailable.notify_all();
+
+		for (auto& worker : m_workers)
+		{
+			worker.join();
+		}
+		m_workers.clear();
+
+		for (auto& texture : m_finished)
+		{
+			texture->DestroyStaging();
+		}
+		m_finished.clear();
+
+		m_queue = {};
+		m_outstanding = 0;
+		m_stopping = false;
+	}
+
+private:
+	struct QueuedTexture
+	{
+		TextureDecodeHandle texture;
+		uint64_t sequence;
+
+		bool operator<(const QueuedTexture& other) const
+		{
+			if (texture->priority != other.texture->priority)
+			{
+				return texture->priority < other.texture->priority;
+			}
+
+			return sequence > other.sequence;
+		}
+	};
+
+	void StartWorkers()
+	{
+		// Leave a core for the main thread, it's recording uploads while the rest decode.
+		auto threadCount = WorkerThreadCount();
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			m_workers.emplace_back([this]() { WorkerLoop(); });
+		}
+	}
+
+	void WorkerLoop()
+	{
+		while (true)
+		{
+			TextureDecodeHandle texture;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_workAvailable.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+
+				if (m_stopping)
+				{
+					return;
+				}
+
+				texture = m_queue.top().texture;
+				m_queue.pop();
+			}
+
+			if (!texture->cancelled)
+			{
+				Decode(*texture);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_finished.push_back(texture);
+			}
+
+			m_decoded.notify_all();
+		}
+	}
+
+	static void Decode(DecodedTexture& decoded)
+	{
+		try
+		{
+			const bool supportsBC = VulkanManager::GetVulkanManager().SupportsTextureCompressionBC();
+
+			// Cooked textures are KTX2 with their mips already built.
+			auto cooked = AssetArchive::Get().Find(decoded.path, MappedFileAccess::Sequential);
+			Texture texture = cooked ? Texture(cooked->data, cooked->size, supportsBC) : Texture(decoded.path.c_str(), supportsBC);
+
+			try
+			{
+				if (!texture.IsValid())
+				{
+					throw std::runtime_error("Failed to load texture " + decoded.path);
+				}
+
+				decoded.width = texture.width;
+				decoded.height = texture.height;
+				decoded.format = texture.m_format;
+				if (texture.HasMipChain())
+				{
+					decoded.levels = texture.m_levels;
+				}
+
+				// Creating buffers and allocating memory don't need the device to be externally synchronized.
+				decoded.staging = Buffer(texture.Size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+				decoded.staging.Write([&](void* data) { texture.Load(data); });
+			}
+			catch (...)
+			{
+				texture.Free();
+				throw;
+			}
+
+			texture.Free();
+		}
+		catch (const std::exception& e)
+		{
+			decoded.DestroyStaging();
+			decoded.error = e.what();
+		}
+	}
+
+	// Cancelled textures are cleaned up here rather than handed out.
+	TextureDecodeHandle PopFinished()
+	{
+		while (!m_finished.empty())
+		{
+			auto texture = m_finished.front();
+			m_finished.pop_front();
+			--m_outstanding;
+
+			if (texture->cancelled)
+			{
+				texture->DestroyStaging();
+				continue;
+			}
+
+			return texture;
+		}
+
+		return nullptr;
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_decoded;
+
+	std::vector<std::thread> m_workers;
+	std::priority_queue<QueuedTexture> m_queue;
+	std::deque<TextureDecodeHandle> m_finished;
+	uint64_t m_sequence = 0;
+	size_t m_outstanding = 0;
+	bool m_stopping = false;
+};
@@ -27,6 +27,42 @@ struct UniformBufferObject
 	alignas(16) glm::mat4 proj;
 };
 
+// Vertex buffer bindings. Positions get their own tightly packed stream so passes that
+// only need positions (depth prepass, shadows, picking) fetch 12 bytes per vertex.
+enum VertexBinding : uint32_t
+{
+	VERTEX_BINDING_POSITION = 0,
+	VERTEX_BINDING_ATTRIBUTES = 1,
+};
+
+// glm::vec3 can be padded out to 16 bytes, this can't.
+struct VertexPosition
+{
+	float x, y, z;
+};
+
+static_assert(sizeof(VertexPosition) == 12, "The position stream has to be tightly packed");
+
+// Everything except the position.
+struct VertexAttributes
+{
+	glm::vec3 normal;
+	glm::vec3 color;
+	glm::vec2 uv;
+	glm::vec4 tangent;
+	uint32_t material;	// Index into Mesh::m_materials, picks the material's atlas region in vs.vert.
+};
+
+// A vertex shader input by name, and where in the vertex buffers it lives.
+struct VertexStreamAttribute
+{
+	const char* name;
+	uint32_t binding;
+	uint32_t offset;
+};
+
+// CPU side vertex used while loading and processing meshes. Uploaded as two streams,
+// see Mesh::GetPositionStream and Mesh::GetAttributeStream.
 class Vertex
 {
 public:
@@ -34,56 +70,61 @@ public:
 	glm::vec3 normal;
 	glm::vec3 color;
 	glm::vec2 uv;
+	glm::vec4 tangent;	// xyz - tangent, w - bitangent sign (MikkTSpace convention)
+	uint32_t material;
 	
-	static VkVertexInputBindingDescription GetBindingDescription()
+	static std::array<VkVertexInputBindingDescription, 2> GetBindingDescriptions()
 	{
 		// Determine per-vertex or per-instance, how many bytes between data entries.
+		std::array<VkVertexInputBindingDescription, 2> desc{};
+		{
+			desc[0] = GetPositionBindingDescription();
+
+			desc[1].binding = VERTEX_BINDING_ATTRIBUTES;	// Index of the binding in the array.
+			desc[1].stride = sizeof(VertexAttributes);
+			desc[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		}
+
+		return desc;
+	}
+
+	// Where each vertex shader input is read from, matched by the input's name. Locations and formats
+	// come from the shader, see PipelineReflection::VertexInput.
+	static const std::array<VertexStreamAttribute, 6>& GetStreamAttributes()
+	{
+		static const std::array<VertexStreamAttribute, 6> attributes = { {
+			{ "inPosition", VERTEX_BINDING_POSITION, 0 },
+			{ "inColor", VERTEX_BINDING_ATTRIBUTES, offsetof(VertexAttributes, color) },
+			{ "inUv", VERTEX_BINDING_ATTRIBUTES, offsetof(VertexAttributes, uv) },
+			{ "inNormal", VERTEX_BINDING_ATTRIBUTES, offsetof(VertexAttributes, normal) },
+			{ "inTangent", VERTEX_BINDING_ATTRIBUTES, offsetof(VertexAttributes, tangent) },
+			{ "inMaterial", VERTEX_BINDING_ATTRIBUTES, offsetof(VertexAttributes, material) },
+		} };
+
+		return attributes;
+	}
+
+	// Position only input for depth-only pipelines. Only the position buffer needs to be bound.
+	static VkVertexInputBindingDescription GetPositionBindingDescription()
+	{
 		VkVertexInputBindingDescription desc{};
 		{
-			desc.binding = 0;	// Index of the binding in the array.
-			desc.stride = sizeof(Vertex);	// We're packing everything into one struct.
+			desc.binding = VERTEX_BINDING_POSITION;
+			desc.stride = sizeof(VertexPosition);
 			desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 		}
 
 		return desc;
 	}
 
-	static std::array<struct VkVertexInputAttributeDescription, 4> GetAttributeDescriptions()
+	static VkVertexInputAttributeDescription GetPositionAttributeDescription()
 	{
-		// Describes how to handle vertex data.
-		std::array<VkVertexInputAttributeDescription, 4> desc{};
+		VkVertexInputAttributeDescription desc{};
 		{
-			// Position
-			{
-				desc[0].binding = 0;							// Which binding the data is coming from
-				desc[0].location = 0;							// Where to find in the shader
-				desc[0].format = VK_FORMAT_R32G32B32_SFLOAT;	// Type of data
-				desc[0].offset = offsetof(Vertex, position);	// Bytes between data
-			}
-
-			// Color
-			{
-				desc[1].binding = 0;							// Which binding the data is coming from
-				desc[1].location = 1;							// Where to find in the shader
-				desc[1].format = VK_FORMAT_R32G32B32_SFLOAT;	// Type of data
-				desc[1].offset = offsetof(Vertex, color);		// Bytes between data
-			}
-
-			// UV
-			{
-				desc[2].binding = 0;							// Which binding the data is coming from
-				desc[2].location = 2;							// Where to find in the shader
-				desc[2].format = VK_FORMAT_R32G32_SFLOAT;		// Type of data
-				desc[2].offset = offsetof(Vertex, uv);			// Bytes between data
-			}
-
-			// Normal
-			{
-				desc[3].binding = 0;
-				desc[3].location = 3;
-				desc[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-				desc[3].offset = offsetof(Vertex, normal);
-			}
+			desc.binding = VERTEX_BINDING_POSITION;
+			desc.location = 0;
+			desc.format = VK_FORMAT_R32G32B32_SFLOAT;
+			desc.offset = 0;
 		}
 
 		return desc;
@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include "mapped_file.h"
+
 static void CreateAttachmentDescription(
 	VkAttachmentDescription& attachment,
 	VkFormat format,
@@ -145,15 +147,17 @@ static VkFormat FindDepthFormat()
 
 namespace vkHelpers
 {
-	static VkShaderModule CreateShaderModule(const std::vector<char>& code)
+	// Takes the SPIR-V straight out of a mapping (see ShaderCode), it's never copied.
+	// pCode has to be 4 byte aligned, mapped files and archive blobs are page aligned.
+	static VkShaderModule CreateShaderModule(ByteSpan code)
 	{
 		// Wraps the code in a VkShaderModule object.
 
 		VkShaderModuleCreateInfo createInfo{};
 		{
 			createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			createInfo.codeSize = code.size();
-			createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+			createInfo.codeSize = code.size;
+			createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data);
 		}
 
 		VkShaderModule shaderModule;
@@ -170,6 +174,25 @@ namespace vkHelpers
 		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 	}
 
+	// Whole image, first mip and layer. For attachments, which without render passes transition themselves.
+	static VkImageMemoryBarrier ImageBarrier(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+	{
+		VkImageMemoryBarrier barrier{};
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = srcAccessMask;
+			barrier.dstAccessMask = dstAccessMask;
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image;
+			barrier.subresourceRange = { aspectMask, 0, 1, 0, 1 };
+		}
+
+		return barrier;
+	}
+
 	static uint32_t CaclulateMipLevels(int width, int height)
 	{
 		// Find largest dimension
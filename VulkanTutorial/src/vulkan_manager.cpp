@@ -1,12 +1,14 @@
 #include "vulkan_manager.h"
 
 #include <algorithm>
+#include <cstring>
 #include <set>
 
 #include "constants.h"
 #include "helpers.h"
 #include "debug_layer.h"
 #include "vulkan_helper.h"
+#include "vulkan_object_cache.h"
 
 void VulkanManager::Initialize()
 {
@@ -178,21 +180,109 @@ void VulkanManager::CreateLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	// Optional extensions are only enabled if the device has them.
+	auto deviceExtensions = g_deviceExtensions;
+	const bool hasDynamicRendering = g_preferDynamicRendering && IsDeviceExtensionSupported(m_physicalDevice, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+	const bool hasGraphicsPipelineLibrary = g_preferGraphicsPipelineLibrary &&
+		IsDeviceExtensionSupported(m_physicalDevice, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+		IsDeviceExtensionSupported(m_physicalDevice, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+
+	// VkPhysicalDeviceVulkan12Features can only be chained on a device that reports 1.2.
+	// On older ones it's left out and the extension structs are chained straight on.
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+	const bool hasVulkan12 = deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+
+	// Query optional features before enabling them.
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT supportedGraphicsPipelineLibrary{};
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR supportedDynamicRendering{};
+	VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+	VkPhysicalDeviceFeatures2 supportedFeatures{};
+	{
+		supportedGraphicsPipelineLibrary.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+		supportedDynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+		supportedDynamicRendering.pNext = hasGraphicsPipelineLibrary ? &supportedGraphicsPipelineLibrary : nullptr;
+		supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		supportedFeatures12.pNext = hasDynamicRendering ? &supportedDynamicRendering : supportedDynamicRendering.pNext;
+		supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures.pNext = hasVulkan12 ? &supportedFeatures12 : supportedFeatures12.pNext;
+		vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supportedFeatures);
+	}
+
 	// Specify device features
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	{
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.multiDrawIndirect = supportedFeatures.features.multiDrawIndirect;
+		deviceFeatures.textureCompressionBC = supportedFeatures.features.textureCompressionBC;
+	}
+
+	m_textureCompressionBCSupported = deviceFeatures.textureCompressionBC;
+
+	// Meshlet culling compacts its draws on the GPU and needs the count to come from a buffer.
+	VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+	{
+		deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		deviceFeatures12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
+	}
+
+	m_drawIndirectCountSupported = deviceFeatures.multiDrawIndirect && deviceFeatures12.drawIndirectCount;
+
+	// Passes are described while recording instead of by render pass and framebuffer objects.
+	// Without it everything falls back to render passes.
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR deviceDynamicRendering{};
+	{
+		deviceDynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+		deviceDynamicRendering.dynamicRendering = supportedDynamicRendering.dynamicRendering;
+	}
+
+	if (deviceDynamicRendering.dynamicRendering)
+	{
+		deviceExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+		deviceFeatures12.pNext = &deviceDynamicRendering;
+	}
+
+	// Pipelines are linked from separately compiled parts (see PipelineRegistry). Only worth it if linking
+	// is fast, otherwise pipelines are created whole.
+	VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProperties{};
+	if (supportedGraphicsPipelineLibrary.graphicsPipelineLibrary)
+	{
+		graphicsPipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 properties{};
+		{
+			properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties.pNext = &graphicsPipelineLibraryProperties;
+			vkGetPhysicalDeviceProperties2(m_physicalDevice, &properties);
+		}
+	}
+
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT deviceGraphicsPipelineLibrary{};
+	{
+		deviceGraphicsPipelineLibrary.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+		deviceGraphicsPipelineLibrary.graphicsPipelineLibrary = supportedGraphicsPipelineLibrary.graphicsPipelineLibrary && graphicsPipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+	}
+
+	if (deviceGraphicsPipelineLibrary.graphicsPipelineLibrary)
+	{
+		deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		deviceGraphicsPipelineLibrary.pNext = deviceFeatures12.pNext;
+		deviceFeatures12.pNext = &deviceGraphicsPipelineLibrary;
 	}
 
+	m_graphicsPipelineLibrarySupported = deviceGraphicsPipelineLibrary.graphicsPipelineLibrary;
+
 	// Create logical device
 	VkDeviceCreateInfo createInfo{};
 	{
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = hasVulkan12 ? &deviceFeatures12 : deviceFeatures12.pNext;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pEnabledFeatures = &deviceFeatures;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(g_deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = g_deviceExtensions.data();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 		if (g_enableValidationLayers)
 		{
@@ -207,6 +297,13 @@ void VulkanManager::CreateLogicalDevice()
 
 	VK_ASSERT(vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &m_device), "Failed to create logical device");
 
+	// Extension commands aren't exported by the loader.
+	if (deviceDynamicRendering.dynamicRendering)
+	{
+		m_vkCmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(m_device, "vkCmdBeginRenderingKHR"));
+		m_vkCmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(m_device, "vkCmdEndRenderingKHR"));
+	}
+
 	// Assign handles to queue
 	vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
 	vkGetDeviceQueue(m_device, indices.presentFamily.value(), 0, &m_presentQueue);
@@ -291,7 +388,7 @@ void VulkanManager::CleanupSwapChain()
 
 void VulkanManager::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
 	VkFormat format, VkImageTiling tiliing, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image,
-	VkDeviceMemory& imageMemory)
+	VkDeviceMemory& imageMemory, uint32_t arrayLayers)
 {
 	VkImageCreateInfo imageInfo{};
 	{
@@ -301,7 +398,7 @@ void VulkanManager::CreateImage(uint32_t width, uint32_t height, uint32_t mipLev
 		imageInfo.extent.height = static_cast<uint32_t>(height);
 		imageInfo.extent.depth = 1;
 		imageInfo.mipLevels = mipLevels;
-		imageInfo.arrayLayers = 1;
+		imageInfo.arrayLayers = arrayLayers;
 		imageInfo.format = format;
 		imageInfo.tiling = tiliing;
 		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -329,7 +426,8 @@ void VulkanManager::CreateImage(uint32_t width, uint32_t height, uint32_t mipLev
 	vkBindImageMemory(m_device, image, imageMemory, 0);
 }
 
-VkImageView VulkanManager::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
+VkImageView VulkanManager::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels,
+	VkImageViewType viewType, uint32_t layerCount)
 {
 	VkImageViewCreateInfo viewInfo{};
 	{
@@ -338,7 +436,7 @@ VkImageView VulkanManager::CreateImageView(VkImage image, VkFormat format, VkIma
 
 		// How to interpret the image data
 		{
-			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.viewType = viewType;
 			viewInfo.format = format;
 		}
 
@@ -356,7 +454,7 @@ VkImageView VulkanManager::CreateImageView(VkImage image, VkFormat format, VkIma
 			viewInfo.subresourceRange.baseMipLevel = 0;
 			viewInfo.subresourceRange.levelCount = mipLevels;
 			viewInfo.subresourceRange.baseArrayLayer = 0;
-			viewInfo.subresourceRange.layerCount = 1;
+			viewInfo.subresourceRange.layerCount = layerCount;
 		}
 	}
 
@@ -367,7 +465,7 @@ VkImageView VulkanManager::CreateImageView(VkImage image, VkFormat format, VkIma
 }
 
 void VulkanManager::TransitionImageLayout(VkCommandPool& commandPool, VkImage image, VkFormat format, VkImageLayout oldLayout,
-	VkImageLayout newLayout, uint32_t mipLevels)
+	VkImageLayout newLayout, uint32_t mipLevels, uint32_t layerCount)
 {
 	// Transition image from old layout to new layout
 
@@ -391,7 +489,7 @@ void VulkanManager::TransitionImageLayout(VkCommandPool& commandPool, VkImage im
 			barrier.subresourceRange.baseMipLevel = 0;
 			barrier.subresourceRange.levelCount = mipLevels;
 			barrier.subresourceRange.baseArrayLayer = 0;
-			barrier.subresourceRange.layerCount = 1;
+			barrier.subresourceRange.layerCount = layerCount;
 
 			if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
 			{
@@ -515,7 +613,8 @@ void VulkanManager::CreateTextureSampler(VkSampler& sampler, float maxLod)
 
 	// The sampler is distinct from the image. The sampler is a way to get data from a texture so we don't need to ref the image here.
 	// This is different than other APIs which requires referring to the actual image.
-	VK_ASSERT(vkCreateSampler(m_device, &samplerInfo, nullptr, &sampler), "Couldn't create texture sampler");
+	// Textures with the same mip count share one sampler, owned by the cache.
+	sampler = VulkanObjectCache::Get().GetSampler(samplerInfo);
 }
 
 void VulkanManager::GenerateMipMaps(VkCommandPool& commandPool, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
@@ -727,6 +826,20 @@ bool VulkanManager::CheckDeviceExtensionSupport(VkPhysicalDevice device)
 	return requiredExtensions.empty();
 }
 
+bool VulkanManager::IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	return std::any_of(availableExtensions.begin(), availableExtensions.end(), [extensionName](const VkExtensionProperties& extension)
+	{
+		return strcmp(extension.extensionName, extensionName) == 0;
+	});
+}
+
 bool VulkanManager::IsDeviceCompatible(VkPhysicalDevice device)
 {
 #if 1
@@ -1005,7 +1118,7 @@ void VulkanManager::EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkComma
 }
 
 void VulkanManager::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-	VkBuffer& buffer, VkDeviceMemory& memory)
+	VkBuffer& buffer, VkDeviceMemory& memory, VkDeviceSize* allocationSize)
 {
 	// Create a buffer for CPU to store data in for the GPU to read -----
 	VkBufferCreateInfo bufferInfo{};
@@ -1037,6 +1150,11 @@ void VulkanManager::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, Vk
 		VK_ASSERT(vkAllocateMemory(m_device, &allocInfo, nullptr, &memory), "Failed to allocate vertex buffer memory");
 	}
 
+	if (allocationSize)
+	{
+		*allocationSize = allocInfo.allocationSize;
+	}
+
 	// Bind the buffer memory -----
 	// We're allocating specifically for this vertex buffer, no offset.
 	// Offset has to be divisible by memoryRequirements.alignment otherwise.
@@ -1099,5 +1217,21 @@ void VulkanManager::CopyBufferToImage(VkCommandPool& commandPool, VkBuffer buffe
 		1,
 		&region);
 	
+	EndSingleTimeCommands(commandBuffer, commandPool);
+}
+
+void VulkanManager::CopyBufferToImage(VkCommandPool& commandPool, VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy>& regions)
+{
+	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(commandPool);
+
+	// Every level is copied in the same command.
+	vkCmdCopyBufferToImage(
+		commandBuffer,
+		buffer,
+		image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(regions.size()),
+		regions.data());
+
 	EndSingleTimeCommands(commandBuffer, commandPool);
 }
\ No newline at end of file
@@ -58,10 +58,10 @@ public:
 	void CleanupSwapChain();
 
 	// I think these make more sense in helper...
-	void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiliing, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+	void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiliing, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers = 1);
 	void CreateTextureImage(const char* path);
-	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
-	void TransitionImageLayout(VkCommandPool& commandPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
+	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t layerCount = 1);
+	void TransitionImageLayout(VkCommandPool& commandPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t layerCount = 1);
 	void CreateTextureSampler(VkSampler& sampler, float maxLod);
 
 	// TODO: This should be a helper function.
@@ -74,6 +74,7 @@ public:
 	// TODO: move these to vulkan_helper.h
 	void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+	bool IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
 	bool IsDeviceCompatible(VkPhysicalDevice device);
 	int RateDeviceCompatibility(VkPhysicalDevice device);
 	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
@@ -88,9 +89,12 @@ public:
 	VkCommandBuffer BeginSingleTimeCommands(VkCommandPool& commandPool);
 	void EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool& commandPool);
 
-	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory);
+	// allocationSize, if given, gets what the memory actually takes up including alignment.
+	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory, VkDeviceSize* allocationSize = nullptr);
 	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkCommandPool& commandPool, VkDeviceSize size);
 	void CopyBufferToImage(VkCommandPool& commandPool, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+	// One region per mip level, for textures that come with their mips.
+	void CopyBufferToImage(VkCommandPool& commandPool, VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy>& regions);
 	
 	// Should these be const?
 	VkInstance& GetInstance() { return m_instance; }
@@ -114,6 +118,15 @@ public:
 
 	VkDebugUtilsMessengerEXT& GetDebugMessenger() { return m_debugMessenger; }
 
+	bool SupportsDrawIndirectCount() { return m_drawIndirectCountSupported; }
+	bool SupportsTextureCompressionBC() { return m_textureCompressionBCSupported; }
+	bool SupportsGraphicsPipelineLibrary() { return m_graphicsPipelineLibrarySupported; }
+
+	// True if passes are recorded with BeginRendering/EndRendering, false if they use render passes and framebuffers.
+	bool UsesDynamicRendering() { return m_vkCmdBeginRendering != nullptr; }
+	void BeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfoKHR& renderingInfo) { m_vkCmdBeginRendering(commandBuffer, &renderingInfo); }
+	void EndRendering(VkCommandBuffer commandBuffer) { m_vkCmdEndRendering(commandBuffer); }
+
 	GLFWwindow* GetWindow() { return m_window; };
 
 	std::vector<VkCommandBuffer>& GetCommandBuffers() { return m_globalCommandBuffers; }
@@ -159,6 +172,15 @@ private:
 	
 	VkDebugUtilsMessengerEXT m_debugMessenger;
 
+	// Optional device features
+	bool m_drawIndirectCountSupported = false;
+	bool m_textureCompressionBCSupported = false;
+	bool m_graphicsPipelineLibrarySupported = false;	// VK_EXT_graphics_pipeline_library with fast linking.
+
+	// VK_KHR_dynamic_rendering, null if it isn't enabled.
+	PFN_vkCmdBeginRenderingKHR m_vkCmdBeginRendering = nullptr;
+	PFN_vkCmdEndRenderingKHR m_vkCmdEndRendering = nullptr;
+
 	// GLFW
 	GLFWwindow* m_window;
 };
\ No newline at end of file
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#endif
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan_manager.h"
+
+// Samplers, descriptor set layouts, pipeline layouts and render passes keyed by the contents of their
+// create infos. Asking for the same thing twice returns the same handle, so any number of materials
+// share a handful of objects and recreating them (e.g. on resize) is a lookup.
+// The cache owns every handle it returns, nothing it hands out should be destroyed by the caller.
+class VulkanObjectCache
+{
+	static inline VulkanObjectCache* s_cache;
+
+public:
+	static VulkanObjectCache& Get()
+	{
+		if (!s_cache)
+		{
+			s_cache = new VulkanObjectCache();
+		}
+
+		return *s_cache;
+	}
+
+	VkSampler GetSampler(const VkSamplerCreateInfo& info)
+	{
+		Key key;
+		key.Add(info.flags);
+		key.Add(info.magFilter);
+		key.Add(info.minFilter);
+		key.Add(info.mipmapMode);
+		key.Add(info.addressModeU);
+		key.Add(info.addressModeV);
+		key.Add(info.addressModeW);
+		key.Add(info.mipLodBias);
+		key.Add(info.anisotropyEnable);
+		key.Add(info.maxAnisotropy);
+		key.Add(info.compareEnable);
+		key.Add(info.compareOp);
+		key.Add(info.minLod);
+		key.Add(info.maxLod);
+		key.Add(info.borderColor);
+		key.Add(info.unnormalizedCoordinates);
+
+		return FindOrCreate(m_samplers, key, info.pNext, [&info](VkDevice device, VkSampler& sampler)
+		{
+			return vkCreateSampler(device, &info, nullptr, &sampler);
+		});
+	}
+
+	VkDescriptorSetLayout GetDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& info)
+	{
+		Key key;
+		key.Add(info.flags);
+		key.Add(info.bindingCount);
+		for (uint32_t i = 0; i < info.bindingCount; ++i)
+		{
+			const auto& binding = info.pBindings[i];
+			key.Add(binding.binding);
+			key.Add(binding.descriptorType);
+			key.Add(binding.descriptorCount);
+			key.Add(binding.stageFlags);
+			key.Add(binding.pImmutableSamplers != nullptr);
+			if (binding.pImmutableSamplers)
+			{
+				for (uint32_t sampler = 0; sampler < binding.descriptorCount; ++sampler)
+				{
+					key.Add(binding.pImmutableSamplers[sampler]);
+				}
+			}
+		}
+
+		return FindOrCreate(m_setLayouts, key, info.pNext, [&info](VkDevice device, VkDescriptorSetLayout& layout)
+		{
+			return vkCreateDescriptorSetLayout(device, &info, nullptr, &layout);
+		});
+	}
+
+	VkPipelineLayout GetPipelineLayout(const VkPipelineLayoutCreateInfo& info)
+	{
+		Key key;
+		key.Add(info.flags);
+		key.Add(info.setLayoutCount);
+		for (uint32_t i = 0; i < info.setLayoutCount; ++i)
+		{
+			key.Add(info.pSetLayouts[i]);
+		}
+		key.Add(info.pushConstantRangeCount);
+		for (uint32_t i = 0; i < info.pushConstantRangeCount; ++i)
+		{
+			key.Add(info.pPushConstantRanges[i].stageFlags);
+			key.Add(info.pPushConstantRanges[i].offset);
+			key.Add(info.pPushConstantRanges[i].size);
+		}
+
+		return FindOrCreate(m_pipelineLayouts, key, info.pNext, [&info](VkDevice device, VkPipelineLayout& layout)
+		{
+			return vkCreatePipelineLayout(device, &info, nullptr, &layout);
+		});
+	}
+
+	VkRenderPass GetRenderPass(const VkRenderPassCreateInfo& info)
+	{
+		Key key;
+		key.Add(info.flags);
+		key.Add(info.attachmentCount);
+		for (uint32_t i = 0; i < info.attachmentCount; ++i)
+		{
+			const auto& attachment = info.pAttachments[i];
+			key.Add(attachment.flags);
+			key.Add(attachment.format);
+			key.Add(attachment.samples);
+			key.Add(attachment.loadOp);
+			key.Add(attachment.storeOp);
+			key.Add(attachment.stencilLoadOp);
+			key.Add(attachment.stencilStoreOp);
+			key.Add(attachment.initialLayout);
+			key.Add(attachment.finalLayout);
+		}
+
+		key.Add(info.subpassCount);
+		for (uint32_t i = 0; i < info.subpassCount; ++i)
+		{
+			const auto& subpass = info.pSubpasses[i];
+			key.Add(subpass.flags);
+			key.Add(subpass.pipelineBindPoint);
+			key.AddReferences(subpass.inputAttachmentCount, subpass.pInputAttachments);
+			key.AddReferences(subpass.colorAttachmentCount, subpass.pColorAttachments);
+			// Resolve attachments are optional, but when present there's one per color attachment.
+			key.AddReferences(subpass.pResolveAttachments ? subpass.colorAttachmentCount : 0, subpass.pResolveAttachments);
+			key.AddReferences(subpass.pDepthStencilAttachment ? 1 : 0, subpass.pDepthStencilAttachment);
+			key.Add(subpass.preserveAttachmentCount);
+			for (uint32_t preserve = 0; preserve < subpass.preserveAttachmentCount; ++preserve)
+			{
+				key.Add(subpass.pPreserveAttachments[preserve]);
+			}
+		}
+
+		key.Add(info.dependencyCount);
+		for (uint32_t i = 0; i < info.dependencyCount; ++i)
+		{
+			const auto& dependency = info.pDependencies[i];
+			key.Add(dependency.srcSubpass);
+			key.Add(dependency.dstSubpass);
+			key.Add(dependency.srcStageMask);
+			key.Add(dependency.dstStageMask);
+			key.Add(dependency.srcAccessMask);
+			key.Add(dependency.dstAccessMask);
+			key.Add(dependency.dependencyFlags);
+		}
+
+		return FindOrCreate(m_renderPasses, key, info.pNext, [&info](VkDevice device, VkRenderPass& renderPass)
+		{
+			return vkCreateRenderPass(device, &info, nullptr, &renderPass);
+		});
+	}
+
+	// Number of objects created so far.
+	size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_samplers.size() + m_setLayouts.size() + m_pipelineLayouts.size() + m_renderPasses.size();
+	}
+
+	// Has to run before the device is destroyed, after anything using the objects is gone.
+	void Destroy()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto device = VulkanManager::GetVulkanManager().GetDevice();
+
+		for (auto& [key, pipelineLayout] : m_pipelineLayouts)
+		{
+			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+		}
+
+		for (auto& [key, setLayout] : m_setLayouts)
+		{
+			vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+		}
+
+		for (auto& [key, sampler] : m_samplers)
+		{
+			vkDestroySampler(device, sampler, nullptr);
+		}
+
+		for (auto& [key, renderPass] : m_renderPasses)
+		{
+			vkDestroyRenderPass(device, renderPass, nullptr);
+		}
+
+		m_pipelineLayouts.clear();
+		m_setLayouts.clear();
+		m_samplers.clear();
+		m_renderPasses.clear();
+	}
+
+private:
+	// Create infos flattened field by field. Padding and pointers would make the raw structs compare unequal
+	// even when they describe the same object, so only the values (and whatever the pointers point at) go in.
+	struct Key
+	{
+		std::string bytes;
+
+		template<typename T>
+		void Add(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be part of a key");
+			bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		void AddReferences(uint32_t count, const VkAttachmentReference* references)
+		{
+			Add(count);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				Add(references[i].attachment);
+				Add(references[i].layout);
+			}
+		}
+
+		bool operator==(const Key& other) const { return bytes == other.bytes; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			return static_cast<size_t>(XXH3_64bits(key.bytes.data(), key.bytes.size()));
+		}
+	};
+
+	template<typename Handle>
+	using ObjectMap = std::unordered_map<Key, Handle, KeyHash>;
+
+	template<typename Handle, typename CreateFunction>
+	Handle FindOrCreate(ObjectMap<Handle>& objects, const Key& key, const void* next, CreateFunction create)
+	{
+		// Extension structs aren't part of the key, two infos differing only there would get the same object.
+		if (next)
+		{
+			throw std::runtime_error("Create infos with a pNext chain can't be cached");
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = objects.find(key);
+		if (it != objects.end())
+		{
+			return it->second;
+		}
+
+		Handle handle = VK_NULL_HANDLE;
+		if (create(VulkanManager::GetVulkanManager().GetDevice(), handle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create a cached Vulkan object");
+		}
+
+		objects.emplace(key, handle);
+
+		return handle;
+	}
+
+	std::mutex m_mutex;
+	ObjectMap<VkSampler> m_samplers;
+	ObjectMap<VkDescriptorSetLayout> m_setLayouts;
+	ObjectMap<VkPipelineLayout> m_pipelineLayouts;
+	ObjectMap<VkRenderPass> m_renderPasses;
+};